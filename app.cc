@@ -1,7 +1,11 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
 #include <cstdio>
 #include <cstdint>
 #include <inttypes.h>
 #include <memory>
+#include <mutex>
 #include <thread>
 
 #include "absl/flags/flag.h"
@@ -20,8 +24,15 @@
 #include "nes/apu.h"
 #include "nes/cartridge.h"
 #include "nes/controller.h"
+#include "nes/cpu6502.h"
+#include "nes/emulation_thread.h"
+#include "nes/frame_pacer.h"
 #include "nes/ppu.h"
 #include "nes/nes.h"
+#include "nes/rewind.h"
+#include "nes/sdl_input.h"
+#include "nes/state_files.h"
+#include "nes/wav_sink.h"
 #include "proto/config.pb.h"
 #include "pybind11/pybind11.h"
 #include "pybind11/embed.h"
@@ -40,6 +51,14 @@
 #endif
 
 ABSL_FLAG(bool, focus, false, "Whether joystick events require window focus");
+ABSL_FLAG(std::string, wavfile, "", "Write audio to the named file");
+ABSL_FLAG(double, ui_fps, 0,
+          "How often to redraw the window, or 0 for the display's refresh "
+          "rate; the NES runs at its own pace");
+ABSL_FLAG(double, rewind_seconds, 600,
+          "How far back State History keeps the states, in seconds");
+ABSL_FLAG(double, rewind_megabytes, 32,
+          "How much memory State History may use, in megabytes");
 ABSL_DECLARE_FLAG(double, volume);
 ABSL_DECLARE_FLAG(std::string, midi);
 ABSL_DECLARE_FLAG(std::string, midi_input);
@@ -52,6 +71,29 @@ using proto::ControllerButtons;
 void ProtoNES::Init() {
     loaded_ = false;
     nes_ = absl::make_unique<NES>();
+    emulation_ = absl::make_unique<EmulationThread>(
+            nes_.get(), [this]() { EmulateFrame(); });
+    double refresh = 0;
+    SDL_DisplayMode mode;
+    if (SDL_GetCurrentDisplayMode(0, &mode) == 0) {
+        refresh = mode.refresh_rate;
+    }
+    emulation_->pacer()->set_display_refresh(refresh);
+    double ui_fps = absl::GetFlag(FLAGS_ui_fps);
+    if (ui_fps <= 0) {
+        ui_fps = refresh > 0 ? refresh : 60.0;
+    }
+    ui_pacer_ = absl::make_unique<FramePacer>(ui_fps);
+    rewind_ = absl::make_unique<Rewind>(nes_.get());
+    rewind_->set_capacity(absl::GetFlag(FLAGS_rewind_seconds),
+                          absl::GetFlag(FLAGS_rewind_megabytes));
+    state_files_ = absl::make_unique<StateFiles>(nes_.get());
+    input_ = absl::make_unique<SdlInput>(nes_.get());
+    const auto& wavfile = absl::GetFlag(FLAGS_wavfile);
+    if (!wavfile.empty()) {
+        wav_ = absl::make_unique<WavSink>(wavfile);
+        nes_->apu()->set_sink(wav_.get());
+    }
     scale_ = 4.0f;
     aspect_ = 1.2f;
     memset(frametime_, 0, sizeof(frametime_));
@@ -89,7 +131,7 @@ void ProtoNES::Init() {
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 256, 240, 0, GL_RGBA,
                  GL_UNSIGNED_BYTE, nes_->ppu()->picture());
     InitControllers();
-    InitAudio(44100, 1, APU::BUFFERLEN / 2, AUDIO_F32);
+    InitAudio(44100, 1, APU::DEVICE_BUFFERLEN, AUDIO_F32);
 
     py::exec(R"py(
         from content.protones import *
@@ -103,7 +145,6 @@ void ProtoNES::Init() {
         buttons_[b.scancode()] = b.button();
     }
     save_state_slot_ = 1;
-    history_ptr_ = 0;
     history_enabled_ = false;
 }
 
@@ -120,11 +161,11 @@ void ProtoNES::ProcessEvent(SDL_Event* event) {
     case SDL_CONTROLLERBUTTONDOWN:
     case SDL_CONTROLLERBUTTONUP:
     case SDL_CONTROLLERAXISMOTION:
-        nes_->controller(0)->set_buttons(event);
+        input_->HandleController(event);
         break;
     case SDL_KEYDOWN:
         if (!io.WantCaptureKeyboard) {
-            nes_->HandleKeyboard(event);
+            input_->HandleKeyboard(event);
             ControllerButtons b = buttons_[event->key.keysym.scancode];
             switch(b) {
             case ControllerButtons::SaveSlot0:
@@ -139,21 +180,14 @@ void ProtoNES::ProcessEvent(SDL_Event* event) {
             case ControllerButtons::SaveSlot9:
                 save_state_slot_ = int(b - ControllerButtons::SaveSlot0);
                 console_->AddLog("Save state slot set to %d", save_state_slot_);
+                PrefetchSlots(save_state_slot_);
                 break;
-            case ControllerButtons::StateReverse: {
-                size_t i = (history_ptr_ - 1) % HISTORY_SIZE;
-                if (nes_->LoadState(history_[i])) {
-                    history_ptr_ = i;
-                }
+            case ControllerButtons::StateReverse:
+                rewind_->Step(-1);
                 break;
-            }
-            case ControllerButtons::StateForward: {
-                size_t i = (history_ptr_ + 1) % HISTORY_SIZE;
-                if (nes_->LoadState(history_[i])) {
-                    history_ptr_ = i;
-                }
+            case ControllerButtons::StateForward:
+                rewind_->Step(1);
                 break;
-            }
 
             default: ;
             }
@@ -161,7 +195,7 @@ void ProtoNES::ProcessEvent(SDL_Event* event) {
         break;
     case SDL_KEYUP:
         if (!io.WantCaptureKeyboard) {
-            nes_->HandleKeyboard(event);
+            input_->HandleKeyboard(event);
             ControllerButtons b = buttons_[event->key.keysym.scancode];
             switch(b) {
             case ControllerButtons::ControllerSaveState:
@@ -182,18 +216,29 @@ void ProtoNES::ProcessEvent(SDL_Event* event) {
     }
 }
 
-void ProtoNES::SaveSlot(int slot) {
-    std::string fn = os::path::DataPath({
+std::string ProtoNES::SlotFilename(int slot) {
+    return os::path::DataPath({
             absl::StrCat(File::Basename(nes_->cartridge()->filename()),
                          ".state", slot)});
-    nes_->SaveStateToFile(fn);
+}
+
+void ProtoNES::SaveSlot(int slot) {
+    // The state is written on the StateFiles thread, which reports to the
+    // console when it's done.
+    state_files_->Save(SlotFilename(slot));
 }
 
 void ProtoNES::LoadSlot(int slot) {
-    std::string fn = os::path::DataPath({
-            absl::StrCat(File::Basename(nes_->cartridge()->filename()),
-                         ".state", slot)});
-    nes_->LoadStateFromFile(fn);
+    if (!state_files_->Load(SlotFilename(slot))) {
+        console_->AddLog("[error] Could not load slot %d", slot);
+    }
+    PrefetchSlots(slot);
+}
+
+void ProtoNES::PrefetchSlots(int slot) {
+    for(int s=std::max(0, slot - 1); s<=std::min(9, slot + 1); s++) {
+        state_files_->Prefetch(SlotFilename(s));
+    }
 }
 
 void ProtoNES::ProcessMessage(const std::string& msg, const void* extra) {
@@ -227,9 +272,12 @@ bool ProtoNES::PreDraw() {
 
     glEnable(GL_TEXTURE_2D);
     glBindTexture(GL_TEXTURE_2D, nesimg_);
-    glTexSubImage2D(GL_TEXTURE_2D, 0,
-                  0, 0, 256, 240,
-                  GL_RGBA, GL_UNSIGNED_BYTE, nes_->ppu()->picture());
+    FrameBuffer* frames = emulation_->frames();
+    if (frames->Acquire()) {
+        glTexSubImage2D(GL_TEXTURE_2D, 0,
+                      0, 0, 256, 240,
+                      GL_RGBA, GL_UNSIGNED_BYTE, frames->picture());
+    }
     return true;
 }
 
@@ -246,7 +294,45 @@ void ProtoNES::DrawPreferences() {
     ImGuiIO& io = ImGui::GetIO();
     ImGui::Text("Fps: %.1f, %.1f", io.Framerate, fta);
 
+    ImGui::Text("Speed: %.2fx", nes_->speedup());
+    DrawPacing("Emulation", emulation_->pacer());
+    DrawPacing("Display", ui_pacer_.get());
+
     ImGui::PushItemWidth(200);
+    bool fast_forward = nes_->fast_forward();
+    if (ImGui::Checkbox("Fast Forward", &fast_forward)) {
+        nes_->set_fast_forward(fast_forward);
+    }
+    // A speed of 0 is uncapped; capping it again starts at 4x.  Slower
+    // than 1x isn't possible.
+    float speed = nes_->fast_forward_speed();
+    bool uncapped = speed <= 0;
+    if (ImGui::Checkbox("Uncapped Fast Forward", &uncapped)) {
+        nes_->set_fast_forward_speed(uncapped ? 0.0 : 4.0);
+    }
+    if (!uncapped &&
+        ImGui::DragFloat("Fast Forward Speed", &speed, 0.1f, 1.0f, 16.0f,
+                         "%.1fx")) {
+        nes_->set_fast_forward_speed(speed);
+    }
+    int run_ahead = nes_->run_ahead();
+    if (ImGui::SliderInt("Run Ahead", &run_ahead, 0, 4)) {
+        nes_->set_run_ahead(run_ahead);
+    }
+    if (run_ahead) {
+        const auto& t = nes_->run_ahead_timing();
+        ImGui::Text("Frame: %.2f ms, each frame ahead: %.2f ms",
+                    t.frame * 1e3, t.per_frame() * 1e3);
+        ImGui::Text("Save: %.1f us, load: %.1f us",
+                    t.save * 1e6, t.load * 1e6);
+    }
+    if (history_enabled_) {
+        const auto stats = rewind_->stats();
+        ImGui::Text("State History: %.1f s in %.2f MB (%" PRIu64 " keyframes)",
+                    stats.seconds, stats.bytes / 1048576.0, stats.keyframes);
+        ImGui::Text("Save: %.1f us, compress: %.1f us per frame",
+                    stats.save * 1e6, stats.compress * 1e6);
+    }
     ImGui::DragFloat("Zoom", &scale_, 0.01f, 0.0f, 10.0f, "%.02f");
     ImGui::DragFloat("Aspect Ratio", &aspect_, 0.001f, 0.0f, 2.0f, "%.03f");
     if (ImGui::SliderFloat("Volume", &volume_, 0.0f, 1.0f)) {
@@ -257,6 +343,29 @@ void ProtoNES::DrawPreferences() {
     ImGui::End();
 }
 
+void ProtoNES::DrawPacing(const char* label, FramePacer* pacer) {
+    const auto stats = pacer->stats();
+    ImGui::PushID(label);
+    ImGui::Text("%s: %.4f fps (%+.3f%%), missed %" PRIu64 " of %" PRIu64,
+                label, stats.fps, stats.correction * 100,
+                stats.missed, stats.frames);
+    // The counts span orders of magnitude: plot their logarithms.
+    float jitter[FramePacer::kBuckets];
+    for(int i=0; i<FramePacer::kBuckets; i++) {
+        jitter[i] = std::log10(1.0f + stats.jitter[i]);
+    }
+    char overlay[64];
+    snprintf(overlay, sizeof(overlay), "jitter 16us..16ms, max %.2f ms",
+             stats.max_jitter * 1e3);
+    ImGui::PlotHistogram("", jitter, FramePacer::kBuckets, 0, overlay,
+                         0.0f, FLT_MAX, ImVec2(0, 48));
+    ImGui::SameLine();
+    if (ImGui::Button("Reset")) {
+        pacer->ResetStats();
+    }
+    ImGui::PopID();
+}
+
 void ProtoNES::Draw() {
     ImGui::SetNextWindowSize(ImVec2(500,300), ImGuiCond_FirstUseEver);
     if (ImGui::BeginMainMenuBar()) {
@@ -313,8 +422,10 @@ save_as:
             ImGui::AlignTextToFramePadding();
             ImGui::Text("Save Slot"); ImGui::SameLine();
             ImGui::PushItemWidth(64);
-            ImGui::Combo("##saveslot", &save_state_slot_,
-                         "0\0001\0002\0003\0004\0005\0006\0007\0008\0009\000\000\000");
+            if (ImGui::Combo("##saveslot", &save_state_slot_,
+                             "0\0001\0002\0003\0004\0005\0006\0007\0008\0009\000\000\000")) {
+                PrefetchSlots(save_state_slot_);
+            }
             ImGui::PopItemWidth();
             hook_.attr("FileMenu")();
             ImGui::Separator();
@@ -327,7 +438,24 @@ save_as:
             ImGui::MenuItem("Debug Console", nullptr, &console_->visible());
             ImGui::MenuItem("Preferences", nullptr, &preferences_);
             ImGui::MenuItem("Midi Setup", nullptr, &midi_setup_->visible(), !absl::GetFlag(FLAGS_midi).empty());
-            ImGui::MenuItem("State History", nullptr, &history_enabled_);
+            if (ImGui::MenuItem("State History", nullptr, &history_enabled_) &&
+                !history_enabled_) {
+                rewind_->Clear();
+            }
+            // The item only sets the explicit request.  When something
+            // else needs the instrumented path, it's shown checked and
+            // can't be turned off here.
+            bool instrumented = nes_->cpu()->instrumented_requested();
+            const bool forced = !instrumented && nes_->instrumented();
+            if (ImGui::MenuItem("Instrument CPU", nullptr,
+                                instrumented || forced, !forced)) {
+                nes_->cpu()->set_instrumented(!instrumented);
+            }
+            if (forced &&
+                ImGui::IsItemHovered(ImGuiHoveredFlags_AllowWhenDisabled)) {
+                ImGui::SetTooltip("On while hooks, tracing, the code/data "
+                                  "log or the profile need it");
+            }
             hook_.attr("EditMenu")();
             ImGui::EndMenu();
         }
@@ -400,26 +528,66 @@ save_as:
     hook_.attr("Draw")();
 }
 
+void ProtoNES::EmulateFrame() {
+    // The hook calls NES::EmulateFrame, which locks the NES and lets go
+    // of the GIL while it runs.
+    uint64_t f0;
+    {
+        std::lock_guard<std::recursive_mutex> lock(nes_->mutex());
+        f0 = nes_->frame();
+    }
+    int64_t t0 = os::utime_now();
+    {
+        py::gil_scoped_acquire gil;
+        hook_.attr("EmulateFrame")();
+    }
+    int64_t t1 = os::utime_now();
+    std::lock_guard<std::recursive_mutex> lock(nes_->mutex());
+    uint64_t f1 = nes_->frame();
+    if (f0 != f1) {
+        frametime_[ftp_] = (t1 - t0) / 1e6f;
+        ftp_ = (ftp_ + 1) % 100;
+    }
+    if (history_enabled_ && f0 != f1) {
+        rewind_->Push();
+    }
+}
+
 void ProtoNES::Run() {
     running_ = true;
-    if (loaded_)
+    if (loaded_) {
         nes_->Reset();
+        PrefetchSlots(save_state_slot_);
+    }
 
+    // The NES runs on the emulation thread.  This one only locks it, and
+    // takes the GIL, to handle events and draw the windows; the picture
+    // comes from the emulation thread's frame buffer.  The NES is always
+    // locked before taking the GIL, as the emulation thread does.
+    py::gil_scoped_release nogil;
+    emulation_->Start();
     while(running_) {
-        py::gil_scoped_acquire gil;
-        uint64_t f0 = nes_->frame();
-        hook_.attr("EmulateFrame")();
-        uint64_t f1 = nes_->frame();
-        if (history_enabled_ && f0 != f1) {
-            history_ptr_ = (history_ptr_ + 1) % HISTORY_SIZE;
-            history_[history_ptr_] = nes_->SaveState();
+        BeginDraw();
+        {
+            std::lock_guard<std::recursive_mutex> lock(nes_->mutex());
+            py::gil_scoped_acquire gil;
+            for(const auto& msg : state_files_->TakeMessages()) {
+                console_->AddLog("%s", msg.c_str());
+            }
+            DrawWidgets();
         }
-        BaseDraw();
-        if (!ProcessEvents()) {
-            running_ = false;
-            break;
+        EndDraw();
+        {
+            std::lock_guard<std::recursive_mutex> lock(nes_->mutex());
+            py::gil_scoped_acquire gil;
+            if (!ProcessEvents()) {
+                running_ = false;
+            }
         }
+        ui_pacer_->Wait();
     }
+    emulation_->Stop();
+    state_files_->Sync();
     nes_->Shutdown();
 }
 
@@ -449,7 +617,62 @@ PYBIND11_EMBEDDED_MODULE(app, m) {
         .def_property("aspect", &ProtoNES::aspect, &ProtoNES::set_aspect)
         .def_property("volume", &ProtoNES::volume, &ProtoNES::set_volume)
         .def_property_readonly("extra_flags", &ProtoNES::extra_flags)
-        .def_property("hook", &ProtoNES::hook, &ProtoNES::set_hook);
+        .def_property("hook", &ProtoNES::hook, &ProtoNES::set_hook)
+        .def_property_readonly("emulation_pacing", [](ProtoNES* self) {
+                return self->emulation()->pacer()->stats();
+            }, "Frame pacing statistics of the emulation thread")
+        .def_property_readonly("display_pacing", [](ProtoNES* self) {
+                return self->ui_pacer()->stats();
+            }, "Frame pacing statistics of drawing the window")
+        .def_property_readonly("rewind", &ProtoNES::rewind,
+                               py::return_value_policy::reference_internal,
+                               "The State History");
+
+    py::class_<Rewind>(m, "Rewind")
+        .def("Step", &Rewind::Step, "Step the NES back or forth n frames",
+             py::arg("n"))
+        .def("Seek", &Rewind::Seek, "Go to a frame", py::arg("index"))
+        .def("Clear", &Rewind::Clear)
+        .def("set_capacity", &Rewind::set_capacity,
+             py::arg("seconds"), py::arg("megabytes"))
+        .def_property_readonly("first", &Rewind::first)
+        .def_property_readonly("last", &Rewind::last)
+        .def_property_readonly("position", &Rewind::position)
+        .def_property_readonly("stats", &Rewind::stats);
+
+    py::class_<Rewind::Stats>(m, "RewindStats")
+        .def_readonly("frames", &Rewind::Stats::frames)
+        .def_readonly("keyframes", &Rewind::Stats::keyframes)
+        .def_readonly("seconds", &Rewind::Stats::seconds,
+                      "Seconds of play kept")
+        .def_readonly("bytes", &Rewind::Stats::bytes, "Memory used")
+        .def_readonly("snapshot", &Rewind::Stats::snapshot,
+                      "Size of one state, uncompressed")
+        .def_readonly("save", &Rewind::Stats::save,
+                      "Seconds per frame on the emulation thread")
+        .def_readonly("compress", &Rewind::Stats::compress,
+                      "Seconds per frame on the compressor thread");
+
+    py::class_<FramePacer::Stats>(m, "FramePacerStats")
+        .def_readonly("frames", &FramePacer::Stats::frames)
+        .def_readonly("missed", &FramePacer::Stats::missed,
+                      "Frames which started after their deadline")
+        .def_property_readonly("jitter", [](const FramePacer::Stats& self) {
+                return std::vector<uint64_t>(self.jitter,
+                                             self.jitter + FramePacer::kBuckets);
+            }, "Histogram of how late the frames started")
+        .def_property_readonly_static("jitter_limits", [](py::object) {
+                std::vector<double> limits;
+                for(int i=0; i<FramePacer::kBuckets; i++) {
+                    limits.push_back(FramePacer::bucket_limit(i));
+                }
+                return limits;
+            }, "Upper limit of each jitter bucket, in seconds")
+        .def_readonly("max_jitter", &FramePacer::Stats::max_jitter,
+                      "Latest any frame started, in seconds")
+        .def_readonly("fps", &FramePacer::Stats::fps, "Measured frame rate")
+        .def_readonly("correction", &FramePacer::Stats::correction,
+                      "Correction applied to the nominal frame rate");
 
     m.def("root", app_root);
 }
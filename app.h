@@ -16,10 +16,16 @@ namespace protones {
 
 class APUDebug;
 class ControllerDebug;
+class EmulationThread;
+class FramePacer;
 class MemDebug;
 class PPUTileDebug;
 class PPUVramDebug;
 class MidiSetup;
+class Rewind;
+class SdlInput;
+class StateFiles;
+class WavSink;
 
 
 class ProtoNES: public ImApp {
@@ -36,11 +42,15 @@ class ProtoNES: public ImApp {
     void Draw() override;
     void Run();
     void DrawPreferences();
+    void DrawPacing(const char* label, FramePacer* pacer);
 
     void AudioCallback(void* stream, int len) override;
     void Help(const std::string& topickey);
 
     std::shared_ptr<NES> nes() { return nes_; }
+    EmulationThread* emulation() { return emulation_.get(); }
+    FramePacer* ui_pacer() { return ui_pacer_.get(); }
+    Rewind* rewind() { return rewind_.get(); }
     float scale() { return scale_; }
     float aspect() { return aspect_; }
     float volume() { return volume_; }
@@ -56,9 +66,13 @@ class ProtoNES: public ImApp {
 
     void SaveSlot(int slot);
     void LoadSlot(int slot);
-
-    const static size_t HISTORY_SIZE = 256;
   private:
+    std::string SlotFilename(int slot);
+    // Read the slot and the ones next to it ahead of loading them.
+    void PrefetchSlots(int slot);
+    // Called on the emulation thread.
+    void EmulateFrame();
+
     bool loaded_;
     bool pause_;
     bool step_;
@@ -69,10 +83,14 @@ class ProtoNES: public ImApp {
     bool preferences_;
     int save_state_slot_;
     std::shared_ptr<NES> nes_;
+    std::unique_ptr<EmulationThread> emulation_;
+    std::unique_ptr<FramePacer> ui_pacer_;
+    std::unique_ptr<Rewind> rewind_;
+    std::unique_ptr<StateFiles> state_files_;
+    std::unique_ptr<SdlInput> input_;
+    std::unique_ptr<WavSink> wav_;
     std::string save_filename_;
 
-    std::string history_[HISTORY_SIZE];
-    size_t history_ptr_;
     bool history_enabled_;
 
     APUDebug* apu_debug_;
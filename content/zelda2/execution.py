@@ -10,27 +10,15 @@ class Execution(object):
         # Eight banks, plus a value to represent idle time.
         self.bank = collections.defaultdict(int)
         self.total = 0
-        self.known_idle = {
-            0x9D59, 0x9DB0, 0xA73D, 0xA7B1, 0xAB73, 0xB08F, 0xD4B2,
-            # Central dispatch loop.  Not really idle, but close enough.
-            0xc010, 0xc013, 0xc015, 0xc017, 0xc019,
-        }
-        self.cpuaddr = collections.defaultdict(int)
+        self.top = []
 
 
     def Calculate(self):
-        self.bank = collections.defaultdict(int)
-        self.cpuaddr.clear()
-        self.total = 0
-        for addr, cycles in self.root.nes.frame_profile.items():
-            b = addr >> 16
-            addr &= 0xFFFF
-            if addr in self.known_idle:
-                b = -1
-
-            self.cpuaddr[addr] += cycles
-            self.bank[b] += cycles
-            self.total += cycles
+        profile = self.root.nes.frame_profile
+        # The emulator counts cycles spent in idle loops under bank -1.
+        self.bank = collections.defaultdict(int, profile.BankTotals())
+        self.total = profile.total
+        self.top = profile.Top(20)
 
     def _Enable(self):
         self.bank = collections.defaultdict(int)
@@ -76,12 +64,12 @@ class Execution(object):
                 i = "Idle"
             bimpy.text("%s: %.2f%%" % (i, 100.0*frac))
 
-        pairs = sorted(self.cpuaddr.items(), key=lambda x:x[1], reverse=True)
-        for addr, count in pairs[0:20]:
-            bimpy.text("%04x: %d (%.2f%%)" % (addr, count, count/self.total*100))
+        for addr, count in self.top:
+            bimpy.text("%02x:%04x: %d (%.2f%%)" % (addr >> 16, addr & 0xFFFF,
+                count, count/self.total*100))
         #m = max(self.cpuaddr)
         #i = self.cpuaddr.index(m)
-        #print("Spent %d clocks at %x (known=%s)" % (m, i, i in self.known_idle))
+        #print("Spent %d clocks at %x" % (m, i))
         #bimpy.plot_histogram('', self.cpuaddr, 0, 'CPU Addr', 0, m)
                 #graph_size=bimpy.Vec2(400, 100))
         bimpy.end()
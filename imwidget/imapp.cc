@@ -128,6 +128,12 @@ bool ImApp::ProcessEvents() {
 }
 
 void ImApp::BaseDraw() {
+    BeginDraw();
+    DrawWidgets();
+    EndDraw();
+}
+
+void ImApp::BeginDraw() {
     if (!PreDraw()) {
         glViewport(0, 0,
                    (int)ImGui::GetIO().DisplaySize.x,
@@ -135,8 +141,10 @@ void ImApp::BaseDraw() {
         glClearColor(clear_color_.x, clear_color_.y, clear_color_.z, clear_color_.w);
         glClear(GL_COLOR_BUFFER_BIT);
     }
-
     ImGui_ImplSdlGL2_NewFrame(window_);
+}
+
+void ImApp::DrawWidgets() {
     console_.Draw();
     for(auto it=draw_callback_.begin(); it != draw_callback_.end();) {
         if ((*it)->visible()) {
@@ -147,8 +155,10 @@ void ImApp::BaseDraw() {
         }
         ++it;
     }
-
     Draw();
+}
+
+void ImApp::EndDraw() {
     ImGui::Render();
     ImGui_ImplSdlGL2_RenderDrawData(ImGui::GetDrawData());
     SDL_GL_SwapWindow(window_);
@@ -28,6 +28,12 @@ class ImApp {
     void SetTitle(const std::string& title, bool with_appname=true);
     void Run();
     void BaseDraw();
+    // BaseDraw in parts: PreDraw and starting the ImGui frame, drawing
+    // the widgets, and rendering and swapping.  Only the middle part runs
+    // the widgets' code.
+    void BeginDraw();
+    void DrawWidgets();
+    void EndDraw();
     virtual bool ProcessEvents();
 
     virtual void ProcessMessage(const std::string& msg, const void *extra) {}
@@ -58,6 +58,8 @@ void MidiConnector::Emulate() {
 }
 
 void MidiConnector::ProcessMessages() {
+    if (!midi_)
+        return;
     std::vector<uint8_t> message;
 
     for(;;) {
@@ -3,6 +3,7 @@
 #include <stdint.h>
 #include <cmath>
 #include <memory>
+#include <mutex>
 
 #include "google/protobuf/text_format.h"
 #include "nes/base.h"
@@ -151,10 +152,10 @@ class Channel {
 class MidiConnector : public EmulatedDevice {
   public:
     MidiConnector(NES* nes)
-      : nes_(nes),
-      midi_(new RtMidiIn)
+      : nes_(nes)
     {
-        MidiConnector::InitNotes(440.0);
+        static std::once_flag notes;
+        std::call_once(notes, MidiConnector::InitNotes, 440.0);
     }
 
     bool enabled() { return enabled_; }
@@ -166,7 +167,11 @@ class MidiConnector : public EmulatedDevice {
         for(auto& c : channel_) { c.second->set_ignore_program_change(val); }
     }
 
-    RtMidiIn* midi() { return midi_.get(); }
+    // The MIDI input is only opened when something asks for it.
+    RtMidiIn* midi() {
+        if (!midi_) midi_.reset(new RtMidiIn);
+        return midi_.get();
+    }
 
     void Emulate();
     void ProcessMessages();
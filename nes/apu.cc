@@ -1,39 +1,20 @@
 #include <string.h>
-#include <SDL2/SDL.h>
-#include "imgui.h"
 
 #include "absl/flags/flag.h"
 #include "util/os.h"
 #include "nes/apu.h"
 #include "nes/nes.h"
 #include "nes/mapper.h"
+#include "nes/pbmacro.h"
 
 #define USE_MUTEX 1
 
 ABSL_FLAG(double, volume, 0.2, "Sound volume");
 ABSL_FLAG(bool, lock_framerate_to_audio, true,
             "Lock the framerate to audio playback");
-ABSL_FLAG(std::string, wavfile, "", "Write audio to the named file");
 
 namespace protones {
 
-static float pulse_table[32];
-static float other_table[204];
-
-static void init_tables() {
-    static int once;
-    int i;
-    if (!once) {
-        once = 1;
-        for(i=0; i<32; i++) {
-            pulse_table[i] = 95.52 / (8128/double(i) + 100);
-        }
-        for(i=0; i<204; i++) {
-            other_table[i] = 163.67 / (24329/double(i) + 100);
-        }
-    }
-}
-
 APU::APU(NES *nes)
     : nes_(nes),
     pulse_{{nes, 1}, {nes, 2}},
@@ -44,17 +25,16 @@ APU::APU(NES *nes)
     frame_period_(0),
     frame_value_(0),
     frame_irq_(0),
-    volume_(absl::GetFlag(FLAGS_volume)),
+    volume_(nes->options().volume),
+    lock_to_audio_(nes->options().lock_framerate_to_audio),
+    mute_(false),
+    decimation_(1.0),
+    decimation_phase_(0),
+    decimation_sum_(0),
+    decimation_count_(0),
+    sink_(nullptr),
     data_{0, },
     len_(0) {
-        mutex_ = SDL_CreateMutex();
-        cond_ = SDL_CreateCond();
-        init_tables();
-        
-        const auto& wavfile = absl::GetFlag(FLAGS_wavfile);
-        if (!wavfile.empty()) {
-            sndfile_ = std::make_unique<SndfileHandle>(wavfile, SFM_WRITE, SF_FORMAT_WAV|SF_FORMAT_FLOAT, 1, 44100);
-        }
 }
 
 void APU::LoadState(proto::APU* state) {
@@ -63,6 +43,7 @@ void APU::LoadState(proto::APU* state) {
     triangle_.LoadState(state->mutable_triangle());
     noise_.LoadState(state->mutable_noise());
     dmc_.LoadState(state->mutable_dmc());
+    LOAD(cycle, frame_period, frame_value, frame_irq);
 }
 
 void APU::SaveState(proto::APU* state) {
@@ -72,6 +53,25 @@ void APU::SaveState(proto::APU* state) {
     triangle_.SaveState(state->mutable_triangle());
     noise_.SaveState(state->mutable_noise());
     dmc_.SaveState(state->mutable_dmc());
+    SAVE(cycle, frame_period, frame_value, frame_irq);
+}
+
+void APU::LoadState(Snapshot* snap) {
+    pulse_[0].LoadState(snap);
+    pulse_[1].LoadState(snap);
+    triangle_.LoadState(snap);
+    noise_.LoadState(snap);
+    dmc_.LoadState(snap);
+    snap->Load(cycle_, frame_period_, frame_value_, frame_irq_);
+}
+
+void APU::SaveState(Snapshot* snap) {
+    pulse_[0].SaveState(snap);
+    pulse_[1].SaveState(snap);
+    triangle_.SaveState(snap);
+    noise_.SaveState(snap);
+    dmc_.SaveState(snap);
+    snap->Save(cycle_, frame_period_, frame_value_, frame_irq_);
 }
 
 void APU::StepTimer() {
@@ -155,52 +155,81 @@ void APU::Emulate() {
     // Every 40.58 clocks
     int s1 = int(c1 / NES::sample_rate);
     int s2 = int(c2 / NES::sample_rate);
-    if (s1 != s2) {
+    if (s1 != s2 && !mute_) {
         float sample = Output();
-        if (sndfile_) {
-            sndfile_->write(&sample, 1);
+        if (sink_) {
+            sink_->Write(sample);
         }
-        if (absl::GetFlag(FLAGS_lock_framerate_to_audio)) {
-#if USE_MUTEX
-            SDL_LockMutex(mutex_);
-            while(len_ == BUFFERLEN) {
-                SDL_CondWait(cond_, mutex_);
-            }
-            if (len_ < BUFFERLEN) {
-                data_[len_++] = sample;
-            } else {
-                fprintf(stderr, "Audio overrun\n");
-            }
-            SDL_UnlockMutex(mutex_);
+        if (decimation_ > 1.0) {
+            decimation_sum_ += sample;
+            decimation_count_++;
+            decimation_phase_ += 1.0;
+            if (decimation_phase_ < decimation_)
+                return;
+            decimation_phase_ -= decimation_;
+            sample = decimation_sum_ / decimation_count_;
+            decimation_sum_ = 0;
+            decimation_count_ = 0;
+        }
+        Play(sample);
+    }
+}
 
+void APU::Play(float sample) {
+    if (lock_to_audio_) {
+#if USE_MUTEX
+        std::unique_lock<std::mutex> lock(mutex_);
+        while(len_ == BUFFERLEN) {
+            cond_.wait(lock);
+        }
+        if (len_ < BUFFERLEN) {
+            data_[len_++] = sample;
+        } else {
+            fprintf(stderr, "Audio overrun\n");
+        }
 #else
-            while((producer_ + 1) % BUFFERLEN == consumer_ % BUFFERLEN) {
-                os::SchedulerYield();
-            }
-            data_[producer_ % BUFFERLEN] = sample;
-            ++producer_;
+        while((producer_ + 1) % BUFFERLEN == consumer_ % BUFFERLEN) {
+            os::SchedulerYield();
+        }
+        data_[producer_ % BUFFERLEN] = sample;
+        ++producer_;
 #endif
-        } else {
-            if (len_ < BUFFERLEN) {
-                data_[len_++] = sample;
-            }
+    } else {
+        if (len_ < BUFFERLEN) {
+            data_[len_++] = sample;
         }
     }
 }
 
+bool APU::WaitForRoom(int samples, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return cond_.wait_for(lock, timeout, [&]() {
+        return BUFFERLEN - len_ >= samples;
+    });
+}
+
+void APU::set_decimation(double n) {
+    decimation_ = n > 1.0 ? n : 1.0;
+}
+
+void APU::Run(int cycles) {
+    for(int i=0; i<cycles; i++) {
+        Emulate();
+    }
+}
+
 void APU::PlayBuffer(void* stream, int bufsz) {
     int n = bufsz / sizeof(float);
     float* out = static_cast<float*>(stream);
 #if USE_MUTEX
     if (len_ >= n) {
-        SDL_LockMutex(mutex_);
+        std::lock_guard<std::mutex> lock(mutex_);
         int rest = len_ - n;
         memcpy(stream, data_, bufsz);
         memmove(data_, data_ + n, rest * sizeof(float));
         len_ = rest;
         last_value_ = out[len_ - 1];
-        SDL_CondSignal(cond_);
-        SDL_UnlockMutex(mutex_);
+        cond_.notify_one();
     } else {
         fprintf(stderr, "Audio underrun\n");
         while(n) {
@@ -3,7 +3,8 @@
 #include <cstdint>
 #include <chrono>
 #include <atomic>
-#include <SDL2/SDL.h>
+#include <condition_variable>
+#include <mutex>
 
 #include "proto/apu.pb.h"
 #include "nes/base.h"
@@ -12,10 +13,18 @@
 #include "nes/apu_pulse.h"
 #include "nes/apu_triangle.h"
 #include "nes/nes.h"
-#include "sndfile.hh"
+#include "nes/snapshot.h"
 
 namespace protones {
 
+// Something outside the emulator which wants every sample the APU makes,
+// e.g. to record them.
+class AudioSink {
+  public:
+    virtual ~AudioSink() {}
+    virtual void Write(float sample) = 0;
+};
+
 class APU : public EmulatedDevice {
   public:
     APU(NES* nes);
@@ -34,12 +43,42 @@ class APU : public EmulatedDevice {
     void SignalIRQ();
     float Output();
     void Emulate();
+    void Run(int cycles);
 
     void LoadState(proto::APU* state);
     void SaveState(proto::APU* state);
+    void LoadState(Snapshot* snap);
+    void SaveState(Snapshot* snap);
     void set_volume(float v) { volume_ = v; }
-    static const int BUFFERLEN = 2048;
+    void set_sink(AudioSink* sink) { sink_ = sink; }
+    // Make no samples, e.g. for frames which will be emulated again.
+    void set_mute(bool m) { mute_ = m; }
+    // Average every `n` samples (n >= 1, not necessarily whole) into one,
+    // so the audio device plays them `n` times as fast, e.g. to fast
+    // forward.  The sink still gets every sample.
+    void set_decimation(double n);
+    // Whether to wait for the audio device when the buffer is full, which
+    // paces the emulation, or to drop the sample.
+    void set_lock_to_audio(bool lock) { lock_to_audio_ = lock; }
+    bool lock_to_audio() const { return lock_to_audio_; }
+    // Samples waiting for the audio device.
+    int queued() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return len_;
+    }
+    // Wait up to `timeout` for the audio device to leave room in the
+    // buffer for `samples` more, and return whether it did.  Waiting here,
+    // before a frame, keeps the APU from waiting in the middle of one.
+    bool WaitForRoom(int samples, std::chrono::milliseconds timeout);
+    // The DMC fetches its samples with DMA, stalling the CPU.
+    inline bool dmc_active() const { return dmc_.length() > 0; }
+    // The audio device takes this many samples at a time.  The buffer
+    // holds its samples and a few frames more either side of half full,
+    // where the frame pacer keeps it.
+    static const int DEVICE_BUFFERLEN = 1024;
+    static const int BUFFERLEN = 4 * DEVICE_BUFFERLEN;
   private:
+    void Play(float sample);
     void set_frame_counter(uint8_t val);
     void set_control(uint8_t val);
 
@@ -48,8 +87,8 @@ class APU : public EmulatedDevice {
     Triangle triangle_;
     Noise noise_;
     DMC dmc_;
-    SDL_mutex *mutex_;
-    SDL_cond *cond_;
+    mutable std::mutex mutex_;
+    std::condition_variable cond_;
 
     uint64_t cycle_;
     uint8_t frame_period_;
@@ -57,8 +96,14 @@ class APU : public EmulatedDevice {
     bool frame_irq_;
     float volume_;
     float last_value_ = 0.0;
+    bool lock_to_audio_;
+    bool mute_;
+    double decimation_;
+    double decimation_phase_;
+    float decimation_sum_;
+    int decimation_count_;
 
-    std::unique_ptr<SndfileHandle> sndfile_;
+    AudioSink* sink_;
 
     float data_[BUFFERLEN];
     std::atomic<int> len_;
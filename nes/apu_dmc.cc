@@ -1,5 +1,5 @@
-#include "imgui.h"
 #include "nes/apu_dmc.h"
+#include "nes/cartridge.h"
 #include "nes/mem.h"
 #include "pbmacro.h"
 
@@ -37,6 +37,24 @@ void DMC::LoadState(proto::APUDMC *state) {
          loop, irq);
 }
 
+void DMC::SaveState(Snapshot* snap) {
+    snap->Save(enabled_,
+               value_,
+               sample_address_, sample_length_,
+               current_address_, current_length_,
+               shift_register_, bit_count_, tick_value_, tick_period_,
+               loop_, irq_);
+}
+
+void DMC::LoadState(Snapshot* snap) {
+    snap->Load(enabled_,
+               value_,
+               sample_address_, sample_length_,
+               current_address_, current_length_,
+               shift_register_, bit_count_, tick_value_, tick_period_,
+               loop_, irq_);
+}
+
 float DMC::Output() {
     dbgbuf_[dbgp_] = value_;
     dbgp_ = (dbgp_ + 1) % DBGBUFSZ;
@@ -46,7 +64,10 @@ float DMC::Output() {
 void DMC::StepReader() {
     if (current_length_ > 0 && bit_count_ == 0) {
         nes_->Stall(4);
+        CodeDataLog* cdl = nes_->cartridge()->cdl();
+        if (cdl) cdl->set_prg_access(CodeDataLog::Pcm);
         shift_register_ = nes_->mem()->Read(current_address_);
+        if (cdl) cdl->set_prg_access(CodeDataLog::None);
         bit_count_ = 8;
         current_address_++;
         if (current_address_ == 0)
@@ -3,6 +3,7 @@
 #include <cstdint>
 #include "nes/base.h"
 #include "nes/nes.h"
+#include "nes/snapshot.h"
 #include "proto/apu.pb.h"
 
 namespace protones {
@@ -26,6 +27,8 @@ class DMC: public APUDevice {
     void restart();
     void LoadState(proto::APUDMC* state);
     void SaveState(proto::APUDMC* state);
+    void LoadState(Snapshot* snap);
+    void SaveState(Snapshot* snap);
 
   private:
     uint8_t InternalOutput();
@@ -1,4 +1,3 @@
-#include "imgui.h"
 #include "nes/apu_noise.h"
 #include "nes/pbmacro.h"
 namespace protones {
@@ -50,6 +49,30 @@ void Noise::LoadState(proto::APUNoise* state) {
          constant_volume);
 }
 
+void Noise::SaveState(Snapshot* snap) {
+    snap->Save(enabled_,
+               mode_,
+               shift_register_,
+               length_enabled_,
+               length_value_,
+               timer_period_, timer_value_,
+               envelope_enable_, envelope_start_, envelope_loop_,
+               envelope_period_, envelope_value_, envelope_volume_,
+               constant_volume_);
+}
+
+void Noise::LoadState(Snapshot* snap) {
+    snap->Load(enabled_,
+               mode_,
+               shift_register_,
+               length_enabled_,
+               length_value_,
+               timer_period_, timer_value_,
+               envelope_enable_, envelope_start_, envelope_loop_,
+               envelope_period_, envelope_value_, envelope_volume_,
+               constant_volume_);
+}
+
 uint8_t Noise::InternalOutput() {
     if (!enabled_) return 0;
     if (length_value_ == 0) return 0;
@@ -3,6 +3,7 @@
 #include <cstdint>
 #include "nes/base.h"
 #include "nes/nes.h"
+#include "nes/snapshot.h"
 #include "proto/apu.pb.h"
 
 namespace protones {
@@ -24,6 +25,8 @@ class Noise: public APUDevice {
     inline uint16_t length() const { return length_value_; }
     void SaveState(proto::APUNoise *state);
     void LoadState(proto::APUNoise *state);
+    void LoadState(Snapshot* snap);
+    void SaveState(Snapshot* snap);
 
   private:
     uint8_t InternalOutput();
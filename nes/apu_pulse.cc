@@ -1,4 +1,3 @@
-#include "imgui.h"
 #include "nes/apu_pulse.h"
 //#include "nes/midi.h"
 #include "pbmacro.h"
@@ -86,6 +85,30 @@ void Pulse::LoadState(proto::APUPulse* state) {
          constant_volume);
 }
 
+void Pulse::SaveState(Snapshot* snap) {
+    snap->Save(enabled_,
+               length_enabled_, length_value_,
+               timer_period_, timer_value_,
+               duty_mode_, duty_value_,
+               sweep_enable_, sweep_reload_, sweep_negate_,
+               sweep_shift_, sweep_period_, sweep_value_,
+               envelope_enable_, envelope_start_, envelope_loop_,
+               envelope_period_, envelope_value_, envelope_volume_,
+               constant_volume_);
+}
+
+void Pulse::LoadState(Snapshot* snap) {
+    snap->Load(enabled_,
+               length_enabled_, length_value_,
+               timer_period_, timer_value_,
+               duty_mode_, duty_value_,
+               sweep_enable_, sweep_reload_, sweep_negate_,
+               sweep_shift_, sweep_period_, sweep_value_,
+               envelope_enable_, envelope_start_, envelope_loop_,
+               envelope_period_, envelope_value_, envelope_volume_,
+               constant_volume_);
+}
+
 uint8_t Pulse::InternalOutput() {
     if (!enabled_) return 0;
     if (length_value_ == 0) return 0;
@@ -1,4 +1,3 @@
-#include "imgui.h"
 #include "nes/apu_triangle.h"
 //#include "nes/midi.h"
 #include "nes/pbmacro.h"
@@ -45,6 +44,24 @@ void Triangle::LoadState(proto::APUTriangle *state) {
          counter_period, counter_value);
 }
 
+void Triangle::SaveState(Snapshot* snap) {
+    snap->Save(enabled_,
+               length_enabled_, length_value_,
+               timer_period_, timer_value_,
+               duty_value_,
+               counter_reload_,
+               counter_period_, counter_value_);
+}
+
+void Triangle::LoadState(Snapshot* snap) {
+    snap->Load(enabled_,
+               length_enabled_, length_value_,
+               timer_period_, timer_value_,
+               duty_value_,
+               counter_reload_,
+               counter_period_, counter_value_);
+}
+
 uint8_t Triangle::InternalOutput() {
     if (!enabled_) return 0;
     return triangle_table[duty_value_];
@@ -3,6 +3,7 @@
 #include <cstdint>
 #include "nes/base.h"
 #include "nes/nes.h"
+#include "nes/snapshot.h"
 #include "proto/apu.pb.h"
 namespace protones {
 
@@ -23,6 +24,8 @@ class Triangle: public APUDevice {
     inline uint16_t length() const { return length_value_; }
     void LoadState(proto::APUTriangle *state);
     void SaveState(proto::APUTriangle *state);
+    void LoadState(Snapshot* snap);
+    void SaveState(Snapshot* snap);
 
   private:
     uint8_t InternalOutput();
@@ -5,7 +5,7 @@
 namespace protones {
 class EmulatedDevice {
   public:
-    ~EmulatedDevice() {}
+    virtual ~EmulatedDevice() {}
 };
 
 class APUDevice {
@@ -18,7 +18,7 @@ class APUDevice {
         set_name(name);
     }
 
-    ~APUDevice() {}
+    virtual ~APUDevice() {}
     enum class Type {
         Unknown,
         Pulse,
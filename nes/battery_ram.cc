@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+#include "nes/battery_ram.h"
+
+namespace protones {
+
+BatteryRam::BatteryRam(uint32_t size)
+  : data_(new uint8_t[size]()),
+    size_(size),
+    dirty_((size + kPageSize - 1) >> kPageShift),
+    changed_(false),
+    pending_(new uint8_t[size]),
+    queued_(dirty_.size()),
+    queued_any_(false),
+    writing_(false),
+    stop_(false),
+    fp_(nullptr) {
+}
+
+BatteryRam::~BatteryRam() {
+    if (writer_.joinable()) {
+        Flush();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cond_.notify_all();
+        writer_.join();
+    }
+    if (fp_) fclose(fp_);
+}
+
+void BatteryRam::Open(const std::string& filename) {
+    filename_ = filename;
+    FILE* fp = fopen(filename.c_str(), "rb");
+    if (fp) {
+        size_t n = fread(data_.get(), 1, size_, fp);
+        if (n < size_) {
+            fprintf(stderr, "%s: only %zu of %u bytes of SRAM\n",
+                    filename.c_str(), n, size_);
+        }
+        fclose(fp);
+    } else {
+        // Write the whole image the first time.
+        dirty_.assign(dirty_.size(), true);
+        changed_ = true;
+    }
+    writer_ = std::thread(&BatteryRam::Writer, this);
+}
+
+void BatteryRam::Assign(uint32_t offset, const uint8_t* data,
+                        uint32_t len) {
+    if (offset >= size_)
+        return;
+    len = std::min(len, size_ - offset);
+    for(uint32_t i=0; i<len; ) {
+        // Up to the end of the page.
+        uint32_t n = std::min(kPageSize - ((offset + i) & (kPageSize - 1)),
+                              len - i);
+        if (memcmp(&data_[offset + i], data + i, n) != 0) {
+            memcpy(&data_[offset + i], data + i, n);
+            dirty_[(offset + i) >> kPageShift] = true;
+            changed_ = true;
+        }
+        i += n;
+    }
+}
+
+void BatteryRam::Flush() {
+    if (!changed_ || !writer_.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for(size_t p=0; p<dirty_.size(); p++) {
+            if (!dirty_[p])
+                continue;
+            uint32_t offset = p << kPageShift;
+            uint32_t len = std::min(kPageSize, size_ - offset);
+            memcpy(&pending_[offset], &data_[offset], len);
+            queued_[p] = true;
+            dirty_[p] = false;
+        }
+        queued_any_ = true;
+        changed_ = false;
+    }
+    cond_.notify_all();
+}
+
+void BatteryRam::Sync() {
+    Flush();
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [this] { return !queued_any_ && !writing_; });
+}
+
+void BatteryRam::Writer() {
+    std::unique_ptr<uint8_t[]> out(new uint8_t[size_]);
+    std::vector<bool> pages(queued_.size());
+    std::unique_lock<std::mutex> lock(mutex_);
+    for(;;) {
+        cond_.wait(lock, [this] { return queued_any_ || stop_; });
+        if (!queued_any_)
+            break;
+        for(size_t p=0; p<queued_.size(); p++) {
+            pages[p] = queued_[p];
+            if (queued_[p]) {
+                uint32_t offset = p << kPageShift;
+                uint32_t len = std::min(kPageSize, size_ - offset);
+                memcpy(&out[offset], &pending_[offset], len);
+                queued_[p] = false;
+            }
+        }
+        queued_any_ = false;
+        writing_ = true;
+        lock.unlock();
+
+        if (!fp_) fp_ = fopen(filename_.c_str(), "r+b");
+        if (!fp_) fp_ = fopen(filename_.c_str(), "w+b");
+        if (fp_) {
+            for(size_t p=0; p<pages.size(); p++) {
+                if (!pages[p])
+                    continue;
+                uint32_t offset = p << kPageShift;
+                uint32_t len = std::min(kPageSize, size_ - offset);
+                fseek(fp_, offset, SEEK_SET);
+                fwrite(&out[offset], 1, len, fp_);
+            }
+            fflush(fp_);
+        } else {
+            fprintf(stderr, "Can't open %s for writing.\n", filename_.c_str());
+        }
+
+        lock.lock();
+        writing_ = false;
+        cond_.notify_all();
+    }
+}
+
+}  // namespace protones
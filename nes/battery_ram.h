@@ -0,0 +1,72 @@
+#ifndef PROTONES_NES_BATTERY_RAM_H
+#define PROTONES_NES_BATTERY_RAM_H
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace protones {
+
+// A cartridge's SRAM, kept in its file on disk if it has a battery.
+//
+// Writes which change a byte mark its 1KB page.  Flush hands the pages
+// which changed to a writer thread, which writes just those pages into
+// the file, so the emulation never waits for the disk.
+class BatteryRam {
+  public:
+    explicit BatteryRam(uint32_t size);
+    ~BatteryRam();
+
+    // Read the RAM from `filename`, if it exists, and keep it there from
+    // now on.
+    void Open(const std::string& filename);
+
+    inline uint8_t Read(uint32_t addr) const { return data_[addr]; }
+    inline void Write(uint32_t addr, uint8_t val) {
+        if (data_[addr] != val) {
+            data_[addr] = val;
+            dirty_[addr >> kPageShift] = true;
+            changed_ = true;
+        }
+    }
+    // Replace the contents, e.g. from a saved state.
+    void Assign(const uint8_t* data, uint32_t len) { Assign(0, data, len); }
+    // Replace `len` bytes from `offset`.
+    void Assign(uint32_t offset, const uint8_t* data, uint32_t len);
+    inline const uint8_t* data() const { return data_.get(); }
+    inline uint32_t size() const { return size_; }
+
+    // Queue the pages which changed since the last Flush to be written.
+    void Flush();
+    // Flush, and wait until everything has been written.
+    void Sync();
+
+  private:
+    static const int kPageShift = 10;
+    static const uint32_t kPageSize = 1 << kPageShift;
+    void Writer();
+
+    std::unique_ptr<uint8_t[]> data_;
+    uint32_t size_;
+    std::vector<bool> dirty_;
+    bool changed_;
+    std::string filename_;
+
+    // The pages waiting for the writer, copied when they were flushed.
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::unique_ptr<uint8_t[]> pending_;
+    std::vector<bool> queued_;
+    bool queued_any_;
+    bool writing_;
+    bool stop_;
+    FILE* fp_;
+    std::thread writer_;
+};
+
+}  // namespace protones
+#endif // PROTONES_NES_BATTERY_RAM_H
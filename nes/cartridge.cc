@@ -1,14 +1,21 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstdint>
+#include <cstring>
 
 #include "absl/flags/flag.h"
 #include "nes/cartridge.h"
+#include "nes/cpu6502.h"
 #include "util/crc.h"
 #include "util/os.h"
 #include "util/file.h"
 
 ABSL_FLAG(bool, sram_on_disk, true, "Save SRAM to disk.");
+ABSL_FLAG(int32_t, sram_flush_frames, 60,
+          "Frames between writes of the SRAM which changed to disk");
+ABSL_FLAG(std::string, cdl, "",
+          "Log how each byte of PRG and CHR ROM is used to this file, "
+          "adding to what it already holds");
 
 namespace protones {
 
@@ -18,7 +25,8 @@ Cartridge::Cartridge(NES* nes)
     chr_(nullptr), chrlen_(0),
     crc32_(0),
     trainer_(nullptr),
-    sram_(nullptr), sramlen_(0) {
+    flush_frames_(nes->options().sram_flush_frames),
+    save_frame_(0) {
 }
 
 
@@ -77,55 +85,101 @@ void Cartridge::LoadFile(const std::string& filename) {
     crc32_ = Crc32(crc32_, chr_, chrlen_);
 
     // For MMC5, we emulate 64k of SRAM, otherwise 8k.
-    sramlen_ = mapper() == 5 ? 65536 : 8192;
-    sram_ = new uint8_t[sramlen_]{0, };
+    sram_.reset(new BatteryRam(mapper() == 5 ? 65536 : 8192));
 
     sram_filename_ = os::path::DataPath({
             File::Basename(filename) + ".sram" });
-    if (absl::GetFlag(FLAGS_sram_on_disk) && header_.sram && !nes_->has_movie()) {
-        if ((fp = fopen(sram_filename_.c_str(), "rb")) != nullptr) {;
-            if (fread(sram_, sramlen_, 1, fp) == 0) {
-                fprintf(stderr, "Couldn't read SRAM.\n");
-            }
-            fclose(fp);
-        }
+    // Movies start from empty SRAM, and mustn't change the saved games.
+    if (nes_->options().sram_on_disk && header_.sram && !nes_->has_movie()) {
+        sram_->Open(sram_filename_);
+    }
+    chr_hash_.Attach(chr_, chrlen_);
+    sram_hash_.Attach(sram_->data(), sram_->size());
+    chr_pages_.Attach(chr_, chrlen_);
+    sram_pages_.Attach(sram_->data(), sram_->size());
+    if (!nes_->options().cdl.empty()) {
+        cdl_.reset(new CodeDataLog(nes_->options().cdl, crc32_, prglen_,
+                                   chrlen_));
     }
     PrintHeader();
 }
 
-void Cartridge::Emulate() {
-    static uint64_t save_frame;
+uint64_t Cartridge::Hash() {
+    uint8_t mirror = mirror_;
+    return Fnv1a(chr_hash_.Hash() ^ sram_hash_.Hash(), &mirror, 1);
+}
+
+void Cartridge::WritePrg(uint32_t addr, uint8_t val) {
+    prg_[addr] = val;
+    // The byte may be mapped anywhere, so drop all decoded instructions.
+    nes_->cpu()->FlushCode();
+}
 
-    if (nes_->frame() - save_frame >= 60) {
-        save_frame = nes_->frame();
+void Cartridge::Emulate() {
+    if (nes_->frame() - save_frame_ >= uint64_t(flush_frames_)) {
+        save_frame_ = nes_->frame();
         SaveSram();
+        if (cdl_) cdl_->Flush();
     }
 }
 
 void Cartridge::SaveSram() {
-    if (!absl::GetFlag(FLAGS_sram_on_disk))
-        return;
-    if (!header_.sram)
-        return;
-
-    FILE *fp = fopen(sram_filename_.c_str(), "wb");
-    if (!fp) {
-        fprintf(stderr, "Can't open %s for writing.\n", sram_filename_.c_str());
-        return;
-    }
-    fwrite(sram_, 1, sramlen_, fp);
-    fclose(fp);
+    sram_->Flush();
+}
+
+void Cartridge::Shutdown() {
+    if (sram_) sram_->Sync();
+    if (cdl_) cdl_->Flush();
 }
 
 void Cartridge::SaveState(proto::Mapper *state) {
     auto* wram = state->mutable_wram();
-    wram->assign((char*)sram_, sramlen_);
+    wram->assign((const char*)sram_->data(), sram_->size());
+    auto* cart = state->mutable_cartridge();
+    cart->set_mirror(mirror_);
+    if (!header_.chrsz) {
+        cart->mutable_chr_ram()->assign((const char*)chr_, chrlen_);
+    }
 }
 
 void Cartridge::LoadState(proto::Mapper *state) {
     const auto& wram = state->wram();
-    memcpy(sram_, wram.data(),
-           wram.size() < sramlen_ ? wram.size() : sramlen_);
+    sram_->Assign((const uint8_t*)wram.data(), wram.size());
+    // Older states only have the SRAM.
+    if (state->has_cartridge()) {
+        const auto& cart = state->cartridge();
+        mirror_ = MirrorMode(cart.mirror());
+        const auto& chr = cart.chr_ram();
+        if (!header_.chrsz) {
+            memcpy(chr_, chr.data(),
+                   chr.size() < chrlen_ ? chr.size() : chrlen_);
+        }
+    }
+    chr_hash_.TouchAll();
+    sram_hash_.TouchAll();
+    chr_pages_.TouchAll();
+    sram_pages_.TouchAll();
+}
+
+void Cartridge::SaveState(Snapshot* snap) {
+    sram_pages_.Save(snap);
+    snap->Save(mirror_);
+    if (!header_.chrsz) {
+        chr_pages_.Save(snap);
+    }
+}
+
+void Cartridge::LoadState(Snapshot* snap) {
+    sram_pages_.Load(snap, [this](uint32_t offset, const uint8_t* data,
+                                  uint32_t len) {
+        sram_->Assign(offset, data, len);
+    });
+    snap->Load(mirror_);
+    if (!header_.chrsz) {
+        chr_pages_.Load(snap, chr_);
+        chr_hash_.TouchAll();
+    }
+    sram_hash_.TouchAll();
 }
 
 void Cartridge::PrintHeader() {
@@ -1,10 +1,15 @@
 #ifndef PROTONES_NES_CARTRIDGE_H
 #define PROTONES_NES_CARTRIDGE_H
+#include <memory>
 #include <string>
 #include <cstdint>
 
 #include "nes/base.h"
+#include "nes/battery_ram.h"
+#include "nes/cdl.h"
 #include "nes/nes.h"
+#include "nes/snapshot.h"
+#include "nes/state_hash.h"
 #include "proto/mappers.pb.h"
 namespace protones {
 
@@ -49,22 +54,47 @@ class Cartridge : public EmulatedDevice {
     }
     inline uint32_t prglen() const { return prglen_; }
     inline uint32_t chrlen() const { return chrlen_; }
-    inline uint32_t sramlen() const { return sramlen_; }
+    inline uint32_t sramlen() const { return sram_ ? sram_->size() : 0; }
     inline uint32_t crc32() const { return crc32_; }
 
-    inline uint8_t ReadPrg(uint32_t addr) { return prg_[addr]; }
-    inline uint8_t ReadChr(uint32_t addr) { return chr_[addr]; }
-    inline uint8_t ReadSram(uint32_t addr) { return sram_[addr]; }
-    inline void WritePrg(uint32_t addr, uint8_t val) { prg_[addr] = val; }
-    inline void WriteChr(uint32_t addr, uint8_t val) { chr_[addr] = val; }
-    inline void WriteSram(uint32_t addr, uint8_t val) { sram_[addr] = val; }
+    inline uint8_t ReadPrg(uint32_t addr) {
+        if (cdl_) cdl_->Prg(addr);
+        return prg_[addr];
+    }
+    inline uint8_t ReadChr(uint32_t addr) {
+        if (cdl_) cdl_->Chr(addr);
+        return chr_[addr];
+    }
+    inline uint8_t ReadSram(uint32_t addr) { return sram_->Read(addr); }
+    void WritePrg(uint32_t addr, uint8_t val);
+    inline void WriteChr(uint32_t addr, uint8_t val) {
+        chr_[addr] = val;
+        chr_hash_.Touch(addr);
+        chr_pages_.Touch(addr);
+    }
+    inline void WriteSram(uint32_t addr, uint8_t val) {
+        sram_->Write(addr, val);
+        sram_hash_.Touch(addr);
+        sram_pages_.Touch(addr);
+    }
     inline const std::string& filename() { return filename_; }
+    // The code/data log, if --cdl is set.
+    inline CodeDataLog* cdl() { return cdl_.get(); }
 
+    // Called once a frame.
     void Emulate();
+    // Start writing the SRAM which changed to disk.
     void SaveSram();
+    // Finish writing everything to disk.
+    void Shutdown();
 
     void LoadState(proto::Mapper* state);
     void SaveState(proto::Mapper* state);
+    void LoadState(Snapshot* snap);
+    void SaveState(Snapshot* snap);
+    // A hash of the SRAM, CHR and mirroring, which only rehashes what was
+    // written since the last time.
+    uint64_t Hash();
   private:
     NES* nes_;
     struct iNESHeader header_;
@@ -75,10 +105,16 @@ class Cartridge : public EmulatedDevice {
     uint32_t crc32_;
     uint8_t *trainer_;
     MirrorMode mirror_;
-    uint8_t *sram_;
-    uint32_t sramlen_;
+    std::unique_ptr<BatteryRam> sram_;
+    HashedRegion chr_hash_;
+    HashedRegion sram_hash_;
+    PagedRegion chr_pages_;
+    PagedRegion sram_pages_;
+    int flush_frames_;
+    uint64_t save_frame_;
     std::string filename_;
     std::string sram_filename_;
+    std::unique_ptr<CodeDataLog> cdl_;
 };
 
 }  // namespace protones
@@ -0,0 +1,80 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+#include "nes/cdl.h"
+
+namespace protones {
+namespace {
+const char kMagic[8] = {'P', 'R', 'O', 'T', 'O', 'C', 'D', 'L'};
+}  // namespace
+
+CodeDataLog::CodeDataLog(const std::string& filename, uint32_t crc32,
+                         uint32_t prglen, uint32_t chrlen)
+  : filename_(filename),
+    fp_(nullptr),
+    prglen_(prglen),
+    chrlen_(chrlen),
+    chr_start_(kHeaderSize + (prglen + 1) / 2),
+    data_(chr_start_ + (chrlen + 3) / 4),
+    dirty_(((data_.size() - 1) >> kPageShift) + 1),
+    prg_access_(None),
+    chr_access_(Rendered) {
+    memcpy(&data_[0], kMagic, sizeof(kMagic));
+    memcpy(&data_[8], &prglen_, sizeof(prglen_));
+    memcpy(&data_[12], &chrlen_, sizeof(chrlen_));
+    memcpy(&data_[16], &crc32, sizeof(crc32));
+    Load();
+}
+
+CodeDataLog::~CodeDataLog() {
+    if (fp_) {
+        Flush();
+        fclose(fp_);
+    }
+}
+
+void CodeDataLog::Load() {
+    fp_ = fopen(filename_.c_str(), "r+b");
+    if (fp_) {
+        std::vector<uint8_t> data(data_.size());
+        if (fread(data.data(), 1, data.size(), fp_) == data.size() &&
+            !memcmp(data.data(), data_.data(), kHeaderSize)) {
+            data_.swap(data);
+            return;
+        }
+        fprintf(stderr, "%s: not a code/data log for this cartridge; "
+                "starting over\n", filename_.c_str());
+        fclose(fp_);
+    }
+    fp_ = fopen(filename_.c_str(), "w+b");
+    if (!fp_) {
+        perror(filename_.c_str());
+        return;
+    }
+    dirty_.assign(dirty_.size(), true);
+}
+
+void CodeDataLog::Flush() {
+    if (!fp_)
+        return;
+    const size_t page = size_t(1) << kPageShift;
+    for(size_t p=0; p<dirty_.size(); p++) {
+        if (!dirty_[p])
+            continue;
+        size_t offset = p << kPageShift;
+        size_t len = std::min(page, data_.size() - offset);
+        fseek(fp_, offset, SEEK_SET);
+        fwrite(&data_[offset], 1, len, fp_);
+        dirty_[p] = false;
+    }
+    fflush(fp_);
+}
+
+void CodeDataLog::Clear() {
+    memset(&data_[kHeaderSize], 0, data_.size() - kHeaderSize);
+    dirty_.assign(dirty_.size(), true);
+}
+
+}  // namespace protones
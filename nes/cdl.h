@@ -0,0 +1,110 @@
+#ifndef PROTONES_NES_CDL_H
+#define PROTONES_NES_CDL_H
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace protones {
+
+// A code/data log: how every byte of PRG and CHR ROM has been used,
+// indexed by its offset in the cartridge, so banked code is told apart.
+//
+// Whoever is about to read through the mapper says how with
+// set_prg_access or set_chr_access (the CPU on its instrumented path, the
+// DMC, the PPU), and the Cartridge marks the bytes the mapper reads.
+// PRG reads made while the access is None (debuggers, scripts) aren't
+// logged.  Nearly every CHR read is the PPU rendering, so that's the
+// default and only PPUDATA reads say otherwise.
+//
+// The flags are bit-packed: 4 bits per PRG byte and 2 per CHR byte.  The
+// log is loaded from its file when it's created, so sessions accumulate,
+// and Flush writes back only the pages which changed.  The file's header
+// has the cartridge's CRC32, and a log of another cartridge is started
+// over rather than merged.
+class CodeDataLog {
+  public:
+    enum PrgFlag : uint8_t {
+        None = 0,
+        Code = 1,
+        Data = 2,
+        // With Data: read through a pointer, (zp,X) or (zp),Y, or the
+        // pointer JMP ($xxxx) reads.
+        Indirect = 4,
+        // DMC sample data.
+        Pcm = 8,
+    };
+    enum ChrFlag : uint8_t {
+        Rendered = 1,
+        // Read by the CPU through PPUDATA.
+        Read = 2,
+    };
+
+    CodeDataLog(const std::string& filename, uint32_t crc32,
+                uint32_t prglen, uint32_t chrlen);
+    ~CodeDataLog();
+
+    inline void set_prg_access(uint8_t flags) { prg_access_ = flags; }
+    inline void set_chr_access(uint8_t flags) { chr_access_ = flags; }
+    inline void Prg(uint32_t offset) {
+        if (prg_access_ && offset < prglen_)
+            Mark<kPrgBits>(offset, kHeaderSize, prg_access_);
+    }
+    inline void Chr(uint32_t offset) {
+        if (chr_access_ && offset < chrlen_)
+            Mark<kChrBits>(offset, chr_start_, chr_access_);
+    }
+    // The flags for an offset; 0 past the end of the ROM.
+    inline uint8_t prg(uint32_t offset) const {
+        return offset < prglen_ ? Get<kPrgBits>(offset, kHeaderSize) : 0;
+    }
+    inline uint8_t chr(uint32_t offset) const {
+        return offset < chrlen_ ? Get<kChrBits>(offset, chr_start_) : 0;
+    }
+    inline uint32_t prglen() const { return prglen_; }
+    inline uint32_t chrlen() const { return chrlen_; }
+
+    // Write the pages which changed since the last Flush to the file.
+    void Flush();
+    void Clear();
+
+  private:
+    static const int kPrgBits = 4;
+    static const int kChrBits = 2;
+    static const size_t kHeaderSize = 20;
+    static const int kPageShift = 12;
+
+    // The log is kept as the file's image: the header, then the PRG flags,
+    // then the CHR flags.
+    template<int kBits>
+    inline void Mark(uint32_t offset, size_t start, uint8_t flags) {
+        size_t i = start + offset / (8 / kBits);
+        int shift = (offset % (8 / kBits)) * kBits;
+        uint8_t value = data_[i] | flags << shift;
+        if (value != data_[i]) {
+            data_[i] = value;
+            dirty_[i >> kPageShift] = true;
+        }
+    }
+    template<int kBits>
+    inline uint8_t Get(uint32_t offset, size_t start) const {
+        size_t i = start + offset / (8 / kBits);
+        int shift = (offset % (8 / kBits)) * kBits;
+        return (data_[i] >> shift) & ((1 << kBits) - 1);
+    }
+    void Load();
+
+    std::string filename_;
+    FILE* fp_;
+    uint32_t prglen_;
+    uint32_t chrlen_;
+    size_t chr_start_;
+    std::vector<uint8_t> data_;
+    std::vector<bool> dirty_;
+    uint8_t prg_access_;
+    uint8_t chr_access_;
+};
+
+}  // namespace protones
+#endif // PROTONES_NES_CDL_H
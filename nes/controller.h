@@ -2,10 +2,9 @@
 #define PROTONES_NES_CONTROLLER_H
 #include <cstdint>
 #include <vector>
-#include <SDL2/SDL.h>
 #include "nes/base.h"
 #include "nes/nes.h"
-#include "proto/controller.pb.h"
+#include "nes/snapshot.h"
 namespace protones {
 
 class Controller : public EmulatedDevice {
@@ -16,9 +15,12 @@ class Controller : public EmulatedDevice {
     void Write(uint8_t val);
     inline uint8_t buttons() { return buttons_; }
     inline void set_buttons(int b) { buttons_ = uint8_t(b); }
-    void set_buttons(SDL_Event* event);
     void AppendButtons(uint8_t b);
     void Emulate();
+    void LoadState(proto::Controller* state);
+    void SaveState(proto::Controller* state);
+    void LoadState(Snapshot* snap);
+    void SaveState(Snapshot* snap);
 
     static const int BUTTON_A      = 0x01;
     static const int BUTTON_B      = 0x02;
@@ -37,7 +39,6 @@ class Controller : public EmulatedDevice {
     bool got_read_;
     int cnum_;
     friend class ControllerDebug;
-    std::map<int, proto::ControllerButtons> keyb_;
 };
 
 }  // namespace protones
@@ -4,33 +4,126 @@
 #include <inttypes.h>
 #include "absl/flags/flag.h"
 #include "nes/cpu6502.h"
+#include "nes/cpu6502_info.h"
+#include "nes/cpu6502_jit.h"
 #include "nes/pbmacro.h"
 
 ABSL_FLAG(bool, trace, false, "Enable per cycle CPU tracing");
-ABSL_FLAG(std::string, rwlog, "", "Save memory access info to a file");
+ABSL_FLAG(int32_t, trace_size, 1000000,
+          "Number of instructions the trace keeps for Flush");
+ABSL_FLAG(std::string, trace_file, "",
+          "Stream the CPU trace to this file instead of keeping the most "
+          "recent instructions in memory");
+ABSL_FLAG(bool, icache, true,
+          "Cache decoded instructions (threaded CPU engine, fast path)");
+ABSL_FLAG(bool, threaded_cpu, true,
+          "Use the threaded (per-opcode handler) CPU engine instead of "
+          "the switch based one");
+ABSL_FLAG(bool, jit, false,
+          "Compile hot basic blocks in PRG ROM to x86-64 code which calls "
+          "each instruction's handler (call threading)");
 
 namespace protones {
 
 void Cpu::Branch(uint16_t addr) {
-    static uint16_t last_pc, last_addr;
-    if (pc_ == last_pc && addr == last_addr && addr == pc_ - 2)
-        abort();
-    last_pc = pc_; last_addr = addr;
+    uint16_t from = pc_ - 2;
     if (PagesDiffer(pc_, addr))
         cycles_++;
     pc_ = addr;
     cycles_++;
+    Jumped(from);
 }
 
-void Cpu::SaveRwLog() {
-    if (absl::GetFlag(FLAGS_rwlog).empty())
-        return;
-    FILE* fp = fopen(absl::GetFlag(FLAGS_rwlog).c_str(), "wb");
-    fwrite(rwlog_, 1, sizeof(rwlog_), fp);
-    fclose(fp);
+void Cpu::Looped(uint16_t from) {
+    IdleLoop& l = idle_;
+    uint32_t tag = window_tag_[pc_ >> kCodeWindowShift];
+    if (pc_ != l.pc || from != l.end || tag != l.tag) {
+        l.pc = pc_;
+        l.end = from;
+        l.tag = tag;
+        l.body = window_rom_[pc_ >> kCodeWindowShift] &&
+                 window_rom_[from >> kCodeWindowShift] &&
+                 IdleBody(pc_, from, &l.reads_status);
+        l.confirmed = false;
+    } else {
+        l.confirmed = l.body && !l.left &&
+                      l.a == a_ && l.x == x_ && l.y == y_ && l.sp == sp_ &&
+                      l.flags == flags_.value;
+        if (l.confirmed)
+            l.iteration = int(cycles_ - l.cycles);
+    }
+    l.a = a_;
+    l.x = x_;
+    l.y = y_;
+    l.sp = sp_;
+    l.flags = flags_.value;
+    l.cycles = cycles_;
+    l.left = false;
+}
+
+bool Cpu::IdleBody(uint16_t first, uint16_t last, bool* reads_status) {
+    // Every instruction from the head of the loop to the branch back must
+    // leave memory and the stack alone and may only read from memory
+    // which nothing but the CPU or PPU events can change.
+    *reads_status = false;
+    for(int pc = first; pc <= last; ) {
+        uint8_t opcode = mem_->read_byte(pc);
+        InstructionInfo info = {kCpuInstructionInfo[opcode]};
+        CpuOp op = CpuOperation(opcode);
+        switch(op) {
+        case CpuOp::Illegal:
+        case CpuOp::BRK: case CpuOp::JSR: case CpuOp::RTI: case CpuOp::RTS:
+        case CpuOp::PHA: case CpuOp::PHP: case CpuOp::PLA: case CpuOp::PLP:
+            return false;
+        default:
+            if (CpuOperationStores(opcode))
+                return false;
+        }
+        uint16_t addr;
+        switch(AddressingMode(info.mode)) {
+        case ZeroPage:
+            break;
+        case Absolute:
+            if (op == CpuOp::JMP)
+                break;
+            addr = mem_->read_byte(pc + 1) | mem_->read_byte(pc + 2) << 8;
+            if ((addr & 0xE007) == 0x2002) {
+                *reads_status = true;
+            } else if (addr >= 0x2000 && addr < 0x6000) {
+                return false;
+            }
+            break;
+        case Immediate: case Implied: case Accumulator: case Relative:
+            break;
+        default:
+            // Indexed and indirect accesses aren't worth following.
+            return false;
+        }
+        if (pc == last)
+            return true;
+        pc += info.size;
+    }
+    return false;
+}
+
+int Cpu::SkipIdle(uint64_t deadline) {
+    if (deadline <= cycles_)
+        return 0;
+    uint64_t skip = (deadline - 1 - cycles_) / idle_.iteration;
+    skip *= idle_.iteration;
+    cycles_ += skip;
+    idle_.cycles = cycles_;
+    return int(skip);
 }
 
 Cpu::Cpu(Mem* mem) :
+    icache_epoch_(1),
+    icache_hits_(0),
+    icache_misses_(0),
+    jit_deadline_(0),
+    jit_window_(0),
+    jit_tag_(0),
+    idle_{},
     mem_(mem),
     flags_{0x24},
     pc_(0),
@@ -40,8 +133,111 @@ Cpu::Cpu(Mem* mem) :
     stall_(0),
     nmi_pending_(false),
     irq_pending_(false),
-    tbptr_(0),
-    halted_(false) {}
+    engine_(absl::GetFlag(FLAGS_threaded_cpu) ? Threaded : Switch),
+    instrumented_(false),
+    cdl_(nullptr),
+    halted_(false) {
+    if (absl::GetFlag(FLAGS_icache)) {
+        icache_.reset(new DecodedOp[65536]());
+    }
+    for(int& id : window_id_) id = -1;
+    for(uint32_t& tag : window_tag_) tag = kUncached;
+    for(bool& rom : window_rom_) rom = false;
+    for(bool& translated : window_translated_) translated = false;
+    set_jit(absl::GetFlag(FLAGS_jit));
+    set_trace(absl::GetFlag(FLAGS_trace));
+}
+
+Cpu::~Cpu() {}
+
+void Cpu::SetCodeWindow(uint16_t first, uint16_t last, int id, bool rom) {
+    for(int w = first >> kCodeWindowShift; w <= last >> kCodeWindowShift; w++) {
+        window_rom_[w] = rom && id >= 0;
+        if (window_id_[w] == id)
+            continue;
+        window_id_[w] = id;
+        window_tag_[w] = id < 0 ? kUncached : (icache_epoch_ << 16 | id);
+    }
+}
+
+void Cpu::InvalidateWindow(int w) {
+    // Give just this window a fresh epoch.  Its translated blocks were
+    // written to, which doesn't happen to real ROM; it's only here so the
+    // JIT can be tested on code in RAM.
+    if (icache_epoch_ + 1 == 0xFFFF) {
+        FlushCode();
+        return;
+    }
+    ++icache_epoch_;
+    int id = window_id_[w];
+    window_tag_[w] = id < 0 ? kUncached : (icache_epoch_ << 16 | id);
+    window_translated_[w] = false;
+}
+
+void Cpu::set_jit(bool enable) {
+    if (!enable) {
+        jit_.reset();
+    } else if (!jit_) {
+        jit_ = CpuJit::New(this);
+    }
+}
+
+uint64_t Cpu::jit_blocks() const {
+    return jit_ ? jit_->blocks() : 0;
+}
+
+void Cpu::FlushCode() {
+    // Keep the epoch clear of kUncached, and of zero, which marks an
+    // invalid entry.
+    if (++icache_epoch_ == 0xFFFF) {
+        icache_epoch_ = 1;
+        if (icache_) {
+            for(int i=0; i<65536; i++) icache_[i].tag = 0;
+        }
+    }
+    for(size_t w=0; w<sizeof(window_id_)/sizeof(window_id_[0]); w++) {
+        int id = window_id_[w];
+        window_tag_[w] = id < 0 ? kUncached : (icache_epoch_ << 16 | id);
+        window_translated_[w] = false;
+    }
+}
+
+void Cpu::FlushRamCode() {
+    if (icache_epoch_ + 1 == 0xFFFF) {
+        FlushCode();
+        return;
+    }
+    ++icache_epoch_;
+    for(size_t w=0; w<sizeof(window_id_)/sizeof(window_id_[0]); w++) {
+        int id = window_id_[w];
+        if (id < 0 || window_rom_[w])
+            continue;
+        window_tag_[w] = icache_epoch_ << 16 | id;
+        window_translated_[w] = false;
+    }
+}
+
+void Cpu::Decode(DecodedOp* op) {
+    icache_misses_++;
+    uint8_t opcode = Read<FastPolicy>(pc_);
+    InstructionInfo info = {kCpuInstructionInfo[opcode]};
+    uint16_t operand = 0;
+    if (info.size == 2) {
+        operand = Read<FastPolicy>(pc_ + 1);
+    } else if (info.size == 3) {
+        operand = Read16<FastPolicy>(pc_ + 1);
+    }
+    op->handler = predecoded_handlers_[opcode];
+    op->operand = operand;
+    // Only cache instructions which lie entirely within one window.
+    uint32_t tag = window_tag_[pc_ >> kCodeWindowShift];
+    uint16_t last = pc_ + info.size - 1;
+    if (info.size == 0 || tag == kUncached ||
+        (pc_ >> kCodeWindowShift) != (last >> kCodeWindowShift)) {
+        tag = 0;
+    }
+    op->tag = tag;
+}
 
 void Cpu::SaveState(proto::CPU6502 *state) {
     state->set_flags(flags_.value);
@@ -51,6 +247,18 @@ void Cpu::SaveState(proto::CPU6502 *state) {
 void Cpu::LoadState(proto::CPU6502 *state) {
     flags_.value = state->flags();
     LOAD(pc, sp, a, x, y, cycles, stall, nmi_pending, irq_pending);
+    idle_ = IdleLoop{};
+}
+
+void Cpu::SaveState(Snapshot* snap) {
+    snap->Save(flags_, pc_, sp_, a_, x_, y_, cycles_, stall_,
+               nmi_pending_, irq_pending_);
+}
+
+void Cpu::LoadState(Snapshot* snap) {
+    snap->Load(flags_, pc_, sp_, a_, x_, y_, cycles_, stall_,
+               nmi_pending_, irq_pending_);
+    idle_ = IdleLoop{};
 }
 
 void Cpu::LoadEverdriveState(const uint8_t* state) {
@@ -60,6 +268,7 @@ void Cpu::LoadEverdriveState(const uint8_t* state) {
     sp_ = state[0x7123];
     pc_ = Read16(0xFFFA);
     flags_.i = true;
+    idle_ = IdleLoop{};
 }
 
 
@@ -73,118 +282,112 @@ void Cpu::Reset() {
     irq_pending_ = false;
     cycles_ = 0;
     stall_ = 0;
-    Emit("RESET");
+    idle_ = IdleLoop{};
+    if (trace_) Emit(TraceRecord::Reset);
+}
+
+int Cpu::FormatState(char* buf, uint16_t pc, uint8_t a, uint8_t x,
+                     uint8_t y, uint8_t sp, uint8_t flags) {
+    CpuFlags f = {flags};
+    return sprintf(buf, "PC=%04x A=%02x X=%02x Y=%02x SP=1%02x %c%c%c%c%c%c%c%c",
+                   pc, a, x, y, sp,
+                   f.n ? 'N' : 'n',
+                   f.v ? 'V' : 'v',
+                   f.u ? 'U' : 'u',
+                   f.b ? 'B' : 'b',
+                   f.d ? 'D' : 'd',
+                   f.i ? 'I' : 'i',
+                   f.z ? 'Z' : 'z',
+                   f.c ? 'C' : 'c');
 }
 
 std::string Cpu::CpuState() {
     char buf[80];
-    sprintf(buf, "PC=%04x A=%02x X=%02x Y=%02x SP=1%02x %c%c%c%c%c%c%c%c",
-            pc_, a_, x_, y_, sp_,
-            flags_.n ? 'N' : 'n',
-            flags_.v ? 'V' : 'v',
-            flags_.u ? 'U' : 'u',
-            flags_.b ? 'B' : 'b',
-            flags_.d ? 'D' : 'd',
-            flags_.i ? 'I' : 'i',
-            flags_.z ? 'Z' : 'z',
-            flags_.c ? 'C' : 'c');
+    FormatState(buf, pc_, a_, x_, y_, sp_, flags_.value);
     return std::string(buf);
 }
 
-std::string Cpu::Disassemble(uint16_t* nexti, bool tracemode) {
+int Cpu::FormatInstruction(char* buf, uint16_t pc, uint8_t opcode,
+                           uint8_t lo, uint8_t hi) {
+    InstructionInfo info = {kCpuInstructionInfo[opcode]};
+    int i;
+    switch(info.size) {
+    case 2:
+        i = sprintf(buf, "%02x: %02x%02x          ", pc, opcode, lo);
+        return i + sprintf(buf+i, kCpuInstructionNames[opcode], lo);
+    case 3:
+        i = sprintf(buf, "%02x: %02x%02x%02x        ", pc, opcode, lo, hi);
+        return i + sprintf(buf+i, kCpuInstructionNames[opcode], lo | hi << 8);
+    default:
+        // One byte instructions and illegal opcodes.
+        return sprintf(buf, "%02x: %02x            %s",
+                       pc, opcode, kCpuInstructionNames[opcode]);
+    }
+}
+
+std::string Cpu::Disassemble(uint16_t* nexti) {
     char buf[80];
-    char *b = buf;
-    uint16_t data = 0;
     uint16_t pc = pc_;
 
     if (nexti && *nexti)
         pc = *nexti;
 
     uint8_t opcode = Read(pc);
-    InstructionInfo info = info_[opcode];
-    int i;
-
-    if (tracemode) {
-        buf[0] = ' ';
-        buf[1] = ' ';
-        buf[2] = ' ';
-        buf[3] = ' ';
-        b = buf+4;
-    }
-
-    switch(info.size) {
-    case 0:
-        // Illegal opcode
-        sprintf(b, "%02x: %02x            %s",
-                pc, opcode, instruction_names_[opcode]);
-        pc++;
-        break;
-    case 1:
-        sprintf(b, "%02x: %02x            %s",
-                pc, opcode, instruction_names_[opcode]);
-        break;
-    case 2:
-        data = Read(pc+1);
-        i = sprintf(b, "%02x: %02x%02x          ", pc, opcode, data);
-        sprintf(b+i, instruction_names_[opcode], data);
-        break;
-    case 3:
-        data = Read(pc+1) | Read(pc+2)<<8;
-        i = sprintf(b, "%02x: %02x%02x%02x        ",
-                    pc, opcode, Read(pc+1), Read(pc+2));
-        sprintf(b+i, instruction_names_[opcode], data);
-        break;
-    }
+    InstructionInfo info = {kCpuInstructionInfo[opcode]};
+    uint8_t lo = info.size >= 2 ? Read(pc+1) : 0;
+    uint8_t hi = info.size >= 3 ? Read(pc+2) : 0;
+    FormatInstruction(buf, pc, opcode, lo, hi);
     if (nexti) {
-        *nexti = pc + info.size;
-    }
-
-    if (tracemode) {
-        Emit(buf, 1);
-        return "";
+        // Skip over illegal opcodes one byte at a time.
+        *nexti = pc + (info.size ? info.size : 1);
     }
     return std::string(buf);
 }
 
-void Cpu::Flush() {
-    for(int i=tbptr_+1; i != tbptr_; i=(i+1)%TRACEBUFSZ) {
-        fputs(tracebuf_[i], stderr);
+void Cpu::set_trace(bool enable) {
+    if (!enable) {
+        trace_.reset();
+    } else if (!trace_) {
+        trace_.reset(new CpuTrace(absl::GetFlag(FLAGS_trace_size),
+                                  absl::GetFlag(FLAGS_trace_file)));
     }
 }
 
-void Cpu::Emit(const char *buf, int how) {
-    static uint64_t last_ts;
-    uint64_t ts = cycles_;
-    if (!absl::GetFlag(FLAGS_trace))
-        return;
-    if (how < 0) {
-        int n = -how;
-        sprintf(tracebuf_[tbptr_], "%*s  %s\n", n, "", buf);
-    } else if (how == 1) {
-        uint64_t dt = ts - last_ts;
-        sprintf(tracebuf_[tbptr_], "%" PRIu64 ": %s\n", dt, buf);
-        last_ts = ts;
-    } else {
-        sprintf(tracebuf_[tbptr_], "%" PRIu64 ": %s\n", ts, buf);
-        last_ts = ts;
-    }
-    tbptr_ = (tbptr_ + 1) % TRACEBUFSZ;
-//    if (tbptr_ > TRACEBUFSZ) {
-//        Flush();
-//    }
+void Cpu::Flush() {
+    if (trace_) trace_->Flush();
 }
 
-
+void Cpu::Emit(TraceRecord::Kind kind) {
+    TraceRecord r = {};
+    r.kind = kind;
+    r.cycles = cycles_;
+    r.pc = pc_;
+    r.bank = window_id_[pc_ >> kCodeWindowShift];
+    trace_->Append(r);
+}
 
 void Cpu::Trace() {
-    if (!absl::GetFlag(FLAGS_trace))
+    if (!trace_)
         return;
-    std::string s = CpuState();
-    Emit(s.c_str(), -8);
-    Disassemble(nullptr, true);
+    TraceRecord r;
+    r.kind = TraceRecord::Instruction;
+    r.cycles = cycles_;
+    r.bank = window_id_[pc_ >> kCodeWindowShift];
+    r.pc = pc_;
+    r.opcode = mem_->read_byte(pc_);
+    InstructionInfo info = {kCpuInstructionInfo[r.opcode]};
+    r.operand[0] = info.size >= 2 ? mem_->read_byte(pc_ + 1) : 0;
+    r.operand[1] = info.size >= 3 ? mem_->read_byte(pc_ + 2) : 0;
+    r.a = a_;
+    r.x = x_;
+    r.y = y_;
+    r.sp = sp_;
+    r.flags = flags_.value;
+    trace_->Append(r);
 }
 
-int Cpu::Execute(void) {
+template<typename Policy>
+int Cpu::Execute() {
     if (halted_)
         return 1;
     if (stall_ > 0) {
@@ -198,18 +401,20 @@ int Cpu::Execute(void) {
     if (nmi_pending_) {
 //        printf("NMI @ %d\n", cycles_);
         nmi_pending_ = false;
-        Push16(pc_);
-        Push(flags_.value | 0x10);
-        pc_ = Read16(0xFFFA);
+        Push16<Policy>(pc_);
+        Push<Policy>(flags_.value | 0x10);
+        pc_ = Read16<Policy>(0xFFFA, CodeDataLog::Data);
         flags_.i = true;
         cycles_ += 7;
+        idle_.left = true;
     } else if (irq_pending_ && !flags_.i) {
         irq_pending_ = false;
-        Push16(pc_);
-        Push(flags_.value | 0x10);
-        pc_ = Read16(0xFFFE);
+        Push16<Policy>(pc_);
+        Push<Policy>(flags_.value | 0x10);
+        pc_ = Read16<Policy>(0xFFFE, CodeDataLog::Data);
         flags_.i = true;
         cycles_ += 7;
+        idle_.left = true;
     }
 
     // Scratch values
@@ -218,13 +423,38 @@ int Cpu::Execute(void) {
 
     uint16_t fetchpc = pc_;
     uint16_t addr = 0;
-    if (exec_cb_[pc_]) {
-        pc_ = exec_cb_[pc_](this);
+    if constexpr (!Policy::kInstrumented) {
+        if (jit_ && cycles_ < jit_deadline_ && jit_->Run()) {
+            return cycles_ - cycles;
+        }
+        if (engine_ == Threaded && icache_) {
+            DecodedOp* op = &icache_[pc_];
+            if (op->tag == window_tag_[pc_ >> kCodeWindowShift]) {
+                icache_hits_++;
+            } else {
+                Decode(op);
+            }
+            (this->*op->handler)(fetchpc, op->operand);
+            return cycles_ - cycles;
+        }
+    }
+    if constexpr (Policy::kInstrumented) {
+        if (exec_cb_.contains(pc_)) {
+            pc_ = exec_cb_[pc_](this);
+        }
+    }
+    uint8_t opcode = Read<Policy>(pc_);
+    InstructionInfo info = {kCpuInstructionInfo[opcode]};
+    if constexpr (Policy::kInstrumented) {
+        Trace();
     }
-    uint8_t opcode = Read(pc_);
-    InstructionInfo info = info_[opcode];
-    Trace();
     //exec_cb_(this, pc_, opcode);
+    if (engine_ == Threaded) {
+        const auto& handlers = Policy::kInstrumented ? instrumented_handlers_
+                                                     : fast_handlers_;
+        (this->*handlers[opcode])(fetchpc, 0);
+        return cycles_ - cycles;
+    }
 
 #undef TESTCPU
 #ifdef TESTCPU
@@ -243,10 +473,10 @@ int Cpu::Execute(void) {
         printf("%02x: %02x\n", pc_, opcode);
         break;
     case 2:
-        printf("%02x: %02x%02x\n", pc_, opcode, Read(pc_+1));
+        printf("%02x: %02x%02x\n", pc_, opcode, Read<Policy>(pc_+1));
         break;
     case 3:
-        printf("%02x: %02x%02x%02x\n", pc_, opcode, Read(pc_+1), Read(pc_+2));
+        printf("%02x: %02x%02x%02x\n", pc_, opcode, Read<Policy>(pc_+1), Read<Policy>(pc_+2));
         break;
     }
 #endif
@@ -256,40 +486,40 @@ int Cpu::Execute(void) {
     // target to be used by the instruction.
     switch(AddressingMode(info.mode)) {
     case Absolute:
-        addr = Read16(pc_+1);
+        addr = Read16<Policy>(pc_+1);
         break;
     case AbsoluteX:
-        addr = Read16(pc_+1) + x_;
+        addr = Read16<Policy>(pc_+1) + x_;
         if (PagesDiffer(addr - x_, addr))
             cycles_ += info.page;
         break;
     case AbsoluteY:
-        addr = Read16(pc_+1) + y_;
+        addr = Read16<Policy>(pc_+1) + y_;
         if (PagesDiffer(addr - y_, addr))
             cycles_ += info.page;
         break;
     case IndexedIndirect:
-        //addr = Read16Bug(Read(pc_+1) + x_);
-        addr = Read16((Read(pc_ + 1) + x()) & 0xff);
+        //addr = Read16Bug<Policy>(Read<Policy>(pc_+1) + x_);
+        addr = Read16<Policy>((Read<Policy>(pc_ + 1) + x()) & 0xff);
         break;
     case Indirect:
-        addr = Read16Bug(Read16(pc_+1));
+        addr = Read16Bug<Policy>(Read16<Policy>(pc_+1));
         break;
     case IndirectIndexed:
-        //addr = Read16Bug(Read(pc_+1)) + y_;
+        //addr = Read16Bug<Policy>(Read<Policy>(pc_+1)) + y_;
         // Fixed?
-        addr = Read16(Read(pc_ + 1)) + y();
+        addr = Read16<Policy>(Read<Policy>(pc_ + 1)) + y();
         if (PagesDiffer(addr - y_, addr))
             cycles_ += info.page;
         break;
     case ZeroPage:
-        addr = Read(pc_ + 1);
+        addr = Read<Policy>(pc_ + 1);
         break;
     case ZeroPageX:
-        addr = (Read(pc_ + 1) + x_) & 0xFF;
+        addr = (Read<Policy>(pc_ + 1) + x_) & 0xFF;
         break;
     case ZeroPageY:
-        addr = (Read(pc_ + 1) + y_) & 0xFF;
+        addr = (Read<Policy>(pc_ + 1) + y_) & 0xFF;
         break;
     case Immediate:
         addr = pc_ + 1;
@@ -299,24 +529,30 @@ int Cpu::Execute(void) {
         addr = 0;
         break;
     case Relative:
-        addr = pc_ + 2 + int8_t(Read(pc_ + 1));;
+        addr = pc_ + 2 + int8_t(Read<Policy>(pc_ + 1));;
         break;
     }
 
 #ifdef TESTCPU
     printf("Computed address %04x via mode %d (%02x %02x)\n",
-            addr, info.mode, Read(addr), Read(addr+1));
+            addr, info.mode, Read<Policy>(addr), Read<Policy>(addr+1));
 #endif
     pc_ += info.size;
     cycles_ += info.cycles;
+    // How the code/data log should see the instruction's operand.
+    const uint8_t data =
+        info.mode == Immediate ? CodeDataLog::Code :
+        info.mode == IndexedIndirect || info.mode == IndirectIndexed ?
+            CodeDataLog::Data | CodeDataLog::Indirect : CodeDataLog::Data;
 
     switch(opcode) {
     /* BRK */
     case 0x0:
-        Push16(pc_+1);
-        Push(flags_.value | 0x10);
+        Push16<Policy>(pc_+1);
+        Push<Policy>(flags_.value | 0x10);
         flags_.i = 1;
-        pc_ = Read16(0xFFFE);
+        pc_ = Read16<Policy>(0xFFFE, CodeDataLog::Data);
+        idle_.left = true;
         break;
     /* ORA (nn,X) */
     case 0x1:
@@ -334,7 +570,7 @@ int Cpu::Execute(void) {
     case 0x19:
     /* ORA nnnn,X */
     case 0x1D:
-        a_ = a_ | Read(addr, LogRead);
+        a_ = a_ | Read<Policy>(addr, data);
         SetZN(a_);
         break;
     /* ASL nn */
@@ -345,10 +581,10 @@ int Cpu::Execute(void) {
     case 0x16:
     /* ASL nnnn,X */
     case 0x1E:
-        val = Read(addr, LogRead);
+        val = Read<Policy>(addr, data);
         flags_.c = val >> 7;
         val <<= 1;
-        Write(addr, val);
+        Write<Policy>(addr, val);
         SetZN(val);
         break;
     /* ASL A */
@@ -359,7 +595,7 @@ int Cpu::Execute(void) {
         break;
     /* PHP */
     case 0x8:
-        Push(flags_.value | 0x10);
+        Push<Policy>(flags_.value | 0x10);
         break;
     /* BPL nn */
     case 0x10:
@@ -372,8 +608,9 @@ int Cpu::Execute(void) {
         break;
     /* JSR */
     case 0x20:
-        Push16(pc_ - 1);
+        Push16<Policy>(pc_ - 1);
         pc_ = addr;
+        idle_.left = true;
         break;
     /* AND (nn,X) */
     case 0x21:
@@ -391,14 +628,14 @@ int Cpu::Execute(void) {
     case 0x39:
     /* AND nnnn,X */
     case 0x3D:
-        a_ = a_ & Read(addr, LogRead);
+        a_ = a_ & Read<Policy>(addr, data);
         SetZN(a_);
         break;
     /* BIT nn */
     case 0x24:
     /* BIT nnnn */
     case 0x2C:
-        val = Read(addr, LogRead);
+        val = Read<Policy>(addr, data);
         flags_.v = val >> 6;
         SetZ(val & a_);
         SetN(val);
@@ -411,15 +648,15 @@ int Cpu::Execute(void) {
     case 0x36:
     /* ROL nnnn,X */
     case 0x3E:
-        r = Read(addr, LogRead);
+        r = Read<Policy>(addr, data);
         r = (r << 1) | flags_.c;
         flags_.c = r >> 8;
-        Write(addr, r);
+        Write<Policy>(addr, r);
         SetZN(r);
         break;
     /* PLP */
     case 0x28:
-        flags_.value = (Pull() & 0xEF) | 0x20;
+        flags_.value = (Pull<Policy>() & 0xEF) | 0x20;
         break;
     /* ROL A */
     case 0x2A:
@@ -439,8 +676,9 @@ int Cpu::Execute(void) {
         break;
     /* RTI */
     case 0x40:
-        flags_.value = (Pull() & 0xEF) | 0x20;
-        pc_ = Pull16();
+        flags_.value = (Pull<Policy>() & 0xEF) | 0x20;
+        pc_ = Pull16<Policy>();
+        idle_.left = true;
         break;
     /* EOR (nn,X) */
     case 0x41:
@@ -458,7 +696,7 @@ int Cpu::Execute(void) {
     case 0x59:
     /* EOR nnnn,X */
     case 0x5D:
-        a_ = a_ ^ Read(addr, LogRead);
+        a_ = a_ ^ Read<Policy>(addr, data);
         SetZN(a_);
         break;
     /* LSR nn */
@@ -469,15 +707,15 @@ int Cpu::Execute(void) {
     case 0x56:
     /* LSR nnnn,X */
     case 0x5E:
-        val = Read(addr, LogRead);
+        val = Read<Policy>(addr, data);
         flags_.c = val & 1;
         val >>= 1;
-        Write(addr, val);
+        Write<Policy>(addr, val);
         SetZN(val);
         break;
     /* PHA */
     case 0x48:
-        Push(a_);
+        Push<Policy>(a_);
         break;
     /* BVC */
     case 0x50:
@@ -489,6 +727,7 @@ int Cpu::Execute(void) {
     /* JMP (nnnn) */
     case 0x6C:
         pc_ = addr;
+        Jumped(fetchpc);
         break;
     /* LSR A */
     case 0x4A:
@@ -502,7 +741,8 @@ int Cpu::Execute(void) {
         break;
     /* RTS */
     case 0x60:
-        pc_ = Pull16() + 1;
+        pc_ = Pull16<Policy>() + 1;
+        idle_.left = true;
         break;
     /* ADC (nn,X) */
     case 0x61:
@@ -521,7 +761,7 @@ int Cpu::Execute(void) {
     /* ADC nnnn,X */
     case 0x7D:
         a = a_;
-        b = Read(addr, LogRead);
+        b = Read<Policy>(addr, data);
         r = a + b + flags_.c;
         a_ = r;
         flags_.c = (r > 0xff);
@@ -536,15 +776,15 @@ int Cpu::Execute(void) {
     case 0x76:
     /* ROR nnnn,X */
     case 0x7E:
-        val = Read(addr, LogRead);
+        val = Read<Policy>(addr, data);
         a = (val >> 1) | (flags_.c << 7);
         flags_.c = val & 1;
-        Write(addr, a);
+        Write<Policy>(addr, a);
         SetZN(a);
         break;
     /* PLA */
     case 0x68:
-        a_ = Pull();
+        a_ = Pull<Policy>();
         SetZN(a_);
         break;
     /* ROR A */
@@ -577,7 +817,7 @@ int Cpu::Execute(void) {
     case 0x99:
     /* STA nnnn,X */
     case 0x9D:
-        Write(addr, a_);
+        Write<Policy>(addr, a_);
         break;
     /* STY nn */
     case 0x84:
@@ -585,7 +825,7 @@ int Cpu::Execute(void) {
     case 0x8C:
     /* STY nn,X */
     case 0x94:
-        Write(addr, y_);
+        Write<Policy>(addr, y_);
         break;
     /* STX nn */
     case 0x86:
@@ -593,7 +833,7 @@ int Cpu::Execute(void) {
     case 0x8E:
     /* STX nn,Y */
     case 0x96:
-        Write(addr, x_);
+        Write<Policy>(addr, x_);
         break;
     /* DEY */
     case 0x88:
@@ -628,7 +868,7 @@ int Cpu::Execute(void) {
     case 0xB4:
     /* LDY nnnn,X */
     case 0xBC:
-        y_ = Read(addr, LogRead);
+        y_ = Read<Policy>(addr, data);
         SetZN(y_);
         break;
     /* LDA (nn,X) */
@@ -647,7 +887,7 @@ int Cpu::Execute(void) {
     case 0xB9:
     /* LDA nnnn,X */
     case 0xBD:
-        a_ = Read(addr, LogRead);
+        a_ = Read<Policy>(addr, data);
         SetZN(a_);
         break;
     /* LDX #nn */
@@ -660,7 +900,7 @@ int Cpu::Execute(void) {
     case 0xB6:
     /* LDX nnnn,Y */
     case 0xBE:
-        x_ = Read(addr, LogRead);
+        x_ = Read<Policy>(addr, data);
         SetZN(x_);
         break;
     /* TAY */
@@ -693,7 +933,7 @@ int Cpu::Execute(void) {
     case 0xC4:
     /* CPY nnnn */
     case 0xCC:
-        Compare(y_, Read(addr, LogRead));
+        Compare(y_, Read<Policy>(addr, data));
         break;
     /* CMP (nn,X) */
     case 0xC1:
@@ -711,7 +951,7 @@ int Cpu::Execute(void) {
     case 0xD9:
     /* CMP nnnn,X */
     case 0xDD:
-        Compare(a_, Read(addr, LogRead));
+        Compare(a_, Read<Policy>(addr, data));
         break;
     /* DEC nn */
     case 0xC6:
@@ -721,8 +961,8 @@ int Cpu::Execute(void) {
     case 0xD6:
     /* DEC nnnn,X */
     case 0xDE:
-        val = Read(addr, LogRead) - 1;
-        Write(addr, val);
+        val = Read<Policy>(addr, data) - 1;
+        Write<Policy>(addr, val);
         SetZN(val);
         break;
     /* INY */
@@ -748,7 +988,7 @@ int Cpu::Execute(void) {
     case 0xE4:
     /* CPX nnnn */
     case 0xEC:
-        Compare(x_, Read(addr, LogRead));
+        Compare(x_, Read<Policy>(addr, data));
         break;
     /* SBC (nn,X) */
     case 0xE1:
@@ -767,7 +1007,7 @@ int Cpu::Execute(void) {
     /* SBC nnnn,X */
     case 0xFD:
         a = a_;
-        b = Read(addr, LogRead);
+        b = Read<Policy>(addr, data);
         r = a - b - (1- flags_.c);
         a_ = r;
         flags_.c = (r >= 0);
@@ -782,8 +1022,8 @@ int Cpu::Execute(void) {
     case 0xF6:
     /* INC nnnn,X */
     case 0xFE:
-        val = Read(addr, LogRead) + 1;
-        Write(addr, val);
+        val = Read<Policy>(addr, data) + 1;
+        Write<Policy>(addr, val);
         SetZN(val);
         break;
     /* INX */
@@ -816,320 +1056,7 @@ int Cpu::Execute(void) {
     return cycles_ - cycles;
 }
 
-// Information about each instruction is encoded into the info_ table.
-// Each 4 bits means (from lowest to highest):
-//    AddressingMode
-//    Instruction Size (in bytes)
-//    Cyles
-//    Extra cycles when crossing a page boundary
-const Cpu::InstructionInfo Cpu::info_[256] = {
-    // 0x00      1       2       3       4       5       6       7
-    //    8      9       a       b       c       d       e       f
-    0x0715, 0x0626, 0x0205, 0x0806, 0x032a, 0x032a, 0x052a, 0x050a, 
-    0x0315, 0x0224, 0x0213, 0x0204, 0x0430, 0x0430, 0x0630, 0x0600, 
-    // 0x10
-    0x1229, 0x1528, 0x0205, 0x0808, 0x042b, 0x042b, 0x062b, 0x060b, 
-    0x0215, 0x1432, 0x0215, 0x0702, 0x1431, 0x1431, 0x0731, 0x0701, 
-    // 0x20
-    0x0630, 0x0626, 0x0205, 0x0806, 0x032a, 0x032a, 0x052a, 0x050a, 
-    0x0415, 0x0224, 0x0213, 0x0204, 0x0430, 0x0430, 0x0630, 0x0600, 
-    // 0x30
-    0x1229, 0x1528, 0x0205, 0x0808, 0x042b, 0x042b, 0x062b, 0x060b, 
-    0x0215, 0x1432, 0x0215, 0x0702, 0x1431, 0x1431, 0x0731, 0x0701, 
-    // 0x40
-    0x0615, 0x0626, 0x0205, 0x0806, 0x032a, 0x032a, 0x052a, 0x050a, 
-    0x0315, 0x0224, 0x0213, 0x0204, 0x0330, 0x0430, 0x0630, 0x0600, 
-    // 0x50
-    0x1229, 0x1528, 0x0205, 0x0808, 0x042b, 0x042b, 0x062b, 0x060b, 
-    0x0215, 0x1432, 0x0215, 0x0702, 0x1431, 0x1431, 0x0731, 0x0701, 
-    // 0x60
-    0x0615, 0x0626, 0x0205, 0x0806, 0x032a, 0x032a, 0x052a, 0x050a, 
-    0x0415, 0x0224, 0x0213, 0x0204, 0x0537, 0x0430, 0x0630, 0x0600, 
-    // 0x70
-    0x1229, 0x1528, 0x0205, 0x0808, 0x042b, 0x042b, 0x062b, 0x060b, 
-    0x0215, 0x1432, 0x0215, 0x0702, 0x1431, 0x1431, 0x0731, 0x0701, 
-    // 0x80
-    0x0224, 0x0626, 0x0204, 0x0606, 0x032a, 0x032a, 0x032a, 0x030a, 
-    0x0215, 0x0204, 0x0215, 0x0204, 0x0430, 0x0430, 0x0430, 0x0400, 
-    // 0x90
-    0x1229, 0x0628, 0x0205, 0x0608, 0x042b, 0x042b, 0x042c, 0x040c, 
-    0x0215, 0x0532, 0x0215, 0x0502, 0x0501, 0x0531, 0x0502, 0x0502, 
-    // 0xA0
-    0x0224, 0x0626, 0x0224, 0x0606, 0x032a, 0x032a, 0x032a, 0x030a, 
-    0x0215, 0x0224, 0x0215, 0x0204, 0x0430, 0x0430, 0x0430, 0x0400, 
-    // 0xB0
-    0x1229, 0x1528, 0x0205, 0x1508, 0x042b, 0x042b, 0x042c, 0x040c, 
-    0x0215, 0x1432, 0x0215, 0x1402, 0x1431, 0x1431, 0x1432, 0x1402, 
-    // 0xC0
-    0x0224, 0x0626, 0x0204, 0x0806, 0x032a, 0x032a, 0x052a, 0x050a, 
-    0x0215, 0x0224, 0x0215, 0x0204, 0x0430, 0x0430, 0x0630, 0x0600, 
-    // 0xD0
-    0x1229, 0x1528, 0x0205, 0x0808, 0x042b, 0x042b, 0x062b, 0x060b, 
-    0x0215, 0x1432, 0x0215, 0x0702, 0x1431, 0x1431, 0x0731, 0x0701, 
-    // 0xE0
-    0x0224, 0x0626, 0x0204, 0x0806, 0x032a, 0x032a, 0x052a, 0x050a, 
-    0x0215, 0x0224, 0x0215, 0x0204, 0x0430, 0x0430, 0x0630, 0x0600, 
-    // 0xF0
-    0x1229, 0x1528, 0x0205, 0x0808, 0x042b, 0x042b, 0x062b, 0x060b, 
-    0x0215, 0x1432, 0x0215, 0x0702, 0x1431, 0x1431, 0x0731, 0x0701, 
-};
+template int Cpu::Execute<FastPolicy>();
+template int Cpu::Execute<InstrumentedPolicy>();
 
-const char* Cpu::instruction_names_[] = {
-/* 00 */      "BRK",
-/* 01 */      "ORA ($%02x,X)",
-/* 02 */      "illop_02",
-/* 03 */      "illop_03",
-/* 04 */      "illop_04",
-/* 05 */      "ORA $%02x",
-/* 06 */      "ASL $%02x",
-/* 07 */      "illop_07",
-/* 08 */      "PHP",
-/* 09 */      "ORA #$%02x",
-/* 0a */      "ASL A",
-/* 0b */      "illop_0b",
-/* 0c */      "illop_0c",
-/* 0d */      "ORA $%04x",
-/* 0e */      "ASL $%04x",
-/* 0f */      "illop_0f",
-/* 10 */      "BPL $%02x",
-/* 11 */      "ORA ($%02x,Y)",
-/* 12 */      "illop_12",
-/* 13 */      "illop_13",
-/* 14 */      "illop_14",
-/* 15 */      "ORA $%02x,X",
-/* 16 */      "ASL $%02x,X",
-/* 17 */      "illop_17",
-/* 18 */      "CLC",
-/* 19 */      "ORA $%04x,Y",
-/* 1a */      "illop_1a",
-/* 1b */      "illop_1b",
-/* 1c */      "illop_1c",
-/* 1d */      "ORA $%04x,X",
-/* 1e */      "ASL $%04x,X",
-/* 1f */      "illop_1f",
-/* 20 */      "JSR $%04x",
-/* 21 */      "AND ($%02x,X)",
-/* 22 */      "illop_22",
-/* 23 */      "illop_23",
-/* 24 */      "BIT $%02x",
-/* 25 */      "AND $%02x",
-/* 26 */      "ROL $%02x",
-/* 27 */      "illop_27",
-/* 28 */      "PLP",
-/* 29 */      "AND #$%02x",
-/* 2a */      "ROL A",
-/* 2b */      "illop_2b",
-/* 2c */      "BIT $%04x",
-/* 2d */      "AND $%04x",
-/* 2e */      "ROL $%04x",
-/* 2f */      "illop_2f",
-/* 30 */      "BMI $%02x",
-/* 31 */      "AND ($%02x,Y)",
-/* 32 */      "illop_32",
-/* 33 */      "illop_33",
-/* 34 */      "illop_34",
-/* 35 */      "AND $%02x,X",
-/* 36 */      "ROL $%02x,X",
-/* 37 */      "illop_37",
-/* 38 */      "SEC",
-/* 39 */      "AND $%04x,Y",
-/* 3a */      "illop_3a",
-/* 3b */      "illop_3b",
-/* 3c */      "illop_3c",
-/* 3d */      "AND $%04x,X",
-/* 3e */      "ROL $%04x,X",
-/* 3f */      "illop_3f",
-/* 40 */      "RTI",
-/* 41 */      "EOR ($%02x,X)",
-/* 42 */      "illop_42",
-/* 43 */      "illop_43",
-/* 44 */      "illop_44",
-/* 45 */      "EOR $%02x",
-/* 46 */      "LSR $%02x",
-/* 47 */      "illop_47",
-/* 48 */      "PHA",
-/* 49 */      "EOR #$%02x",
-/* 4a */      "LSR A",
-/* 4b */      "illop_4b",
-/* 4c */      "JMP $%04x",
-/* 4d */      "EOR $%04x",
-/* 4e */      "LSR $%04x",
-/* 4f */      "illop_4f",
-/* 50 */      "BVC",
-/* 51 */      "EOR ($%02x,Y)",
-/* 52 */      "illop_52",
-/* 53 */      "illop_53",
-/* 54 */      "illop_54",
-/* 55 */      "EOR $%02x,X",
-/* 56 */      "LSR $%02x,X",
-/* 57 */      "illop_57",
-/* 58 */      "CLI",
-/* 59 */      "EOR $%04x,Y",
-/* 5a */      "illop_5a",
-/* 5b */      "illop_5b",
-/* 5c */      "illop_5c",
-/* 5d */      "EOR $%04x,X",
-/* 5e */      "LSR $%04x,X",
-/* 5f */      "illop_5f",
-/* 60 */      "RTS",
-/* 61 */      "ADC ($%02x,X)",
-/* 62 */      "illop_62",
-/* 63 */      "illop_63",
-/* 64 */      "illop_64",
-/* 65 */      "ADC $%02x",
-/* 66 */      "ROR $%02x",
-/* 67 */      "illop_67",
-/* 68 */      "PLA",
-/* 69 */      "ADC #$%02x",
-/* 6a */      "ROR A",
-/* 6b */      "illop_6b",
-/* 6c */      "JMP ($%04x)",
-/* 6d */      "ADC $%04x",
-/* 6e */      "ROR $%04x",
-/* 6f */      "illop_6f",
-/* 70 */      "BVS",
-/* 71 */      "ADC ($%02x,Y)",
-/* 72 */      "illop_72",
-/* 73 */      "illop_73",
-/* 74 */      "illop_74",
-/* 75 */      "ADC $%02x,X",
-/* 76 */      "ROR $%02x,X",
-/* 77 */      "illop_77",
-/* 78 */      "SEI",
-/* 79 */      "ADC $%04x,Y",
-/* 7a */      "illop_7a",
-/* 7b */      "illop_7b",
-/* 7c */      "illop_7c",
-/* 7d */      "ADC $%04x,X",
-/* 7e */      "ROR $%04x,X",
-/* 7f */      "illop_7f",
-/* 80 */      "illop_80",
-/* 81 */      "STA ($%02x,X)",
-/* 82 */      "illop_82",
-/* 83 */      "illop_83",
-/* 84 */      "STY $%02x",
-/* 85 */      "STA $%02x",
-/* 86 */      "STX $%02x",
-/* 87 */      "illop_87",
-/* 88 */      "DEY",
-/* 89 */      "illop_89",
-/* 8a */      "TXA",
-/* 8b */      "illop_8b",
-/* 8c */      "STY $%04x",
-/* 8d */      "STA $%04x",
-/* 8e */      "STX $%04x",
-/* 8f */      "illop_8f",
-/* 90 */      "BCC $%02x",
-/* 91 */      "STA ($%02x,Y)",
-/* 92 */      "illop_92",
-/* 93 */      "illop_93",
-/* 94 */      "STY $%02x,X",
-/* 95 */      "STA $%02x,X",
-/* 96 */      "STX $%02x,Y",
-/* 97 */      "illop_97",
-/* 98 */      "TYA",
-/* 99 */      "STA $%04x,Y",
-/* 9a */      "TXS",
-/* 9b */      "illop_9b",
-/* 9c */      "illop_9c",
-/* 9d */      "STA $%04x,X",
-/* 9e */      "illop_9e",
-/* 9f */      "illop_9f",
-/* a0 */      "LDY #$%02x",
-/* a1 */      "LDA ($%02x,X)",
-/* a2 */      "LDX #$%02x",
-/* a3 */      "illop_a3",
-/* a4 */      "LDY $%02x",
-/* a5 */      "LDA $%02x",
-/* a6 */      "LDX $%02x",
-/* a7 */      "illop_a7",
-/* a8 */      "TAY",
-/* a9 */      "LDA #$%02x",
-/* aa */      "TAX",
-/* ab */      "illop_ab",
-/* ac */      "LDY $%04x",
-/* ad */      "LDA $%04x",
-/* ae */      "LDX $%04x",
-/* af */      "illop_af",
-/* b0 */      "BCS $%02x",
-/* b1 */      "LDA ($%02x,Y)",
-/* b2 */      "illop_b2",
-/* b3 */      "illop_b3",
-/* b4 */      "LDY $%02x,X",
-/* b5 */      "LDA $%02x,X",
-/* b6 */      "LDX $%02x,Y",
-/* b7 */      "illop_b7",
-/* b8 */      "CLV",
-/* b9 */      "LDA $%04x,Y",
-/* ba */      "TSX",
-/* bb */      "illop_bb",
-/* bc */      "LDY $%04x,X",
-/* bd */      "LDA $%04x,X",
-/* be */      "LDX $%04x,Y",
-/* bf */      "illop_bf",
-/* c0 */      "CPY #$%02x",
-/* c1 */      "CMP ($%02x,X)",
-/* c2 */      "illop_c2",
-/* c3 */      "illop_c3",
-/* c4 */      "CPY $%02x",
-/* c5 */      "CMP $%02x",
-/* c6 */      "DEC $%02x",
-/* c7 */      "illop_c7",
-/* c8 */      "INY",
-/* c9 */      "CMP #$%02x",
-/* ca */      "DEX",
-/* cb */      "illop_cb",
-/* cc */      "CPY $%04x",
-/* cd */      "CMP $%04x",
-/* ce */      "DEC $%04x",
-/* cf */      "illop_cf",
-/* d0 */      "BNE $%02x",
-/* d1 */      "CMP ($%02x,Y)",
-/* d2 */      "illop_d2",
-/* d3 */      "illop_d3",
-/* d4 */      "illop_d4",
-/* d5 */      "CMP $%02x,X",
-/* d6 */      "DEC $%02x,X",
-/* d7 */      "illop_d7",
-/* d8 */      "CLD",
-/* d9 */      "CMP $%04x,Y",
-/* da */      "illop_da",
-/* db */      "illop_db",
-/* dc */      "illop_dc",
-/* dd */      "CMP $%04x,X",
-/* de */      "DEC $%04x,X",
-/* df */      "illop_df",
-/* e0 */      "CPX #$%02x",
-/* e1 */      "SBC ($%02x,X)",
-/* e2 */      "illop_e2",
-/* e3 */      "illop_e3",
-/* e4 */      "CPX $%02x",
-/* e5 */      "SBC $%02x",
-/* e6 */      "INC $%02x",
-/* e7 */      "illop_e7",
-/* e8 */      "INX",
-/* e9 */      "SBC #$%02x",
-/* ea */      "NOP",
-/* eb */      "illop_eb",
-/* ec */      "CPX $%04x",
-/* ed */      "SBC $%04x",
-/* ee */      "INC $%04x",
-/* ef */      "illop_ef",
-/* f0 */      "BEQ $%02x",
-/* f1 */      "SBC ($%02x,Y)",
-/* f2 */      "illop_f2",
-/* f3 */      "illop_f3",
-/* f4 */      "illop_f4",
-/* f5 */      "SBC $%02x,X",
-/* f6 */      "INC $%02x,X",
-/* f7 */      "illop_f7",
-/* f8 */      "SED",
-/* f9 */      "SBC $%04x,Y",
-/* fa */      "illop_fa",
-/* fb */      "illop_fb",
-/* fc */      "illop_fc",
-/* fd */      "SBC $%04x,X",
-/* fe */      "INC $%04x,X",
-/* ff */      "illop_ff",
-};
 }  // namespace protones
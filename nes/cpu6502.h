@@ -1,38 +1,84 @@
 #ifndef PROTONES_CPU2_H
 #define PROTONES_CPU2_H
+#include <array>
 #include <cstdint>
 #include <functional>
+#include <memory>
 #include <string>
+#include <utility>
 #include "nes/base.h"
+#include "nes/cdl.h"
+#include "nes/cpu_trace.h"
+#include "nes/hooks.h"
 #include "nes/mem.h"
+#include "nes/snapshot.h"
 #include "proto/cpu6502.pb.h"
 namespace protones {
 
+// Instrumentation policies for the CPU execution path.  Tracing, the code
+// data log and the read/write/exec hooks are guarded by `if constexpr` on the policy,
+// so the fast instantiation carries none of them.  The NES execution
+// profile follows the same policy (see NES::Emulate).
+struct FastPolicy {
+    static constexpr bool kInstrumented = false;
+};
+struct InstrumentedPolicy {
+    static constexpr bool kInstrumented = true;
+};
+
+class CpuJit;
+
 class Cpu : public EmulatedDevice {
   public:
     typedef std::function<uint8_t(Cpu*, uint16_t, uint8_t)> MemoryCb;
     typedef std::function<uint16_t(Cpu*)> ExecCb;
     Cpu() : Cpu(nullptr) {}
     Cpu(Mem* mem);
-    ~Cpu() { }
+    ~Cpu();
 
     void SaveState(proto::CPU6502 *state);
     void LoadState(proto::CPU6502 *state);
+    void LoadState(Snapshot* snap);
+    void SaveState(Snapshot* snap);
     void LoadEverdriveState(const uint8_t* state);
     void Reset();
     void Emulate() { Execute(); }
-    int Execute();
+    inline int Execute() {
+        return instrumented() ? Execute<InstrumentedPolicy>()
+                              : Execute<FastPolicy>();
+    }
+    template<typename Policy> int Execute();
     void Stall(int s) { stall_ += s; }
-    std::string Disassemble(uint16_t *nexti=nullptr, bool tracemode=false);
+    // The cycles the CPU has yet to spend stalled, and spending `s` of
+    // them at once (see NES::Emulate).
+    int stall() const { return halted_ ? 0 : stall_; }
+    // Whether the CPU stopped at an illegal opcode.  It executes nothing
+    // more until it's reset.
+    bool halted() const { return halted_; }
+    void Stalled(int s) {
+        stall_ -= s;
+        cycles_ += s;
+    }
+    std::string Disassemble(uint16_t *nexti=nullptr);
     std::string CpuState();
+    // Format an instruction or the register state into `buf` the way
+    // Disassemble and CpuState do.  Returns the length.
+    static int FormatInstruction(char* buf, uint16_t pc, uint8_t opcode,
+                                 uint8_t lo, uint8_t hi);
+    static int FormatState(char* buf, uint16_t pc, uint8_t a, uint8_t x,
+                           uint8_t y, uint8_t sp, uint8_t flags);
     inline void NMI() {
         nmi_pending_ = true;
-        Emit("NMI");
+        if (trace_) Emit(TraceRecord::NMI);
     }
     inline void IRQ() {
         irq_pending_ = true;
-        Emit("IRQ");
+        if (trace_) Emit(TraceRecord::IRQ);
     }
+    // Tracing records every instruction executed (see cpu_trace.h).
+    // Flush writes out what has been recorded.
+    void set_trace(bool enable);
+    inline bool trace() const { return trace_ != nullptr; }
     void Flush();
     inline bool irq_pending() const { return irq_pending_; }
 
@@ -105,60 +151,163 @@ class Cpu : public EmulatedDevice {
         ZeroPageY,
     };
 
-    enum RWLog {
-        LogRead = 1,
-        LogWrite = 2,
-        LogWriteZero = 4,
-        LogStack = 8,
-        LogExec = 16,
+    // Execution engines.  Switch decodes every instruction through the
+    // addressing mode and opcode switches in Execute.  Threaded dispatches
+    // through a table of per-opcode handlers generated at compile time from
+    // kCpuInstructionInfo (see cpu6502_threaded.cc).  Both produce identical
+    // results.
+    enum Engine {
+        Switch,
+        Threaded,
     };
+    inline Engine engine() const { return engine_; }
+    inline void set_engine(Engine e) { engine_ = e; }
 
     inline void set_read_cb(uint16_t addr, const MemoryCb& cb) {
-        read_cb_[addr] = cb;
+        read_cb_.Set(addr, cb);
     }
     inline void set_write_cb(uint16_t addr, const MemoryCb& cb) {
-        write_cb_[addr] = cb;
+        write_cb_.Set(addr, cb);
     }
     inline void set_exec_cb(uint16_t addr, const ExecCb& cb) {
-        exec_cb_[addr] = cb;
+        exec_cb_.Set(addr, cb);
+    }
+    // The instrumented path is used while tracing or the code/data log is
+    // enabled, while any hook is installed, or when explicitly requested
+    // (e.g. by a debugger or a python script).
+    inline bool instrumented() const {
+        return instrumented_ || trace_ || cdl_ || !read_cb_.empty() ||
+               !write_cb_.empty() || !exec_cb_.empty();
+    }
+    inline void set_instrumented(bool v) { instrumented_ = v; }
+    // Whether the instrumented path was explicitly requested.
+    inline bool instrumented_requested() const { return instrumented_; }
+    void ClearCallbacks() {
+        read_cb_.Clear();
+        write_cb_.Clear();
+        exec_cb_.Clear();
     }
-    void SaveRwLog();
-    void ClearRwLog() {
-        memset(rwlog_, 0, sizeof(rwlog_));
+    // Decoded instruction cache.  The owner of the memory map describes
+    // what is mapped into [first, last] with SetCodeWindow: an id which
+    // identifies the contents (e.g. a PRG bank number), or -1 if code
+    // there must never be cached.  Changing a window's id invalidates the
+    // entries in it.  InvalidateCode must be called for every write to a
+    // cacheable RAM window and FlushCode whenever cached contents change
+    // behind the cache's back (e.g. loading a state or patching PRG).
+    // Only windows marked `rom` are translated by the JIT.
+    void SetCodeWindow(uint16_t first, uint16_t last, int id, bool rom=false);
+    inline bool rom_window(uint16_t addr) const {
+        return window_rom_[addr >> kCodeWindowShift];
     }
+    inline void InvalidateCode(uint16_t addr) {
+        if (icache_) {
+            // An instruction is at most 3 bytes long.
+            icache_[addr].tag = 0;
+            icache_[uint16_t(addr - 1)].tag = 0;
+            icache_[uint16_t(addr - 2)].tag = 0;
+        }
+        if (window_translated_[addr >> kCodeWindowShift]) {
+            InvalidateWindow(addr >> kCodeWindowShift);
+        }
+    }
+    void FlushCode();
+    // Forget only what was decoded from RAM, e.g. after loading a state:
+    // ROM doesn't change with the state.
+    void FlushRamCode();
+    inline uint64_t icache_hits() const { return icache_hits_; }
+    inline uint64_t icache_misses() const { return icache_misses_; }
+    inline void ClearIcacheStats() { icache_hits_ = icache_misses_ = 0; }
+
+    // Call-threaded compilation of basic blocks (see cpu6502_jit.h).
+    // Translated blocks only run on the fast path, and only while the
+    // cycle count is below the deadline: the owner moves the deadline
+    // before each Execute to the earliest cycle at which something outside
+    // the CPU (an interrupt, DMA, the end of a frame) could need the CPU
+    // to stop.  The default deadline of 0 never runs translated code.
+    void set_jit(bool enable);
+    inline bool jit() const { return jit_ != nullptr; }
+    inline void set_jit_deadline(uint64_t cycle) { jit_deadline_ = cycle; }
+    uint64_t jit_blocks() const;
+
+    // Idle loop detection.  A short loop in ROM which only reads RAM, ROM
+    // or PPUSTATUS, and which comes back to its head with the same
+    // registers after an iteration without interrupts, will keep doing
+    // exactly that until something outside the CPU changes what it reads.
+    // idle() is true right after such an iteration; the owner may then
+    // SkipIdle up to the next event which could end the loop.
+    inline bool idle() const {
+        return idle_.confirmed && cycles_ == idle_.cycles;
+    }
+    // Whether the cpu has just come back to the head of a loop which might
+    // turn out to be idle.
+    inline bool looped() const {
+        return idle_.body && cycles_ == idle_.cycles;
+    }
+    inline bool idle_reads_status() const { return idle_.reads_status; }
+    // Whether `addr` is in the body of the last idle loop found.
+    inline bool idle_loop(uint16_t addr) const {
+        return idle_.confirmed && InLoop(addr);
+    }
+    // Skip whole iterations of the idle loop, stopping short of `deadline`.
+    // Returns the number of cycles skipped.
+    int SkipIdle(uint64_t deadline);
+
+    // Tell the code/data log how each read is used.
+    inline void set_cdl(CodeDataLog* cdl) { cdl_ = cdl; }
 
   private:
-    uint8_t inline Read(uint16_t addr, RWLog how=LogExec) {
+    template<typename Policy=InstrumentedPolicy>
+    uint8_t inline Read(uint16_t addr, uint8_t how=CodeDataLog::Code) {
+        if constexpr (Policy::kInstrumented) {
+            if (cdl_) cdl_->set_prg_access(how);
+        }
         uint8_t val = mem_->read_byte(addr);
-        if (read_cb_[addr]) val = read_cb_[addr](this, addr, val);
-        rwlog_[addr] |= how;
+        if constexpr (Policy::kInstrumented) {
+            if (cdl_) cdl_->set_prg_access(CodeDataLog::None);
+            if (read_cb_.contains(addr)) val = read_cb_[addr](this, addr, val);
+        }
         return val;
     }
-    void inline Write(uint16_t addr, uint8_t val, RWLog how=LogWrite) {
-        if (write_cb_[addr]) val = write_cb_[addr](this, addr, val);
-        mem_->write_byte(addr, val);
-        if (how == LogWrite && val == 0) {
-            how = LogWriteZero;
+    template<typename Policy=InstrumentedPolicy>
+    void inline Write(uint16_t addr, uint8_t val) {
+        if constexpr (Policy::kInstrumented) {
+            if (write_cb_.contains(addr)) val = write_cb_[addr](this, addr, val);
         }
-        rwlog_[addr] |= how;
+        mem_->write_byte(addr, val);
     }
-    uint16_t inline Read16(uint16_t addr) {
-        return Read(addr) | Read(addr+1) << 8;
+    template<typename Policy=InstrumentedPolicy>
+    uint16_t inline Read16(uint16_t addr, uint8_t how=CodeDataLog::Code) {
+        return Read<Policy>(addr, how) | Read<Policy>(addr+1, how) << 8;
     }
+    template<typename Policy=InstrumentedPolicy>
     uint16_t inline Read16Bug(uint16_t addr) {
         // When reading the high byte of the word, the address
         // increments, but doesn't carry from the low address byte to the
-        // high address byte.
-        uint16_t ret = Read(addr);
-        ret |= Read((addr & 0xFF00) | ((addr+1) & 0x00FF)) << 8;
+        // high address byte.  Only JMP ($xxxx) reads a pointer this way.
+        const uint8_t how = CodeDataLog::Data | CodeDataLog::Indirect;
+        uint16_t ret = Read<Policy>(addr, how);
+        ret |= Read<Policy>((addr & 0xFF00) | ((addr+1) & 0x00FF), how) << 8;
         return ret;
     }
 
-    inline void Push(uint8_t val) { Write(sp_-- | 0x100, val, LogStack); }
-    inline uint8_t Pull() { return Read(++sp_ | 0x100, LogStack); }
+    template<typename Policy=InstrumentedPolicy>
+    inline void Push(uint8_t val) {
+        Write<Policy>(sp_-- | 0x100, val);
+    }
+    template<typename Policy=InstrumentedPolicy>
+    inline uint8_t Pull() {
+        return Read<Policy>(++sp_ | 0x100, CodeDataLog::Data);
+    }
 
-    inline void Push16(uint16_t val) { Push(val>>8); Push(val); }
-    inline uint16_t Pull16() { return Pull() | Pull() << 8; }
+    template<typename Policy=InstrumentedPolicy>
+    inline void Push16(uint16_t val) {
+        Push<Policy>(val>>8);
+        Push<Policy>(val);
+    }
+    template<typename Policy=InstrumentedPolicy>
+    inline uint16_t Pull16() {
+        return Pull<Policy>() | Pull<Policy>() << 8;
+    }
 
     inline void SetZ(uint8_t val) { flags_.z = (val == 0); }
     inline void SetN(uint8_t val) { flags_.n = !!(val & 0x80); }
@@ -171,7 +320,95 @@ class Cpu : public EmulatedDevice {
         return (a & 0xFF00) != (b & 0xFF00);
     }
     void Branch(uint16_t addr);
+    // Called after a taken branch or jump at `from`.  Loops reaching back
+    // at most kIdleLoopSize bytes are checked for being idle.  Anything
+    // else which goes into or out of the last loop's body, and calls,
+    // returns and interrupts, which can't be part of an idle loop, mean
+    // the next iteration isn't one.
+    inline void Jumped(uint16_t from) {
+        if (uint16_t(from - pc_) < kIdleLoopSize) {
+            Looped(from);
+        } else if (!InLoop(from) || !InLoop(pc_)) {
+            idle_.left = true;
+        }
+    }
+    inline bool InLoop(uint16_t addr) const {
+        return uint16_t(addr - idle_.pc) <= uint16_t(idle_.end - idle_.pc);
+    }
+    void Looped(uint16_t from);
+    bool IdleBody(uint16_t first, uint16_t last, bool* reads_status);
 
+    // Threaded engine: one handler per opcode with the addressing mode,
+    // size, cycle count and page crossing penalty baked in.
+    // Predecoded handlers take their operand as an argument instead of
+    // reading it from memory.
+    typedef void (Cpu::*Handler)(uint16_t fetchpc, uint16_t operand);
+    template<typename Policy, int kOpcode, bool kPredecoded>
+    void ExecuteOp(uint16_t fetchpc, uint16_t operand);
+    template<typename Policy, bool kPredecoded, size_t... kOpcodes>
+    static constexpr std::array<Handler, 256> MakeHandlers(
+            std::index_sequence<kOpcodes...>) {
+        return {{&Cpu::ExecuteOp<Policy, kOpcodes, kPredecoded>...}};
+    }
+    static const std::array<Handler, 256> fast_handlers_;
+    static const std::array<Handler, 256> instrumented_handlers_;
+    static const std::array<Handler, 256> predecoded_handlers_;
+
+    // Translated blocks call one of these per instruction.  They run the
+    // predecoded handler and return whether the block may continue.
+    typedef bool (*JitHandler)(Cpu* cpu, uint16_t operand);
+    template<int kOpcode>
+    static bool JitOp(Cpu* cpu, uint16_t operand);
+    template<size_t... kOpcodes>
+    static constexpr std::array<JitHandler, 256> MakeJitHandlers(
+            std::index_sequence<kOpcodes...>) {
+        return {{&Cpu::JitOp<kOpcodes>...}};
+    }
+    static const std::array<JitHandler, 256> jit_handlers_;
+    friend class CpuJit;
+
+    // The decoded instruction cache.  Entries are indexed by pc and tagged
+    // with the tag of the 2KB window holding the instruction at the time
+    // it was decoded.  A window's tag combines the identity of what is
+    // mapped there (see SetCodeWindow) with an epoch which FlushCode
+    // advances, so switching back to a bank revives its entries.
+    struct DecodedOp {
+        Handler handler;
+        uint32_t tag;
+        uint16_t operand;
+    };
+    static const int kCodeWindowShift = 11;
+    static const uint32_t kUncached = 0xFFFFFFFF;
+    void Decode(DecodedOp* op);
+    void InvalidateWindow(int w);
+    std::unique_ptr<DecodedOp[]> icache_;
+    int window_id_[65536 >> kCodeWindowShift];
+    uint32_t window_tag_[65536 >> kCodeWindowShift];
+    bool window_rom_[65536 >> kCodeWindowShift];
+    bool window_translated_[65536 >> kCodeWindowShift];
+    uint32_t icache_epoch_;
+    uint64_t icache_hits_;
+    uint64_t icache_misses_;
+
+    std::unique_ptr<CpuJit> jit_;
+    uint64_t jit_deadline_;
+    // The window and tag of the running translated block.
+    int jit_window_;
+    uint32_t jit_tag_;
+
+    // The last loop seen by Looped: where it is, whether its body could be
+    // idle, the registers and cycle count at the last arrival at its head
+    // and whether execution has left the body since.
+    static const int kIdleLoopSize = 16;
+    struct IdleLoop {
+        uint16_t pc, end;
+        uint32_t tag;
+        bool body, reads_status, confirmed, left;
+        uint8_t a, x, y, sp, flags;
+        int iteration;
+        uint64_t cycles;
+    };
+    IdleLoop idle_;
 
     Mem* mem_;
     CpuFlags flags_;
@@ -183,23 +420,18 @@ class Cpu : public EmulatedDevice {
     int stall_;
     bool nmi_pending_;
     bool irq_pending_;
+    Engine engine_;
+    bool instrumented_;
 
-    static const InstructionInfo info_[256];
-    static const char* instruction_names_[256];
-
-    void Emit(const char *buf, int how=0);
+    void Emit(TraceRecord::Kind kind);
     void Trace();
 
-    static const int TRACEBUFSZ = 1000000;
-    static const int SLOP = 1000;
-    char tracebuf_[TRACEBUFSZ][80];
-    int tbptr_;
+    std::unique_ptr<CpuTrace> trace_;
+    CodeDataLog* cdl_;
     bool halted_;
-    std::map<uint16_t, MemoryCb> read_cb_;
-    std::map<uint16_t, MemoryCb> write_cb_;
-    std::map<uint16_t, ExecCb> exec_cb_;
-
-    uint8_t rwlog_[65536];
+    HookTable<MemoryCb> read_cb_;
+    HookTable<MemoryCb> write_cb_;
+    HookTable<ExecCb> exec_cb_;
 };
 
 }  // namespace protones
@@ -0,0 +1,243 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <vector>
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define PROTONES_JIT_X86_64 1
+#endif
+
+#include "absl/flags/flag.h"
+#include "nes/cpu6502.h"
+#include "nes/cpu6502_info.h"
+#include "nes/cpu6502_jit.h"
+
+ABSL_FLAG(int32_t, jit_threshold, 16,
+          "Number of times a block must start executing before the JIT "
+          "translates it");
+ABSL_FLAG(int32_t, jit_max_block, 32,
+          "Maximum number of instructions in a translated block");
+
+namespace protones {
+namespace {
+
+// Size of the code buffer.  When it fills up all blocks are thrown away
+// and translation starts over.
+const size_t kBufferSize = 4 << 20;
+
+// Host code bytes per translated instruction, and for the prologue and
+// epilogue of a block.
+const size_t kInstructionSize = 28;
+const size_t kBlockOverhead = 8;
+
+// Whether a block may contain the instruction.  Accesses through indexed
+// and indirect addressing modes are checked at run time by Cpu::JitOp.
+bool Translatable(uint8_t opcode, uint16_t operand) {
+    Cpu::InstructionInfo info = {kCpuInstructionInfo[opcode]};
+    CpuOp op = CpuOperation(opcode);
+    switch(Cpu::AddressingMode(info.mode)) {
+    case Cpu::Absolute:
+        if (op == CpuOp::JMP || op == CpuOp::JSR)
+            return true;
+        return JitSafe(operand, CpuOperationStores(opcode));
+    case Cpu::Indirect:
+        // JMP ($xxxx) reads its target from memory, with the 6502's page
+        // wrapping bug.
+        return JitSafe(operand, false) &&
+               JitSafe((operand & 0xFF00) | ((operand + 1) & 0xFF), false);
+    default:
+        return true;
+    }
+}
+
+// Whether a block must end after the instruction: it changes the pc, or
+// changes the interrupt disable flag, after which an IRQ may have to be
+// taken.
+bool EndsBlock(CpuOp op) {
+    switch(op) {
+    case CpuOp::BCC: case CpuOp::BCS: case CpuOp::BEQ: case CpuOp::BMI:
+    case CpuOp::BNE: case CpuOp::BPL: case CpuOp::BVC: case CpuOp::BVS:
+    case CpuOp::BRK: case CpuOp::JMP: case CpuOp::JSR: case CpuOp::RTI:
+    case CpuOp::RTS: case CpuOp::CLI: case CpuOp::PLP:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Just enough of an x86-64 assembler for the blocks.
+class Emitter {
+  public:
+    explicit Emitter(uint8_t* p) : p_(p) {}
+    inline uint8_t* pc() const { return p_; }
+    inline void Byte(uint8_t b) { *p_++ = b; }
+    inline void Bytes(std::initializer_list<uint8_t> bytes) {
+        for(uint8_t b : bytes) Byte(b);
+    }
+    inline void Imm32(uint32_t v) { memcpy(p_, &v, 4); p_ += 4; }
+    inline void Imm64(uint64_t v) { memcpy(p_, &v, 8); p_ += 8; }
+    // Returns the location of the rel32 to patch.
+    inline uint8_t* Jz() { Bytes({0x0F, 0x84}); Imm32(0); return p_ - 4; }
+    inline void Patch(uint8_t* rel32, uint8_t* target) {
+        int32_t rel = int32_t(target - (rel32 + 4));
+        memcpy(rel32, &rel, 4);
+    }
+
+  private:
+    uint8_t* p_;
+};
+
+}  // namespace
+
+std::unique_ptr<CpuJit> CpuJit::New(Cpu* cpu) {
+#ifdef PROTONES_JIT_X86_64
+    // The buffer is mapped twice: blocks are written through a writable
+    // view and run from an executable one, so no page is ever both.
+    int fd = memfd_create("protones-jit", MFD_CLOEXEC);
+    if (fd == -1) {
+        perror("CpuJit: memfd_create");
+        return nullptr;
+    }
+    void* code = MAP_FAILED;
+    void* exec = MAP_FAILED;
+    if (ftruncate(fd, kBufferSize) == 0) {
+        code = mmap(nullptr, kBufferSize, PROT_READ | PROT_WRITE,
+                    MAP_SHARED, fd, 0);
+        exec = mmap(nullptr, kBufferSize, PROT_READ | PROT_EXEC,
+                    MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (code == MAP_FAILED || exec == MAP_FAILED) {
+        perror("CpuJit: mmap");
+        if (code != MAP_FAILED) munmap(code, kBufferSize);
+        if (exec != MAP_FAILED) munmap(exec, kBufferSize);
+        return nullptr;
+    }
+    return std::unique_ptr<CpuJit>(new CpuJit(
+            cpu, static_cast<uint8_t*>(code), static_cast<uint8_t*>(exec),
+            kBufferSize));
+#else
+    fprintf(stderr, "CpuJit: not supported on this host\n");
+    return nullptr;
+#endif
+}
+
+CpuJit::CpuJit(Cpu* cpu, uint8_t* buffer, uint8_t* exec, size_t size)
+  : cpu_(cpu),
+    entries_(new Entry[65536]()),
+    buffer_(buffer),
+    exec_(exec),
+    size_(size),
+    used_(0),
+    blocks_(0),
+    threshold_(absl::GetFlag(FLAGS_jit_threshold)),
+    max_block_(absl::GetFlag(FLAGS_jit_max_block)) {
+    if (max_block_ < 1) max_block_ = 1;
+}
+
+CpuJit::~CpuJit() {
+#ifdef PROTONES_JIT_X86_64
+    munmap(buffer_, size_);
+    munmap(exec_, size_);
+#endif
+}
+
+void CpuJit::Clear() {
+    for(int i=0; i<65536; i++) entries_[i] = Entry{};
+    for(bool& translated : cpu_->window_translated_) translated = false;
+    used_ = 0;
+}
+
+bool CpuJit::Run() {
+    Cpu* cpu = cpu_;
+    uint16_t pc = cpu->pc_;
+    int w = pc >> Cpu::kCodeWindowShift;
+    if (!cpu->window_rom_[w])
+        return false;
+    uint32_t tag = cpu->window_tag_[w];
+    Entry* e = &entries_[pc];
+    if (e->tag != tag) {
+        *e = Entry{nullptr, tag, 0};
+    }
+    if (!e->code) {
+        if (++e->count < uint32_t(threshold_))
+            return false;
+        Block code = Translate(pc);
+        e = &entries_[pc];
+        *e = Entry{code, tag, 0};
+    }
+    cpu->jit_window_ = w;
+    cpu->jit_tag_ = tag;
+    uint64_t cycles = cpu->cycles_;
+    e->code(cpu);
+    return cpu->cycles_ != cycles;
+}
+
+CpuJit::Block CpuJit::Translate(uint16_t pc) {
+    if (size_ - used_ < kBlockOverhead + max_block_ * kInstructionSize) {
+        Clear();
+    }
+    Cpu* cpu = cpu_;
+    const int w = pc >> Cpu::kCodeWindowShift;
+    uint8_t* start = buffer_ + used_;
+    // The jumps in a block are relative, so it runs from the executable
+    // view as it was written to the other.
+    Emitter x(start);
+    std::vector<uint8_t*> exits;
+
+    // The block is called as void(Cpu*).  Keep the Cpu* in rbx, which the
+    // handlers preserve; pushing it also aligns the stack for the calls.
+    x.Byte(0x53);                       // push rbx
+    x.Bytes({0x48, 0x89, 0xFB});        // mov rbx, rdi
+
+    uint16_t addr = pc;
+    for(int n=0; n<max_block_; n++) {
+        uint8_t opcode = cpu->Read<FastPolicy>(addr);
+        Cpu::InstructionInfo info = {kCpuInstructionInfo[opcode]};
+        CpuOp op = CpuOperation(opcode);
+        if (op == CpuOp::Illegal || info.size == 0)
+            break;
+        // The block's tag only covers its own window.
+        uint16_t last = addr + info.size - 1;
+        if (last < addr || (last >> Cpu::kCodeWindowShift) != w)
+            break;
+        uint16_t operand = 0;
+        if (info.size == 2) {
+            operand = cpu->Read<FastPolicy>(addr + 1);
+        } else if (info.size == 3) {
+            operand = cpu->Read16<FastPolicy>(addr + 1);
+        }
+        if (!Translatable(opcode, operand))
+            break;
+
+        if (n > 0) {
+            x.Bytes({0x84, 0xC0});      // test al, al
+            exits.push_back(x.Jz());    // jz exit
+        }
+        x.Bytes({0x48, 0x89, 0xDF});    // mov rdi, rbx
+        x.Byte(0xBE);                   // mov esi, operand
+        x.Imm32(operand);
+        x.Bytes({0x48, 0xB8});          // mov rax, handler
+        x.Imm64(reinterpret_cast<uint64_t>(Cpu::jit_handlers_[opcode]));
+        x.Bytes({0xFF, 0xD0});          // call rax
+
+        addr += info.size;
+        if (EndsBlock(op))
+            break;
+    }
+
+    for(uint8_t* rel32 : exits) {
+        x.Patch(rel32, x.pc());
+    }
+    x.Byte(0x5B);                       // pop rbx
+    x.Byte(0xC3);                       // ret
+
+    used_ += x.pc() - start;
+    blocks_++;
+    cpu->window_translated_[w] = true;
+    return reinterpret_cast<Block>(exec_ + (start - buffer_));
+}
+
+}  // namespace protones
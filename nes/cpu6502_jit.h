@@ -0,0 +1,79 @@
+#ifndef PROTONES_NES_CPU6502_JIT_H
+#define PROTONES_NES_CPU6502_JIT_H
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace protones {
+
+class Cpu;
+
+// Whether a translated block may access `addr` itself.  The PPU, APU,
+// controller and mapper registers at $2000-$5FFF have side effects which
+// depend on when they happen relative to the other devices, which only
+// catch up after the block has run, and so does a write to $8000-$FFFF,
+// which is a mapper register write and may switch the block's own bank.
+// Instructions which touch them are left to the interpreter.
+inline bool JitSafe(uint16_t addr, bool store) {
+    if (addr >= 0x2000 && addr < 0x6000)
+        return false;
+    return !(store && addr >= 0x8000);
+}
+
+// Optional call-threading JIT for x86-64 hosts.
+//
+// Once a block (a straight line of instructions up to and including the
+// first branch, jump, return or change of the interrupt flag) has started
+// executing often enough, it is compiled to host code which is only a
+// sequence of calls: to the predecoded handler of each instruction, with
+// the operand as an immediate, each followed by a check whether to go on.
+// No instruction's semantics are compiled; the interpreter's handlers do
+// the work.  What it removes is the fetch, the decode, the interrupt
+// checks and the dispatch for all but the first instruction of the block.
+// Cycles are counted by the handlers themselves, so the count is exact
+// wherever the block exits.
+//
+// A block stops before an instruction which would touch I/O (see JitSafe)
+// and after the one which reaches the CPU's jit deadline; the interpreter
+// takes it from there.  Blocks are only translated from windows marked as
+// ROM, are tagged like the decoded instruction cache entries and so are
+// invalidated the same way when the mapper switches banks.
+//
+// Use `cpu_test --jit` and `jit_lockstep` to check translated code against
+// the interpreter.
+class CpuJit {
+  public:
+    // Returns nullptr if the host isn't supported.
+    static std::unique_ptr<CpuJit> New(Cpu* cpu);
+    ~CpuJit();
+
+    // Run the block at the cpu's pc, if there is one.  Returns false if
+    // nothing was executed.
+    bool Run();
+    inline uint64_t blocks() const { return blocks_; }
+
+  private:
+    typedef void (*Block)(Cpu* cpu);
+    struct Entry {
+        Block code;
+        uint32_t tag;
+        uint32_t count;
+    };
+    CpuJit(Cpu* cpu, uint8_t* buffer, uint8_t* exec, size_t size);
+    Block Translate(uint16_t pc);
+    void Clear();
+
+    Cpu* cpu_;
+    std::unique_ptr<Entry[]> entries_;
+    // The code buffer, writable, and the same memory mapped executable.
+    uint8_t* buffer_;
+    uint8_t* exec_;
+    size_t size_;
+    size_t used_;
+    uint64_t blocks_;
+    int threshold_;
+    int max_block_;
+};
+
+}  // namespace protones
+#endif // PROTONES_NES_CPU6502_JIT_H
@@ -0,0 +1,350 @@
+#include <cstdio>
+#include <cstdint>
+#include "nes/cpu6502.h"
+#include "nes/cpu6502_info.h"
+#include "nes/cpu6502_jit.h"
+
+// The threaded engine.
+//
+// Every opcode gets its own handler, instantiated from ExecuteOp.
+// The addressing mode, instruction size, cycle count and page crossing
+// penalty come from kCpuInstructionInfo and the operation comes from the
+// mnemonic in kCpuInstructionNames, so each handler compiles down to just
+// the work for that one opcode.  Execute() dispatches through a handler
+// table with a single indirect call instead of the mode and opcode
+// switches.  There is one handler table per instrumentation policy, plus
+// one for the decoded instruction cache whose handlers take the operand
+// from the cache entry rather than memory.  Blocks translated by the JIT
+// call the predecoded handlers through JitOp.
+//
+// The semantics (including the order of bus accesses) must match the
+// switch engine in cpu6502.cc exactly.  Use `cpu_test --compare_engines`
+// to check the two against each other.
+
+namespace protones {
+
+template<typename Policy, int kOpcode, bool kPredecoded>
+void Cpu::ExecuteOp(uint16_t fetchpc, uint16_t operand) {
+    constexpr uint16_t kInfo = kCpuInstructionInfo[kOpcode];
+    constexpr AddressingMode kMode = AddressingMode(kInfo & 0xF);
+    constexpr int kSize = (kInfo >> 4) & 0xF;
+    constexpr int kCycles = (kInfo >> 8) & 0xF;
+    constexpr int kPage = (kInfo >> 12) & 0xF;
+    constexpr CpuOp kOp = CpuOperation(kOpcode);
+
+    // The operand bytes come either from the decoded instruction cache or
+    // from memory, in the same order the switch engine reads them.
+    auto operand8 = [&]() -> uint8_t {
+        if constexpr (kPredecoded) {
+            return operand;
+        } else {
+            return Read<Policy>(pc_ + 1);
+        }
+    };
+    auto operand16 = [&]() -> uint16_t {
+        if constexpr (kPredecoded) {
+            return operand;
+        } else {
+            return Read16<Policy>(pc_ + 1);
+        }
+    };
+
+    uint16_t addr = 0;
+    if constexpr (kMode == Absolute) {
+        addr = operand16();
+    } else if constexpr (kMode == AbsoluteX) {
+        addr = operand16() + x_;
+        if (kPage && PagesDiffer(addr - x_, addr))
+            cycles_ += kPage;
+    } else if constexpr (kMode == AbsoluteY) {
+        addr = operand16() + y_;
+        if (kPage && PagesDiffer(addr - y_, addr))
+            cycles_ += kPage;
+    } else if constexpr (kMode == IndexedIndirect) {
+        addr = Read16<Policy>((operand8() + x_) & 0xff);
+    } else if constexpr (kMode == Indirect) {
+        addr = Read16Bug<Policy>(operand16());
+    } else if constexpr (kMode == IndirectIndexed) {
+        addr = Read16<Policy>(operand8()) + y_;
+        if (kPage && PagesDiffer(addr - y_, addr))
+            cycles_ += kPage;
+    } else if constexpr (kMode == ZeroPage) {
+        addr = operand8();
+    } else if constexpr (kMode == ZeroPageX) {
+        addr = (operand8() + x_) & 0xFF;
+    } else if constexpr (kMode == ZeroPageY) {
+        addr = (operand8() + y_) & 0xFF;
+    } else if constexpr (kMode == Immediate) {
+        addr = pc_ + 1;
+    } else if constexpr (kMode == Relative) {
+        addr = pc_ + 2 + int8_t(operand8());
+    }
+    pc_ += kSize;
+    cycles_ += kCycles;
+
+    // The value an instruction operates on.  A predecoded immediate
+    // operand is already at hand.
+    auto load = [&]() -> uint8_t {
+        if constexpr (kPredecoded && kMode == Immediate) {
+            return operand;
+        } else {
+            constexpr uint8_t kHow =
+                kMode == Immediate ? CodeDataLog::Code :
+                kMode == IndexedIndirect || kMode == IndirectIndexed ?
+                    CodeDataLog::Data | CodeDataLog::Indirect :
+                    CodeDataLog::Data;
+            return Read<Policy>(addr, kHow);
+        }
+    };
+
+    // Scratch values
+    uint8_t val, a, b;
+    int16_t r;
+    (void)operand; (void)addr; (void)val; (void)a; (void)b; (void)r;
+
+    if constexpr (kOp == CpuOp::BRK) {
+        Push16<Policy>(pc_+1);
+        Push<Policy>(flags_.value | 0x10);
+        flags_.i = 1;
+        pc_ = Read16<Policy>(0xFFFE, CodeDataLog::Data);
+        idle_.left = true;
+    } else if constexpr (kOp == CpuOp::ORA) {
+        a_ = a_ | load();
+        SetZN(a_);
+    } else if constexpr (kOp == CpuOp::AND) {
+        a_ = a_ & load();
+        SetZN(a_);
+    } else if constexpr (kOp == CpuOp::EOR) {
+        a_ = a_ ^ load();
+        SetZN(a_);
+    } else if constexpr (kOp == CpuOp::ASL && kMode == Accumulator) {
+        flags_.c = a_ >> 7;
+        a_ <<= 1;
+        SetZN(a_);
+    } else if constexpr (kOp == CpuOp::ASL) {
+        val = load();
+        flags_.c = val >> 7;
+        val <<= 1;
+        Write<Policy>(addr, val);
+        SetZN(val);
+    } else if constexpr (kOp == CpuOp::ROL && kMode == Accumulator) {
+        a = (a_ << 1) | flags_.c;
+        flags_.c = a_ >> 7;
+        a_ = a;
+        SetZN(a_);
+    } else if constexpr (kOp == CpuOp::ROL) {
+        r = load();
+        r = (r << 1) | flags_.c;
+        flags_.c = r >> 8;
+        Write<Policy>(addr, r);
+        SetZN(r);
+    } else if constexpr (kOp == CpuOp::LSR && kMode == Accumulator) {
+        flags_.c = a_ & 1;
+        a_ >>= 1;
+        SetZN(a_);
+    } else if constexpr (kOp == CpuOp::LSR) {
+        val = load();
+        flags_.c = val & 1;
+        val >>= 1;
+        Write<Policy>(addr, val);
+        SetZN(val);
+    } else if constexpr (kOp == CpuOp::ROR && kMode == Accumulator) {
+        a = (a_ >> 1) | (flags_.c << 7);
+        flags_.c = a_ & 1;
+        a_ = a;
+        SetZN(a_);
+    } else if constexpr (kOp == CpuOp::ROR) {
+        val = load();
+        a = (val >> 1) | (flags_.c << 7);
+        flags_.c = val & 1;
+        Write<Policy>(addr, a);
+        SetZN(a);
+    } else if constexpr (kOp == CpuOp::BIT) {
+        val = load();
+        flags_.v = val >> 6;
+        SetZ(val & a_);
+        SetN(val);
+    } else if constexpr (kOp == CpuOp::PHP) {
+        Push<Policy>(flags_.value | 0x10);
+    } else if constexpr (kOp == CpuOp::PLP) {
+        flags_.value = (Pull<Policy>() & 0xEF) | 0x20;
+    } else if constexpr (kOp == CpuOp::PHA) {
+        Push<Policy>(a_);
+    } else if constexpr (kOp == CpuOp::PLA) {
+        a_ = Pull<Policy>();
+        SetZN(a_);
+    } else if constexpr (kOp == CpuOp::BPL) {
+        if (!flags_.n)
+            Branch(addr);
+    } else if constexpr (kOp == CpuOp::BMI) {
+        if (flags_.n)
+            Branch(addr);
+    } else if constexpr (kOp == CpuOp::BVC) {
+        if (!flags_.v)
+            Branch(addr);
+    } else if constexpr (kOp == CpuOp::BVS) {
+        if (flags_.v)
+            Branch(addr);
+    } else if constexpr (kOp == CpuOp::BCC) {
+        if (!flags_.c)
+            Branch(addr);
+    } else if constexpr (kOp == CpuOp::BCS) {
+        if (flags_.c)
+            Branch(addr);
+    } else if constexpr (kOp == CpuOp::BNE) {
+        if (!flags_.z)
+            Branch(addr);
+    } else if constexpr (kOp == CpuOp::BEQ) {
+        if (flags_.z)
+            Branch(addr);
+    } else if constexpr (kOp == CpuOp::CLC) {
+        flags_.c = 0;
+    } else if constexpr (kOp == CpuOp::SEC) {
+        flags_.c = 1;
+    } else if constexpr (kOp == CpuOp::CLI) {
+        flags_.i = 0;
+    } else if constexpr (kOp == CpuOp::SEI) {
+        flags_.i = 1;
+    } else if constexpr (kOp == CpuOp::CLV) {
+        flags_.v = 0;
+    } else if constexpr (kOp == CpuOp::CLD) {
+        flags_.d = 0;
+    } else if constexpr (kOp == CpuOp::SED) {
+        flags_.d = true;
+    } else if constexpr (kOp == CpuOp::JSR) {
+        Push16<Policy>(pc_ - 1);
+        pc_ = addr;
+        idle_.left = true;
+    } else if constexpr (kOp == CpuOp::JMP) {
+        pc_ = addr;
+        Jumped(fetchpc);
+    } else if constexpr (kOp == CpuOp::RTI) {
+        flags_.value = (Pull<Policy>() & 0xEF) | 0x20;
+        pc_ = Pull16<Policy>();
+        idle_.left = true;
+    } else if constexpr (kOp == CpuOp::RTS) {
+        pc_ = Pull16<Policy>() + 1;
+        idle_.left = true;
+    } else if constexpr (kOp == CpuOp::ADC) {
+        a = a_;
+        b = load();
+        r = a + b + flags_.c;
+        a_ = r;
+        flags_.c = (r > 0xff);
+        flags_.v = ((a ^ b) & 0x80) == 0 && ((a ^ a_) & 0x80) != 0;
+        SetZN(a_);
+    } else if constexpr (kOp == CpuOp::SBC) {
+        a = a_;
+        b = load();
+        r = a - b - (1- flags_.c);
+        a_ = r;
+        flags_.c = (r >= 0);
+        flags_.v = ((a ^ r) & 0x80) != 0 && ((a ^ b) & 0x80) != 0;
+        SetZN(a_);
+    } else if constexpr (kOp == CpuOp::STA) {
+        Write<Policy>(addr, a_);
+    } else if constexpr (kOp == CpuOp::STX) {
+        Write<Policy>(addr, x_);
+    } else if constexpr (kOp == CpuOp::STY) {
+        Write<Policy>(addr, y_);
+    } else if constexpr (kOp == CpuOp::LDA) {
+        a_ = load();
+        SetZN(a_);
+    } else if constexpr (kOp == CpuOp::LDX) {
+        x_ = load();
+        SetZN(x_);
+    } else if constexpr (kOp == CpuOp::LDY) {
+        y_ = load();
+        SetZN(y_);
+    } else if constexpr (kOp == CpuOp::TAX) {
+        x_ = a_;
+        SetZN(x_);
+    } else if constexpr (kOp == CpuOp::TAY) {
+        y_ = a_;
+        SetZN(y_);
+    } else if constexpr (kOp == CpuOp::TXA) {
+        a_ = x_;
+        SetZN(a_);
+    } else if constexpr (kOp == CpuOp::TYA) {
+        a_ = y_;
+        SetZN(a_);
+    } else if constexpr (kOp == CpuOp::TSX) {
+        x_ = sp_;
+        SetZN(x_);
+    } else if constexpr (kOp == CpuOp::TXS) {
+        sp_ = x_;
+    } else if constexpr (kOp == CpuOp::CMP) {
+        Compare(a_, load());
+    } else if constexpr (kOp == CpuOp::CPX) {
+        Compare(x_, load());
+    } else if constexpr (kOp == CpuOp::CPY) {
+        Compare(y_, load());
+    } else if constexpr (kOp == CpuOp::INC) {
+        val = load() + 1;
+        Write<Policy>(addr, val);
+        SetZN(val);
+    } else if constexpr (kOp == CpuOp::DEC) {
+        val = load() - 1;
+        Write<Policy>(addr, val);
+        SetZN(val);
+    } else if constexpr (kOp == CpuOp::INX) {
+        SetZN(++x_);
+    } else if constexpr (kOp == CpuOp::INY) {
+        SetZN(++y_);
+    } else if constexpr (kOp == CpuOp::DEX) {
+        SetZN(--x_);
+    } else if constexpr (kOp == CpuOp::DEY) {
+        SetZN(--y_);
+    } else if constexpr (kOp == CpuOp::NOP) {
+    } else {
+        static_assert(kOp == CpuOp::Illegal, "Unhandled operation");
+        fprintf(stderr, "Illegal opcode %02x at %04x\n", kOpcode, fetchpc);
+        halted_ = true;
+        Flush();
+    }
+}
+
+template<int kOpcode>
+bool Cpu::JitOp(Cpu* cpu, uint16_t operand) {
+    constexpr uint16_t kInfo = kCpuInstructionInfo[kOpcode];
+    constexpr AddressingMode kMode = AddressingMode(kInfo & 0xF);
+    constexpr bool kStore = CpuOperationStores(kOpcode);
+
+    // Absolute and zero page addresses were checked when the block was
+    // translated.  Indexed and indirect ones are only known now, and the
+    // instruction must be left to the interpreter if they hit a register.
+    if constexpr (kMode == AbsoluteX || kMode == AbsoluteY ||
+                  kMode == IndexedIndirect || kMode == IndirectIndexed) {
+        uint16_t addr;
+        if constexpr (kMode == AbsoluteX) {
+            addr = operand + cpu->x_;
+        } else if constexpr (kMode == AbsoluteY) {
+            addr = operand + cpu->y_;
+        } else if constexpr (kMode == IndexedIndirect) {
+            addr = cpu->Read16<FastPolicy>((operand + cpu->x_) & 0xff);
+        } else {
+            addr = cpu->Read16<FastPolicy>(operand) + cpu->y_;
+        }
+        if (!JitSafe(addr, kStore))
+            return false;
+    }
+    cpu->ExecuteOp<FastPolicy, kOpcode, true>(cpu->pc_, operand);
+    if constexpr (kStore) {
+        // The store may have modified the block itself.
+        if (cpu->window_tag_[cpu->jit_window_] != cpu->jit_tag_)
+            return false;
+    }
+    return cpu->cycles_ < cpu->jit_deadline_;
+}
+
+const std::array<Cpu::Handler, 256> Cpu::fast_handlers_ =
+    Cpu::MakeHandlers<FastPolicy, false>(std::make_index_sequence<256>());
+const std::array<Cpu::Handler, 256> Cpu::instrumented_handlers_ =
+    Cpu::MakeHandlers<InstrumentedPolicy, false>(
+        std::make_index_sequence<256>());
+const std::array<Cpu::Handler, 256> Cpu::predecoded_handlers_ =
+    Cpu::MakeHandlers<FastPolicy, true>(std::make_index_sequence<256>());
+const std::array<Cpu::JitHandler, 256> Cpu::jit_handlers_ =
+    Cpu::MakeJitHandlers(std::make_index_sequence<256>());
+
+}  // namespace protones
@@ -0,0 +1,243 @@
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/flags/declare.h"
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "nes/cpu6502.h"
+#include "nes/flat_memory.h"
+
+ABSL_FLAG(int32_t, load, 0x400,
+          "Address to load a raw image at (iNES files go to $8000)");
+ABSL_FLAG(int32_t, start, -1,
+          "Address to start at: $400 for raw images, $C000 (nestest's "
+          "automated mode) for iNES files");
+ABSL_FLAG(int32_t, end, -1,
+          "Stop when the pc reaches this address ($C66E for nestest)");
+ABSL_FLAG(int64_t, max_cycles, 100000000,
+          "Maximum number of cycles to emulate per run");
+ABSL_FLAG(int32_t, repeat, 3, "Runs per configuration; the best is kept");
+ABSL_FLAG(std::string, json, "",
+          "Write the results as JSON to this file (- for stdout)");
+ABSL_DECLARE_FLAG(bool, icache);
+ABSL_DECLARE_FLAG(bool, jit);
+ABSL_DECLARE_FLAG(bool, trace);
+
+using protones::Cpu;
+using protones::FlatMemory;
+
+// Run a CPU test image (Klaus Dormann's functional tests, nestest.nes in
+// automated mode, ...) on the flat memory with every available execution
+// engine and instrumentation level, and report how fast each one goes.
+//
+// Every run stops at the same place: the end address, a trap (an
+// instruction which jumps to itself, which is how the functional tests
+// report success or failure) or --max_cycles.  The first run counts the
+// instructions; the others must end in the same state.  An illegal opcode
+// halts the CPU, and fails the configuration.
+
+struct Config {
+    const char* engine;
+    const char* level;
+    Cpu::Engine cpu_engine;
+    bool icache;
+    bool jit;
+    bool instrumented;
+    bool trace;
+};
+
+const Config kConfigs[] = {
+    {"switch",   "fast",         Cpu::Switch,   false, false, false, false},
+    {"switch",   "instrumented", Cpu::Switch,   false, false, true,  false},
+    {"switch",   "trace",        Cpu::Switch,   false, false, true,  true},
+    {"threaded", "fast",         Cpu::Threaded, false, false, false, false},
+    {"threaded", "instrumented", Cpu::Threaded, false, false, true,  false},
+    {"threaded", "trace",        Cpu::Threaded, false, false, true,  true},
+    {"icache",   "fast",         Cpu::Threaded, true,  false, false, false},
+    {"jit",      "fast",         Cpu::Threaded, true,  true,  false, false},
+};
+
+struct Result {
+    const Config* config;
+    double seconds;
+    uint64_t cycles;
+    uint64_t instructions;
+    uint16_t pc;
+    // The CPU stopped at an illegal opcode.
+    bool halted;
+};
+
+// Whether the instruction at `pc` jumps or branches to itself.
+bool Trap(FlatMemory* mem, uint16_t pc) {
+    uint8_t opcode = mem->read_byte(pc);
+    if (opcode == 0x4C) {
+        return mem->read_word(pc + 1) == pc;
+    }
+    return (opcode & 0x1F) == 0x10 && mem->read_byte(pc + 1) == 0xFE;
+}
+
+bool Run(const Config& config, const std::string& image, Result* result) {
+    // The decoded instruction cache only exists if the flag was set when
+    // the Cpu was made.
+    absl::SetFlag(&FLAGS_icache, config.icache);
+    absl::SetFlag(&FLAGS_jit, false);
+    absl::SetFlag(&FLAGS_trace, false);
+    std::unique_ptr<FlatMemory> mem(new FlatMemory);
+    std::unique_ptr<Cpu> cpu(new Cpu);
+    if (!mem->Load(image, absl::GetFlag(FLAGS_load)))
+        return false;
+    mem->Attach(cpu.get());
+    cpu->set_engine(config.cpu_engine);
+    cpu->set_instrumented(config.instrumented);
+    cpu->set_trace(config.trace);
+    if (config.jit) {
+        cpu->set_jit(true);
+        if (!cpu->jit())
+            return false;
+    }
+
+    int start = absl::GetFlag(FLAGS_start);
+    if (start < 0) {
+        start = mem->ines() ? 0xC000 : 0x400;
+    }
+    const int end = absl::GetFlag(FLAGS_end);
+    const uint64_t max_cycles = absl::GetFlag(FLAGS_max_cycles);
+    cpu->set_pc(start);
+    // Translated blocks must stop where the interpreter would.
+    cpu->set_jit_deadline(max_cycles);
+
+    uint64_t instructions = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    while (cpu->cycles() < max_cycles && cpu->pc() != end) {
+        uint16_t pc = cpu->pc();
+        cpu->Execute();
+        instructions++;
+        if (cpu->halted() || (cpu->pc() == pc && Trap(mem.get(), pc)))
+            break;
+    }
+    auto t1 = std::chrono::steady_clock::now();
+
+    result->config = &config;
+    result->seconds = std::chrono::duration<double>(t1 - t0).count();
+    result->cycles = cpu->cycles();
+    result->instructions = instructions;
+    result->pc = cpu->pc();
+    result->halted = cpu->halted();
+    return true;
+}
+
+void WriteJson(FILE* fp, const std::string& image,
+               const std::vector<Result>& results) {
+    const Result& ref = results[0];
+    fprintf(fp, "{\n  \"image\": \"%s\",\n", image.c_str());
+    fprintf(fp, "  \"cycles\": %" PRIu64 ",\n"
+            "  \"instructions\": %" PRIu64 ",\n",
+            ref.cycles, ref.instructions);
+    fprintf(fp, "  \"end_pc\": %u,\n  \"results\": [\n", ref.pc);
+    for(size_t i=0; i<results.size(); i++) {
+        const Result& r = results[i];
+        fprintf(fp, "    {\"engine\": \"%s\", \"level\": \"%s\", "
+                "\"seconds\": %.6f, \"mhz\": %.3f, "
+                "\"instructions_per_sec\": %.0f, \"cycles_per_sec\": %.0f}%s\n",
+                r.config->engine, r.config->level, r.seconds,
+                ref.cycles / r.seconds / 1e6,
+                ref.instructions / r.seconds, ref.cycles / r.seconds,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+}
+
+int main(int argc, char *argv[]) {
+    auto args = absl::ParseCommandLine(argc, argv);
+    if (args.size() < 2) {
+        fprintf(stderr, "Usage: %s [flags] <image>\n", args[0]);
+        return 1;
+    }
+    const std::string image = args[1];
+    const int repeat = std::max(1, absl::GetFlag(FLAGS_repeat));
+    // Run fails when a configuration isn't available, so make sure that's
+    // not because of the image.
+    std::unique_ptr<FlatMemory> mem(new FlatMemory);
+    if (!mem->Load(image, absl::GetFlag(FLAGS_load))) {
+        fprintf(stderr, "%s: could not load the image\n", image.c_str());
+        return 1;
+    }
+
+    std::vector<Result> results;
+    bool ok = true;
+    for(const Config& config : kConfigs) {
+        Result best{};
+        bool ran = false;
+        for(int i=0; i<repeat; i++) {
+            Result r;
+            if (!Run(config, image, &r))
+                break;
+            if (r.halted) {
+                best = r;
+                ran = true;
+                break;
+            }
+            if (!ran || r.seconds < best.seconds)
+                best = r;
+            ran = true;
+        }
+        if (!ran) {
+            fprintf(stderr, "%s/%s: not available\n",
+                    config.engine, config.level);
+            continue;
+        }
+        if (best.halted) {
+            fprintf(stderr, "%s/%s: illegal opcode at %04x after %" PRIu64
+                    " cycles\n", config.engine, config.level, best.pc,
+                    best.cycles);
+            ok = false;
+            continue;
+        }
+        // The JIT counts a translated block as one Execute, so the
+        // instruction count comes from the first run.
+        if (!results.empty() && (best.cycles != results[0].cycles ||
+                                 best.pc != results[0].pc)) {
+            fprintf(stderr, "%s/%s: ended at %04x after %" PRIu64 " cycles, "
+                    "expected %04x after %" PRIu64 "\n",
+                    config.engine, config.level, best.pc, best.cycles,
+                    results[0].pc, results[0].cycles);
+            ok = false;
+        }
+        results.push_back(best);
+    }
+    if (results.empty())
+        return 1;
+
+    const Result& ref = results[0];
+    printf("%s: %" PRIu64 " instructions, %" PRIu64 " cycles, "
+           "ended at %04x\n",
+           image.c_str(), ref.instructions, ref.cycles, ref.pc);
+    printf("%-10s %-13s %10s %14s %14s\n",
+           "engine", "level", "MHz", "instr/sec", "cycles/sec");
+    for(const Result& r : results) {
+        printf("%-10s %-13s %10.2f %14.0f %14.0f\n",
+               r.config->engine, r.config->level,
+               ref.cycles / r.seconds / 1e6,
+               ref.instructions / r.seconds, ref.cycles / r.seconds);
+    }
+
+    const std::string json = absl::GetFlag(FLAGS_json);
+    if (json == "-") {
+        WriteJson(stdout, image, results);
+    } else if (!json.empty()) {
+        FILE* fp = fopen(json.c_str(), "w");
+        if (!fp) {
+            perror(json.c_str());
+            return 1;
+        }
+        WriteJson(fp, image, results);
+        fclose(fp);
+    }
+    return ok ? 0 : 1;
+}
@@ -2,43 +2,111 @@
 #include <cstdio>
 #include <string>
 
+#include "absl/flags/declare.h"
 #include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
 #include "nes/cpu6502.h"
-#include "nes/mem.h"
+#include "nes/flat_memory.h"
 
 ABSL_FLAG(int32_t, end, 0, "End address");
 ABSL_FLAG(int64_t, max_cycles, 0, "Maxiumum number of cycles to emulate");
+ABSL_FLAG(bool, compare_engines, false,
+          "Run the threaded engine (or the JIT, with --jit) in lockstep "
+          "with the switch engine and stop at the first instruction where "
+          "they differ");
+ABSL_FLAG(bool, instrumented, false,
+          "Run the instrumented CPU path instead of the fast one");
+ABSL_FLAG(bool, mirror_test, false,
+          "Instead of running an image, check that code written through a "
+          "mirror of RAM runs as written, on each engine");
+ABSL_DECLARE_FLAG(bool, threaded_cpu);
+ABSL_DECLARE_FLAG(bool, jit);
 
-class Memory: public protones::Mem {
-  public:
-    Memory() : Mem(nullptr) {}
+using protones::FlatMemory;
 
-    uint8_t read_byte(uint16_t addr) override { return ram_[addr]; }
-    void write_byte(uint16_t addr, uint8_t val) override { ram_[addr] = val; }
+FlatMemory mem;
+protones::Cpu cpu;
+FlatMemory ref_mem;
+protones::Cpu ref_cpu;
 
-    uint8_t read_byte_no_io(uint16_t addr) override { return read_byte(addr); }
-    void write_byte_no_io(uint16_t addr, uint8_t val) override { write_byte(addr, val); }
+bool SameState() {
+    return cpu.pc() == ref_cpu.pc() &&
+           cpu.a() == ref_cpu.a() &&
+           cpu.x() == ref_cpu.x() &&
+           cpu.y() == ref_cpu.y() &&
+           cpu.sp() == ref_cpu.sp() &&
+           cpu.flags() == ref_cpu.flags() &&
+           cpu.cycles() == ref_cpu.cycles() &&
+           mem.writes() == ref_mem.writes();
+}
 
-    void Load(const std::string& file, uint16_t addr) {
-        FILE* fp = fopen(file.c_str(), "rb");
-        size_t n = fread(ram_+addr, 1, 65536-addr, fp);
-        printf("Read %zu bytes into ram\n", n);
-        fclose(fp);
+// Run a routine at $0600, then patch its operand through the mirror at
+// $0E00 and run it again.  The decoded instruction cache and the JIT only
+// cache $0000-$07FF, so the write must invalidate what's cached there.
+bool MirrorTest(protones::Cpu::Engine engine, bool jit) {
+    static const uint8_t kMain[] = {
+        0x20, 0x00, 0x06,   // $0400 JSR $0600
+        0xA9, 0x02,         //       LDA #$02
+        0x8D, 0x01, 0x0E,   //       STA $0E01
+        0x20, 0x00, 0x06,   //       JSR $0600
+        0x4C, 0x0B, 0x04,   // $040B JMP $040B
+    };
+    static const uint8_t kRoutine[] = {
+        0xA9, 0x01,         // $0600 LDA #$01
+        0x60,               //       RTS
+    };
+    FlatMemory m;
+    protones::Cpu c;
+    m.set_ram_mirrors(true);
+    for(size_t i=0; i<sizeof(kMain); i++) m.write_byte(0x400 + i, kMain[i]);
+    for(size_t i=0; i<sizeof(kRoutine); i++)
+        m.write_byte(0x600 + i, kRoutine[i]);
+    m.Attach(&c);
+    c.set_engine(engine);
+    c.set_jit(jit);
+    c.set_jit_deadline(UINT64_MAX);
+    c.set_pc(0x400);
+    while(c.pc() != 0x40B && c.cycles() < 1000) {
+        c.Emulate();
     }
-  private:
-    uint8_t ram_[64*1024];
-};
-
-Memory mem;
-protones::Cpu cpu;
+    bool ok = c.pc() == 0x40B && c.a() == 2;
+    printf("mirror test (%s%s): %s, A=%02x\n",
+           engine == protones::Cpu::Switch ? "switch" : "threaded",
+           jit ? ", jit" : "", ok ? "ok" : "FAILED", c.a());
+    return ok;
+}
 
 int main(int argc, char *argv[]) {
     printf("argc=%d argv=%p\n", argc, argv);
     auto args = absl::ParseCommandLine(argc, argv);
 
-    mem.Load(args[1], 0x400);
-    cpu.memory(&mem);
+    bool compare = absl::GetFlag(FLAGS_compare_engines);
+    bool jit = absl::GetFlag(FLAGS_jit);
+    if (absl::GetFlag(FLAGS_mirror_test)) {
+        bool ok = MirrorTest(protones::Cpu::Switch, false);
+        ok = MirrorTest(protones::Cpu::Threaded, false) && ok;
+        ok = MirrorTest(protones::Cpu::Threaded, true) && ok;
+        return ok ? 0 : 1;
+    }
+    cpu.set_instrumented(absl::GetFlag(FLAGS_instrumented));
+    ref_cpu.set_instrumented(absl::GetFlag(FLAGS_instrumented));
+    printf("Read %zu bytes into ram\n", mem.Load(args[1], 0x400));
+    mem.Attach(&cpu);
     cpu.set_pc(0x400);
+    if (compare) {
+        cpu.set_engine(protones::Cpu::Threaded);
+        ref_mem.Load(args[1], 0x400);
+        ref_mem.Attach(&ref_cpu);
+        ref_cpu.set_pc(0x400);
+        ref_cpu.set_engine(protones::Cpu::Switch);
+        ref_cpu.set_jit(false);
+    } else {
+        cpu.set_engine(absl::GetFlag(FLAGS_threaded_cpu)
+                       ? protones::Cpu::Threaded : protones::Cpu::Switch);
+    }
+    // Nothing outside the CPU ever needs it to stop here.
+    cpu.set_jit(jit);
+    cpu.set_jit_deadline(UINT64_MAX);
 
 
     for(;;) {
@@ -49,9 +117,28 @@ int main(int argc, char *argv[]) {
         printf("%s\n   %-40s %lu (0x%lx)\n", state.c_str(), instr.c_str(), cpu.cycles(), cpu.cycles());
 
         cpu.Emulate();
+        if (compare) {
+            // A translated block runs several instructions at once.  Its
+            // state must match the reference's after the same
+            // instructions; run with --jit_max_block=1 to compare after
+            // every instruction.
+            do {
+                ref_cpu.Emulate();
+            } while (ref_cpu.cycles() < cpu.cycles());
+            if (!SameState()) {
+                printf("MISMATCH!\n  %s: %s %lu\n  switch:   %s %lu\n",
+                       jit ? "jit     " : "threaded",
+                       cpu.CpuState().c_str(), cpu.cycles(),
+                       ref_cpu.CpuState().c_str(), ref_cpu.cycles());
+                return 1;
+            }
+        }
         if (cpu.pc() == absl::GetFlag(FLAGS_end) ||
             (absl::GetFlag(FLAGS_max_cycles) && cpu.cycles() >= absl::GetFlag(FLAGS_max_cycles))) {
             printf("SUCCESS!\n");
+            printf("icache: %lu hits, %lu misses\n",
+                   cpu.icache_hits(), cpu.icache_misses());
+            printf("jit: %lu blocks translated\n", cpu.jit_blocks());
             break;
         }
     }
@@ -0,0 +1,113 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#define __STDC_FORMAT_MACROS 1
+#include <inttypes.h>
+#include "nes/cpu6502.h"
+#include "nes/cpu_trace.h"
+
+namespace protones {
+
+CpuTrace::CpuTrace(size_t size, const std::string& filename)
+  : ring_(new TraceRecord[size ? size : 1]),
+    size_(size ? size : 1),
+    head_(0),
+    tail_(0),
+    fp_(nullptr),
+    stop_(false),
+    last_cycles_(0) {
+    if (!filename.empty()) {
+        fp_ = fopen(filename.c_str(), "w");
+        if (fp_) {
+            writer_ = std::thread(&CpuTrace::Writer, this);
+        } else {
+            perror(filename.c_str());
+        }
+    }
+}
+
+CpuTrace::~CpuTrace() {
+    if (fp_) {
+        stop_ = true;
+        writer_.join();
+        fclose(fp_);
+    }
+}
+
+int CpuTrace::Format(const TraceRecord& r, char* buf) {
+    int n;
+    switch(r.kind) {
+    case TraceRecord::Instruction:
+        // The CPU state before the instruction, then the instruction and
+        // the cycles since the last record.
+        n = sprintf(buf, "%10s", "");
+        n += Cpu::FormatState(buf + n, r.pc, r.a, r.x, r.y, r.sp, r.flags);
+        n += sprintf(buf + n, "\n%" PRIu64 ":     ", r.cycles - last_cycles_);
+        if (r.bank >= 0) {
+            n += sprintf(buf + n, "%02x:", r.bank);
+        }
+        n += Cpu::FormatInstruction(buf + n, r.pc, r.opcode,
+                                    r.operand[0], r.operand[1]);
+        break;
+    case TraceRecord::Reset:
+        n = sprintf(buf, "%" PRIu64 ": RESET", r.cycles);
+        break;
+    case TraceRecord::NMI:
+        n = sprintf(buf, "%" PRIu64 ": NMI", r.cycles);
+        break;
+    case TraceRecord::IRQ:
+        n = sprintf(buf, "%" PRIu64 ": IRQ", r.cycles);
+        break;
+    default:
+        n = 0;
+    }
+    buf[n++] = '\n';
+    last_cycles_ = r.cycles;
+    return n;
+}
+
+void CpuTrace::Flush() {
+    if (fp_) {
+        while (tail_.load(std::memory_order_acquire) !=
+               head_.load(std::memory_order_relaxed)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        fflush(fp_);
+        return;
+    }
+    char buf[256];
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    uint64_t i = head > size_ ? head - size_ : 0;
+    if (i < head) last_cycles_ = ring_[i % size_].cycles;
+    for(; i < head; i++) {
+        int n = Format(ring_[i % size_], buf);
+        fwrite(buf, 1, n, stderr);
+    }
+}
+
+void CpuTrace::Writer() {
+    char buf[256];
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    for(;;) {
+        // Look at stop_ first, so everything appended before it was set
+        // gets written out.
+        bool stop = stop_;
+        uint64_t head = head_.load(std::memory_order_acquire);
+        if (tail == head) {
+            if (stop)
+                break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        for(; tail != head; tail++) {
+            int n = Format(ring_[tail % size_], buf);
+            fwrite(buf, 1, n, fp_);
+            if (tail % 1024 == 0) {
+                tail_.store(tail, std::memory_order_release);
+            }
+        }
+        tail_.store(tail, std::memory_order_release);
+    }
+}
+
+}  // namespace protones
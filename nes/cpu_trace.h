@@ -0,0 +1,72 @@
+#ifndef PROTONES_NES_CPU_TRACE_H
+#define PROTONES_NES_CPU_TRACE_H
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace protones {
+
+// One traced instruction or event, recorded as is.  Disassembly and
+// formatting are left until the trace is written out.
+struct TraceRecord {
+    enum Kind : uint8_t {
+        Instruction,
+        Reset,
+        NMI,
+        IRQ,
+    };
+    uint64_t cycles;
+    // The id of the code window holding pc (see Cpu::SetCodeWindow),
+    // which for PRG ROM is the bank number.
+    int32_t bank;
+    uint16_t pc;
+    Kind kind;
+    uint8_t opcode;
+    uint8_t operand[2];
+    uint8_t a, x, y, sp, flags;
+};
+static_assert(sizeof(TraceRecord) == 24, "TraceRecord should be compact");
+
+// A ring buffer of trace records, only allocated while tracing.
+//
+// Without a file it keeps the most recent `size` records, which Flush
+// writes to stderr.  With a file, a writer thread drains the ring and
+// writes the formatted records to it as they come in.  The CPU waits
+// for the writer if it gets a whole ring ahead, so nothing is lost.
+class CpuTrace {
+  public:
+    CpuTrace(size_t size, const std::string& filename);
+    ~CpuTrace();
+
+    inline void Append(const TraceRecord& record) {
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        if (fp_) {
+            while (head - tail_.load(std::memory_order_acquire) >= size_) {
+                std::this_thread::yield();
+            }
+        }
+        ring_[head % size_] = record;
+        head_.store(head + 1, std::memory_order_release);
+    }
+    void Flush();
+
+  private:
+    void Writer();
+    int Format(const TraceRecord& record, char* buf);
+
+    std::unique_ptr<TraceRecord[]> ring_;
+    size_t size_;
+    std::atomic<uint64_t> head_;
+    std::atomic<uint64_t> tail_;
+    FILE* fp_;
+    std::atomic<bool> stop_;
+    std::thread writer_;
+    // The cycle count of the last formatted record.
+    uint64_t last_cycles_;
+};
+
+}  // namespace protones
+#endif // PROTONES_NES_CPU_TRACE_H
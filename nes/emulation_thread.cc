@@ -0,0 +1,77 @@
+#include "nes/emulation_thread.h"
+
+#include <chrono>
+#include <cmath>
+#include <mutex>
+
+#include "nes/apu.h"
+#include "nes/ppu.h"
+
+namespace protones {
+
+EmulationThread::EmulationThread(NES* nes, std::function<void()> frame)
+  : nes_(nes),
+    frame_(frame),
+    pacer_(nes->options().fps),
+    running_(false) {
+    if (!frame_) {
+        frame_ = [this]() {
+            std::lock_guard<std::recursive_mutex> lock(nes_->mutex());
+            nes_->EmulateFrame();
+        };
+    }
+}
+
+EmulationThread::~EmulationThread() {
+    Stop();
+}
+
+void EmulationThread::Start() {
+    if (running_)
+        return;
+    running_ = true;
+    pacer_.Restart();
+    thread_ = std::thread(&EmulationThread::Run, this);
+}
+
+void EmulationThread::Stop() {
+    running_ = false;
+    if (thread_.joinable())
+        thread_.join();
+}
+
+void EmulationThread::Run() {
+    while(running_) {
+        Pace();
+        frame_();
+        std::lock_guard<std::recursive_mutex> lock(nes_->mutex());
+        frames_.Publish(nes_->ppu()->picture(), nes_->frame());
+    }
+}
+
+void EmulationThread::Pace() {
+    bool audio;
+    double speed = 1.0;
+    double fill = -1;
+    {
+        std::lock_guard<std::recursive_mutex> lock(nes_->mutex());
+        audio = nes_->apu()->lock_to_audio() && !nes_->pause();
+        if (nes_->fast_forward() && !nes_->pause())
+            speed = nes_->fast_forward_speed();
+        if (audio)
+            fill = double(nes_->apu()->queued()) / APU::BUFFERLEN;
+    }
+    pacer_.set_audio_fill(fill);
+    pacer_.Wait(speed);
+    if (audio) {
+        // The pacer keeps the queue about half full; this only catches
+        // it running over.  A frame makes at most this many samples, and
+        // fewer when the APU is decimating them.
+        int samples = int(std::ceil(44100.0 / nes_->options().fps));
+        if (!nes_->apu()->WaitForRoom(samples, std::chrono::milliseconds(100))) {
+            pacer_.Restart();
+        }
+    }
+}
+
+}  // namespace protones
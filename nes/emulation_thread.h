@@ -0,0 +1,51 @@
+#ifndef PROTONES_NES_EMULATION_THREAD_H
+#define PROTONES_NES_EMULATION_THREAD_H
+#include <atomic>
+#include <functional>
+#include <thread>
+
+#include "nes/frame_buffer.h"
+#include "nes/frame_pacer.h"
+#include "nes/nes.h"
+
+namespace protones {
+
+// Runs an NES on a thread of its own, so the frontend can draw at its own
+// rate.
+//
+// A FramePacer paces the frames.  When the framerate is locked to audio
+// it follows the audio queue, and each frame also waits for room in it
+// before it starts.  The picture of each frame is published to a
+// FrameBuffer.  The NES is locked (see NES::mutex) while a frame is
+// emulated, and never while waiting, so the frontend can look at it
+// between frames.
+class EmulationThread {
+  public:
+    // `frame` emulates one frame, locking the NES while it does.  The
+    // default just calls NES::EmulateFrame.
+    explicit EmulationThread(NES* nes, std::function<void()> frame=nullptr);
+    ~EmulationThread();
+
+    void Start();
+    // Stop after the frame being emulated.  Must not be called while
+    // holding anything `frame` waits for.
+    void Stop();
+    inline bool running() const { return running_; }
+    inline FrameBuffer* frames() { return &frames_; }
+    inline FramePacer* pacer() { return &pacer_; }
+
+  private:
+    void Run();
+    // Wait until it's time for the next frame.
+    void Pace();
+
+    NES* nes_;
+    std::function<void()> frame_;
+    FrameBuffer frames_;
+    FramePacer pacer_;
+    std::atomic<bool> running_;
+    std::thread thread_;
+};
+
+}  // namespace protones
+#endif // PROTONES_NES_EMULATION_THREAD_H
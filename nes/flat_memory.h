@@ -0,0 +1,88 @@
+#ifndef PROTONES_NES_FLAT_MEMORY_H
+#define PROTONES_NES_FLAT_MEMORY_H
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "nes/cpu6502.h"
+#include "nes/mem.h"
+
+namespace protones {
+
+// A flat 64KB RAM with no I/O, for running CPU test programs without the
+// rest of the NES (see cpu_test and cpu_benchmark).
+class FlatMemory: public Mem {
+  public:
+    FlatMemory() : Mem(nullptr) {}
+
+    uint8_t read_byte(uint16_t addr) override { return ram_[Ram(addr)]; }
+    void write_byte(uint16_t addr, uint8_t val) override {
+        ram_[Ram(addr)] = val;
+        if (cpu_) cpu_->InvalidateCode(Ram(addr));
+        writes_ = writes_ * 31 + (addr << 8 | val);
+    }
+
+    uint8_t read_byte_no_io(uint16_t addr) override { return read_byte(addr); }
+    void write_byte_no_io(uint16_t addr, uint8_t val) override { write_byte(addr, val); }
+
+    // Load a raw image at `addr`, or the PRG ROM of an iNES file (e.g.
+    // nestest.nes) at $8000, with a 16KB PRG mirrored at $C000.  Returns
+    // the number of bytes read; ines() tells which it was.
+    size_t Load(const std::string& file, uint16_t addr) {
+        FILE* fp = fopen(file.c_str(), "rb");
+        if (!fp) {
+            perror(file.c_str());
+            return 0;
+        }
+        uint8_t header[16];
+        size_t n = fread(header, 1, sizeof(header), fp);
+        ines_ = n == sizeof(header) && !memcmp(header, "NES\x1a", 4);
+        if (ines_) {
+            size_t prglen = header[4] * 16384;
+            if (header[6] & 4) fseek(fp, 512, SEEK_CUR);
+            if (prglen > 0x8000) prglen = 0x8000;
+            n = fread(ram_ + 0x8000, 1, prglen, fp);
+            if (prglen == 0x4000) memcpy(ram_ + 0xC000, ram_ + 0x8000, 0x4000);
+        } else {
+            rewind(fp);
+            n = fread(ram_ + addr, 1, 65536 - addr, fp);
+        }
+        fclose(fp);
+        return n;
+    }
+    bool ines() const { return ines_; }
+    // A running hash of every write, so two memories can be compared
+    // cheaply after each instruction.
+    uint64_t writes() const { return writes_; }
+
+    // Mirror $0000-$07FF up to $1FFF, as the NES does.  Like the NES
+    // (see NES::UpdateCodeWindows), only $0000-$07FF is cached.  Call
+    // before Attach.
+    void set_ram_mirrors(bool mirrors) { ram_mirrors_ = mirrors; }
+
+    // Every byte is RAM, so the whole address space is one cacheable
+    // window which the CPU must hear about on every write.  It's marked as
+    // ROM anyway so the JIT translates the test program.
+    void Attach(Cpu* cpu) {
+        cpu_ = cpu;
+        cpu->memory(this);
+        cpu->SetCodeWindow(0x0000, 0xFFFF, 0, true);
+        if (ram_mirrors_) {
+            cpu->SetCodeWindow(0x0800, 0x1FFF, -1);
+        }
+    }
+  private:
+    inline uint16_t Ram(uint16_t addr) const {
+        return ram_mirrors_ && addr < 0x2000 ? addr & 0x7FF : addr;
+    }
+
+    uint8_t ram_[64*1024] = {0, };
+    uint64_t writes_ = 0;
+    bool ines_ = false;
+    bool ram_mirrors_ = false;
+    Cpu* cpu_ = nullptr;
+};
+
+}  // namespace protones
+#endif // PROTONES_NES_FLAT_MEMORY_H
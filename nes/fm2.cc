@@ -20,7 +20,7 @@ void FM2Movie::Load(const std::string& filename) {
     FILE *fp;
     char buf[256];
     int n = 0;
-    int predelay = absl::GetFlag(FLAGS_fm2_predelay);
+    int predelay = nes_->options().fm2_predelay;
 
     fp = fopen(filename.c_str(), "r");
     if (fp == nullptr) {
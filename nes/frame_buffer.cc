@@ -0,0 +1,28 @@
+#include "nes/frame_buffer.h"
+
+#include <cstring>
+
+namespace protones {
+
+FrameBuffer::FrameBuffer()
+  : back_(0),
+    front_(1),
+    middle_(2) {
+    memset(buffer_, 0, sizeof(buffer_));
+}
+
+void FrameBuffer::Publish(const uint32_t* picture, uint64_t frame) {
+    Buffer* b = &buffer_[back_];
+    memcpy(b->picture, picture, sizeof(b->picture));
+    b->frame = frame;
+    back_ = middle_.exchange(back_ | kFresh, std::memory_order_acq_rel) & 3;
+}
+
+bool FrameBuffer::Acquire() {
+    if (!(middle_.load(std::memory_order_relaxed) & kFresh))
+        return false;
+    front_ = middle_.exchange(front_, std::memory_order_acq_rel) & 3;
+    return true;
+}
+
+}  // namespace protones
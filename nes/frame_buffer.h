@@ -0,0 +1,45 @@
+#ifndef PROTONES_NES_FRAME_BUFFER_H
+#define PROTONES_NES_FRAME_BUFFER_H
+#include <atomic>
+#include <cstdint>
+
+namespace protones {
+
+// Hands finished pictures from the thread which emulates to the thread
+// which shows them, without either one waiting for the other.
+//
+// There are three buffers: the producer fills one, the consumer shows
+// another, and the third holds the newest finished picture.  Publishing
+// trades the producer's buffer for that one, and so does acquiring the
+// consumer's, each with a single atomic exchange.  The consumer always
+// gets the newest picture; the ones it was too slow to see are dropped.
+class FrameBuffer {
+  public:
+    static const int kWidth = 256;
+    static const int kHeight = 240;
+    FrameBuffer();
+
+    // Producer: copy in the picture of `frame`, and make it the newest.
+    void Publish(const uint32_t* picture, uint64_t frame);
+    // Consumer: switch to the newest picture, and return whether it is
+    // one which hadn't been acquired before.
+    bool Acquire();
+    // Consumer: the picture from the last Acquire, and its frame.
+    inline const uint32_t* picture() const { return buffer_[front_].picture; }
+    inline uint64_t frame() const { return buffer_[front_].frame; }
+
+  private:
+    // Marks the middle buffer as not acquired yet.
+    static const int kFresh = 4;
+    struct Buffer {
+        uint32_t picture[kWidth * kHeight];
+        uint64_t frame;
+    };
+    Buffer buffer_[3];
+    int back_;
+    int front_;
+    std::atomic<int> middle_;
+};
+
+}  // namespace protones
+#endif // PROTONES_NES_FRAME_BUFFER_H
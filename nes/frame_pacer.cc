@@ -0,0 +1,142 @@
+#include "nes/frame_pacer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+namespace protones {
+
+namespace {
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::nanoseconds;
+
+// How far the audio queue's fill from half full corrects the rate.
+const double kAudioGain = 0.02;
+// Smoothing of the audio queue's fill: it is filled a frame at a time
+// and drained a buffer at a time, so it swings by a buffer.
+const double kAudioSmoothing = 0.02;
+// Smoothing of the measured frame interval.
+const double kIntervalSmoothing = 0.01;
+}  // namespace
+
+constexpr double FramePacer::kMaxCorrection;
+
+FramePacer::FramePacer(double fps)
+  : fps_(fps),
+    display_refresh_(0),
+    audio_fill_(-1),
+    correction_(0),
+    carry_(0),
+    interval_(0),
+    deadline_(Clock::now()),
+    last_(deadline_),
+    spin_(microseconds(500)) {
+}
+
+double FramePacer::bucket_limit(int i) {
+    return i < kBuckets - 1 ? 16e-6 * (1 << i) : HUGE_VAL;
+}
+
+void FramePacer::set_audio_fill(double fill) {
+    if (fill < 0) {
+        audio_fill_ = -1;
+    } else if (audio_fill_ < 0) {
+        audio_fill_ = fill;
+    } else {
+        audio_fill_ += kAudioSmoothing * (fill - audio_fill_);
+    }
+}
+
+FramePacer::Clock::duration FramePacer::Period(double speed) {
+    double fps = fps_;
+    double refresh = display_refresh_;
+    if (refresh > 0 && std::abs(refresh / fps_ - 1) <= kMaxCorrection) {
+        fps = refresh;
+    }
+    if (audio_fill_ >= 0) {
+        // Fuller than half: slow down.
+        double c = kAudioGain * (0.5 - audio_fill_);
+        fps *= 1 + std::max(-kMaxCorrection, std::min(kMaxCorrection, c));
+    }
+    correction_ = fps / fps_ - 1;
+    // Carry the fraction of a nanosecond over to the next period.
+    double ns = 1e9 / (fps * speed) + carry_;
+    double whole = std::floor(ns);
+    carry_ = ns - whole;
+    return duration_cast<Clock::duration>(nanoseconds(int64_t(whole)));
+}
+
+void FramePacer::Wait(double speed) {
+    auto now = Clock::now();
+    if (speed <= 0) {
+        deadline_ = now;
+        Record(now, Clock::duration::zero(), false);
+        return;
+    }
+    auto period = Period(speed);
+    deadline_ += period;
+    bool missed = now > deadline_;
+    Clock::duration late = now - deadline_;
+    if (late > period) {
+        // Too far behind to catch up without a burst of frames: start
+        // over from now.
+        deadline_ = now;
+    } else if (!missed) {
+        if (deadline_ - now > spin_) {
+            auto target = deadline_ - spin_;
+            std::this_thread::sleep_until(target);
+            // Spin for about twice as long as sleeps oversleep.
+            auto over = Clock::now() - target;
+            spin_ = std::max<Clock::duration>(microseconds(50),
+                    std::min<Clock::duration>(microseconds(4000),
+                                              (spin_ * 7 + over * 2) / 8));
+        }
+        while((now = Clock::now()) < deadline_) {
+            std::this_thread::yield();
+        }
+        late = now - deadline_;
+    }
+    Record(now, late, missed);
+}
+
+void FramePacer::Restart() {
+    deadline_ = Clock::now();
+    last_ = deadline_;
+}
+
+void FramePacer::Record(Clock::time_point now, Clock::duration late,
+                        bool missed) {
+    double seconds = std::chrono::duration<double>(late).count();
+    double interval = std::chrono::duration<double>(now - last_).count();
+    last_ = now;
+    if (interval_ == 0) {
+        interval_ = interval;
+    } else if (interval < 1) {
+        interval_ += kIntervalSmoothing * (interval - interval_);
+    }
+
+    int bucket = 0;
+    while(bucket < kBuckets - 1 && seconds >= bucket_limit(bucket)) {
+        ++bucket;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.frames++;
+    if (missed) stats_.missed++;
+    stats_.jitter[bucket]++;
+    stats_.max_jitter = std::max(stats_.max_jitter, seconds);
+    stats_.fps = interval_ > 0 ? 1.0 / interval_ : 0;
+    stats_.correction = correction_;
+}
+
+FramePacer::Stats FramePacer::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void FramePacer::ResetStats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_ = Stats();
+}
+
+}  // namespace protones
@@ -0,0 +1,88 @@
+#ifndef PROTONES_NES_FRAME_PACER_H
+#define PROTONES_NES_FRAME_PACER_H
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace protones {
+
+// Paces a loop to a steady rate by the monotonic clock.
+//
+// The deadlines are kept in nanoseconds and each one follows the last by
+// exactly one period, so rounding never adds up to drift.  Wait sleeps
+// until shortly before the deadline and spins the rest of the way; how
+// long before is learned from how late the sleeps wake up.
+//
+// Two things can correct the rate, by at most kMaxCorrection:
+//  - A display whose refresh is that close to the rate sets the rate
+//    instead, so each refresh shows one frame.
+//  - The fill of the audio queue, when the frames feed one: the rate
+//    follows the audio clock by keeping the queue half full.
+class FramePacer {
+  public:
+    using Clock = std::chrono::steady_clock;
+    static constexpr double kMaxCorrection = 0.005;
+    // Jitter histogram buckets: the first counts frames which started
+    // less than 16us after their deadline, and each one after covers
+    // twice the time of the one before, the last everything from 16ms.
+    static const int kBuckets = 12;
+
+    struct Stats {
+        uint64_t frames = 0;
+        // Frames which weren't ready to wait until after their deadline.
+        uint64_t missed = 0;
+        uint64_t jitter[kBuckets] = {};
+        // The latest any frame started, in seconds.
+        double max_jitter = 0;
+        // The rate measured from when the frames started, and the
+        // correction applied to the nominal rate.
+        double fps = 0;
+        double correction = 0;
+    };
+    // The upper limit of bucket `i`, in seconds.
+    static double bucket_limit(int i);
+
+    explicit FramePacer(double fps);
+
+    // Wait for the next deadline, running `speed` times the rate; don't
+    // wait at all if it is 0.
+    void Wait(double speed=1.0);
+    // Start over from now, e.g. after a pause.
+    void Restart();
+
+    inline double fps() const { return fps_; }
+    void set_fps(double fps) { fps_ = fps; }
+    // The refresh rate of the display, or 0 if unknown.  Any thread.
+    void set_display_refresh(double hz) { display_refresh_ = hz; }
+    // How full the audio queue is, from 0 to 1, or negative if nothing
+    // is playing the frames' audio.
+    void set_audio_fill(double fill);
+
+    // Any thread.
+    Stats stats() const;
+    void ResetStats();
+
+  private:
+    // The period at `speed`, corrected.
+    Clock::duration Period(double speed);
+    void Record(Clock::time_point now, Clock::duration late, bool missed);
+
+    double fps_;
+    std::atomic<double> display_refresh_;
+    double audio_fill_;
+    double correction_;
+    // The fraction of a nanosecond left over from the last period.
+    double carry_;
+    // The smoothed time between frames, in seconds.
+    double interval_;
+    Clock::time_point deadline_;
+    Clock::time_point last_;
+    Clock::duration spin_;
+
+    mutable std::mutex mutex_;
+    Stats stats_;
+};
+
+}  // namespace protones
+#endif // PROTONES_NES_FRAME_PACER_H
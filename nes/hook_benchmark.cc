@@ -0,0 +1,77 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/declare.h"
+#include "nes/cpu6502.h"
+#include "nes/nes.h"
+
+ABSL_FLAG(int32_t, frames, 1200, "Number of frames to emulate per run");
+ABSL_FLAG(int32_t, many_hooks, 2048,
+          "Number of read and write hooks to install for the 'many' run");
+ABSL_DECLARE_FLAG(bool, lock_framerate_to_audio);
+ABSL_DECLARE_FLAG(bool, sram_on_disk);
+
+using protones::Cpu;
+using protones::NES;
+
+// Emulate a fixed number of frames from the same starting state and report
+// the achieved frame rate.
+double RunFrames(NES* nes, const std::string& start) {
+    nes->LoadState(start);
+    int frames = absl::GetFlag(FLAGS_frames);
+    auto t0 = std::chrono::steady_clock::now();
+    for(int i=0; i<frames; i++) {
+        nes->EmulateFrame();
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    return frames / std::chrono::duration<double>(t1 - t0).count();
+}
+
+int main(int argc, char *argv[]) {
+    auto args = absl::ParseCommandLine(argc, argv);
+    if (args.size() < 2) {
+        fprintf(stderr, "Usage: %s [flags] <rom>\n", args[0]);
+        return 1;
+    }
+    // Run unthrottled and don't touch the user's save files.
+    absl::SetFlag(&FLAGS_lock_framerate_to_audio, false);
+    absl::SetFlag(&FLAGS_sram_on_disk, false);
+
+    NES nes;
+    nes.LoadFile(args[1]);
+    nes.Reset();
+    std::string start = nes.SaveState();
+    Cpu* cpu = nes.cpu();
+
+    auto passthru = [](Cpu* cpu, uint16_t addr, uint8_t val) { return val; };
+    auto exec = [](Cpu* cpu) { return cpu->pc(); };
+
+    double none = RunFrames(&nes, start);
+
+    // A single read hook in zero page, where most games keep hot variables.
+    cpu->set_read_cb(0x0000, passthru);
+    double one = RunFrames(&nes, start);
+    cpu->ClearCallbacks();
+
+    int many = absl::GetFlag(FLAGS_many_hooks);
+    for(int i=0; i<many; i++) {
+        cpu->set_read_cb(uint16_t(i), passthru);
+        cpu->set_write_cb(uint16_t(i), passthru);
+    }
+    for(int i=0; i<256; i++) {
+        cpu->set_exec_cb(uint16_t(0x8000 + i * 0x80), exec);
+    }
+    double lots = RunFrames(&nes, start);
+    cpu->ClearCallbacks();
+
+    printf("%-24s %10s\n", "hooks", "frames/sec");
+    printf("%-24s %10.1f\n", "none", none);
+    printf("%-24s %10.1f\n", "one", one);
+    printf("%-24s %10.1f\n",
+           (std::to_string(many * 2 + 256) + " (many)").c_str(), lots);
+    return 0;
+}
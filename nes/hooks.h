@@ -0,0 +1,69 @@
+#ifndef PROTONES_NES_HOOKS_H
+#define PROTONES_NES_HOOKS_H
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+namespace protones {
+
+// A sparse table of callbacks indexed by a 16-bit CPU bus address.
+//
+// A presence bitmap covering the whole address space makes the common
+// "no hook here" case a single bit test.  Handlers are stored in 256-entry
+// pages which are only allocated once a hook is installed in that page, so
+// an empty table costs 8KB for the bitmap and nothing else.
+template<typename Callback>
+class HookTable {
+  public:
+    HookTable() : present_{0, }, count_(0) {}
+
+    inline bool contains(uint16_t addr) const {
+        return (present_[addr >> 6] >> (addr & 63)) & 1;
+    }
+    inline bool empty() const { return count_ == 0; }
+    inline size_t size() const { return count_; }
+
+    // Only valid when contains(addr) is true.
+    inline const Callback& operator[](uint16_t addr) const {
+        return pages_[addr >> 8][addr & 0xFF];
+    }
+
+    // Install a callback at addr.  An empty callback (e.g. None from
+    // python) removes the hook.
+    void Set(uint16_t addr, const Callback& cb) {
+        uint64_t bit = uint64_t(1) << (addr & 63);
+        auto& page = pages_[addr >> 8];
+        if (!cb) {
+            if (!contains(addr))
+                return;
+            page[addr & 0xFF] = nullptr;
+            present_[addr >> 6] &= ~bit;
+            count_--;
+            return;
+        }
+        if (!page) {
+            page.reset(new Callback[256]);
+        }
+        page[addr & 0xFF] = cb;
+        if (!contains(addr)) {
+            present_[addr >> 6] |= bit;
+            count_++;
+        }
+    }
+
+    void Clear() {
+        memset(present_, 0, sizeof(present_));
+        for(auto& page : pages_) {
+            page.reset();
+        }
+        count_ = 0;
+    }
+
+  private:
+    uint64_t present_[65536 / 64];
+    std::unique_ptr<Callback[]> pages_[256];
+    size_t count_;
+};
+
+}  // namespace protones
+#endif // PROTONES_NES_HOOKS_H
@@ -0,0 +1,87 @@
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "absl/flags/declare.h"
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "nes/cpu6502.h"
+#include "nes/mem.h"
+#include "nes/nes.h"
+
+ABSL_FLAG(int32_t, frames, 600, "Number of frames to emulate");
+ABSL_DECLARE_FLAG(bool, lock_framerate_to_audio);
+ABSL_DECLARE_FLAG(bool, sram_on_disk);
+
+using protones::Cpu;
+using protones::NES;
+
+// Run a ROM on two NESes, one with the JIT and one without, and compare
+// them every time the JIT one has executed an instruction or a translated
+// block.  Run with --jit_max_block=1 to compare after every instruction.
+
+bool SameState(NES* a, NES* b) {
+    Cpu* x = a->cpu();
+    Cpu* y = b->cpu();
+    if (x->pc() != y->pc() || x->a() != y->a() || x->x() != y->x() ||
+        x->y() != y->y() || x->sp() != y->sp() ||
+        x->flags() != y->flags() || x->cycles() != y->cycles() ||
+        x->irq_pending() != y->irq_pending()) {
+        return false;
+    }
+    for(uint16_t addr=0; addr<0x800; addr++) {
+        if (a->mem()->read_byte(addr) != b->mem()->read_byte(addr))
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    auto args = absl::ParseCommandLine(argc, argv);
+    if (args.size() < 2) {
+        fprintf(stderr, "Usage: %s [flags] <rom>\n", args[0]);
+        return 1;
+    }
+    absl::SetFlag(&FLAGS_lock_framerate_to_audio, false);
+    absl::SetFlag(&FLAGS_sram_on_disk, false);
+
+    NES jit, ref;
+    for(NES* nes : {&jit, &ref}) {
+        nes->LoadFile(args[1]);
+        nes->Reset();
+    }
+    jit.cpu()->set_jit(true);
+    ref.cpu()->set_jit(false);
+    if (!jit.cpu()->jit()) {
+        fprintf(stderr, "The JIT isn't available\n");
+        return 1;
+    }
+
+    uint64_t end = uint64_t(absl::GetFlag(FLAGS_frames)) * 29781;
+    uint64_t steps = 0;
+    while (jit.cpu_cycles() < end) {
+        std::string before = jit.cpu()->CpuState();
+        jit.Emulate(end);
+        do {
+            ref.Emulate(end);
+        } while (ref.cpu_cycles() < jit.cpu_cycles());
+        steps++;
+        if (!SameState(&jit, &ref)) {
+            printf("MISMATCH after step %lu from %s\n"
+                   "  jit: %s %lu\n  ref: %s %lu\n",
+                   steps, before.c_str(),
+                   jit.cpu()->CpuState().c_str(), jit.cpu_cycles(),
+                   ref.cpu()->CpuState().c_str(), ref.cpu_cycles());
+            return 1;
+        }
+    }
+    // The other devices only catch up with the CPU after a translated
+    // block, so check they ended up in the same place as well.
+    if (jit.SaveState() != ref.SaveState()) {
+        printf("MISMATCH in the final state\n");
+        return 1;
+    }
+    printf("SUCCESS! %lu cycles in %lu steps, %lu blocks translated\n",
+           jit.cpu_cycles(), steps, jit.cpu()->jit_blocks());
+    return 0;
+}
@@ -6,6 +6,7 @@
 #include "nes/base.h"
 #include "nes/cartridge.h"
 #include "nes/nes.h"
+#include "nes/snapshot.h"
 #include "proto/mappers.pb.h"
 namespace protones {
 
@@ -15,8 +16,22 @@ class Mapper : public EmulatedDevice {
     enum PseudoRegister {
         CpuExecBank,
     };
+    // How the mapper needs to be clocked.  The NES only calls it when it
+    // has something to do:
+    //   ClockNone:     never.
+    //   ClockCpu:      CpuCycles(n) after every n CPU cycles (M2).
+    //   ClockScanline: Scanline() at dot 260 of every line the PPU renders
+    //                  with rendering on, when the sprite pattern fetches
+    //                  raise PPU A12 (see PPU::Run).
+    //   ClockDot:      Emulate() after every PPU dot.
+    enum Clock {
+        ClockNone,
+        ClockCpu,
+        ClockScanline,
+        ClockDot,
+    };
 
-    Mapper(NES* nes) : nes_(nes) {}
+    Mapper(NES* nes, Clock clock=ClockDot) : nes_(nes), clock_(clock) {}
     virtual uint8_t Read(uint16_t addr) = 0;
     virtual void ReadChr2(uint16_t addr, uint8_t* a, uint8_t* b) {
         *a = Read(addr);
@@ -29,15 +44,28 @@ class Mapper : public EmulatedDevice {
     }
 
     virtual void Write(uint16_t addr, uint8_t val) = 0;
+    inline Clock clock() const { return clock_; }
     virtual void Emulate() {}
+    virtual void CpuCycles(int n) {}
+    virtual void Scanline() {}
     virtual void LoadState(proto::Mapper *state) {}
     virtual void SaveState(proto::Mapper *state) {}
+    virtual void LoadState(Snapshot* snap) {}
+    virtual void SaveState(Snapshot* snap) {}
     virtual void LoadEverdriveState(const uint8_t* state) {}
     virtual uint8_t RegisterValue(PseudoRegister reg) {
         static uint8_t bogus = 0xff;
         return bogus;
     }
 
+    // Identify what the CPU sees in the 8KB window starting at addr
+    // (0x6000, 0x8000, ... 0xE000) so the CPU can cache decoded
+    // instructions there: the 8KB PRG ROM bank number, kSramWindow | bank
+    // for PRG RAM, or -1 if code in the window must not be cached.
+    // The NES asks again after every write to a mapper register.
+    static const int kSramWindow = 0x8000;
+    virtual int PrgWindow(uint16_t addr) { return -1; }
+
     // Calculate addresses based on the "standard" mirror modes for the NES.
     uint16_t MirrorAddress(uint16_t addr) {
         static const uint16_t lookup[5][4] = {
@@ -59,6 +87,9 @@ class Mapper : public EmulatedDevice {
     virtual uint8_t* VramAddress(uint8_t* ppuram, uint16_t addr) {
         return ppuram + MirrorAddress(addr);
     }
+    // The PPU wrote through a pointer from VramAddress outside `ppuram`,
+    // into VRAM of the mapper's own.
+    virtual void VramWritten(uint8_t* p) {}
 
     virtual float ExpansionAudio() { return 0; }
     virtual const APUDevices& DebugExpansionAudio() {
@@ -68,6 +99,8 @@ class Mapper : public EmulatedDevice {
 
   protected:
     NES* nes_;
+  private:
+    Clock clock_;
 };
 
 class MapperRegistry {
@@ -1,6 +1,5 @@
 #include "nes/mapper1.h"
 
-#include "imgui.h"
 #include "nes/cartridge.h"
 #include "nes/cpu6502.h"
 #include "nes/pbmacro.h"
@@ -8,7 +7,7 @@
 namespace protones {
 
 Mapper1::Mapper1(NES* nes)
-    : Mapper(nes),
+    : Mapper(nes, ClockNone),
     shift_register_(0x10),
     control_(0),
     prg_mode_(0), chr_mode_(0),
@@ -45,6 +44,22 @@ void Mapper1::SaveState(proto::Mapper* mstate) {
     state->add_chr_offset(chr_offset_[1]);
 }
 
+void Mapper1::LoadState(Snapshot* snap) {
+    snap->Load(shift_register_,
+               control_,
+               prg_mode_, chr_mode_,
+               prg_bank_, chr_bank0_, chr_bank1_,
+               prg_offset_, chr_offset_);
+}
+
+void Mapper1::SaveState(Snapshot* snap) {
+    snap->Save(shift_register_,
+               control_,
+               prg_mode_, chr_mode_,
+               prg_bank_, chr_bank0_, chr_bank1_,
+               prg_offset_, chr_offset_);
+}
+
 uint8_t Mapper1::Read(uint16_t addr) {
     if (addr < 0x2000) {
         int bank = addr / 0x1000;
@@ -89,9 +104,6 @@ void Mapper1::Write(uint16_t addr, uint8_t val) {
     }
 }
 
-void Mapper1::Emulate() {
-}
-
 int Mapper1::PrgBankOffset(int index) {
     if (index >= 0x80)
         index -= 0x100;
@@ -202,5 +214,11 @@ uint8_t Mapper1::RegisterValue(PseudoRegister reg) {
     }
 }
 
+int Mapper1::PrgWindow(uint16_t addr) {
+    if (addr < 0x8000)
+        return kSramWindow;
+    return (prg_offset_[(addr - 0x8000) / 0x4000] + (addr & 0x2000)) / 0x2000;
+}
+
 REGISTER_MAPPER(1, Mapper1);
 }  // namespace protones
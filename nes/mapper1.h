@@ -11,11 +11,13 @@ class Mapper1: public Mapper {
     void ReadChr2(uint16_t addr, uint8_t* a, uint8_t* b) override;
     uint8_t Read(uint16_t addr) override;
     void Write(uint16_t addr, uint8_t val) override;
-    void Emulate() override;
 
     void LoadState(proto::Mapper* state) override;
     void SaveState(proto::Mapper* state) override;
+    void LoadState(Snapshot* snap) override;
+    void SaveState(Snapshot* snap) override;
     uint8_t RegisterValue(PseudoRegister reg) override;
+    int PrgWindow(uint16_t addr) override;
 
   private:
     int PrgBankOffset(int index);
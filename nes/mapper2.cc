@@ -7,7 +7,7 @@ namespace protones {
 class Mapper2: public Mapper {
   public:
     Mapper2(NES* nes):
-        Mapper(nes),
+        Mapper(nes, ClockNone),
         prg_banks_(nes_->cartridge()->prglen() / 0x4000),
         prg_bank1_(0),
         prg_bank2_(prg_banks_ - 1) {}
@@ -22,6 +22,14 @@ class Mapper2: public Mapper {
         SAVE(prg_banks, prg_bank1, prg_bank2);
     }
 
+    void LoadState(Snapshot* snap) {
+        snap->Load(prg_banks_, prg_bank1_, prg_bank2_);
+    }
+
+    void SaveState(Snapshot* snap) {
+        snap->Save(prg_banks_, prg_bank1_, prg_bank2_);
+    }
+
     uint8_t Read(uint16_t addr) override {
         if (addr < 0x2000) {
             return nes_->cartridge()->ReadChr(addr);
@@ -37,6 +45,16 @@ class Mapper2: public Mapper {
         return 0;
     }
 
+    int PrgWindow(uint16_t addr) override {
+        if (addr < 0x8000) {
+            return kSramWindow;
+        } else if (addr < 0xC000) {
+            return (prg_bank1_*0x4000 + (addr & 0x2000)) / 0x2000;
+        } else {
+            return (prg_bank2_*0x4000 + (addr & 0x2000)) / 0x2000;
+        }
+    }
+
     void Write(uint16_t addr, uint8_t val) override {
         if (addr < 0x2000) {
             return nes_->cartridge()->WriteChr(addr, val);
@@ -7,7 +7,7 @@ namespace protones {
 class Mapper3: public Mapper {
   public:
     Mapper3(NES* nes):
-        Mapper(nes),
+        Mapper(nes, ClockNone),
         chr_banks_(nes_->cartridge()->chrlen() / 0x2000),
         chr_bank1_(0) {}
 
@@ -21,6 +21,14 @@ class Mapper3: public Mapper {
         SAVE(chr_banks, chr_bank1);
     }
 
+    void LoadState(Snapshot* snap) {
+        snap->Load(chr_banks_, chr_bank1_);
+    }
+
+    void SaveState(Snapshot* snap) {
+        snap->Save(chr_banks_, chr_bank1_);
+    }
+
     uint8_t Read(uint16_t addr) override {
         if (addr < 0x2000) {
             return nes_->cartridge()->ReadChr(chr_bank1_*0x2000 + addr);
@@ -32,6 +40,12 @@ class Mapper3: public Mapper {
         return 0;
     }
 
+    int PrgWindow(uint16_t addr) override {
+        if (addr < 0x8000)
+            return kSramWindow;
+        return (addr - 0x8000) / 0x2000;
+    }
+
     void Write(uint16_t addr, uint8_t val) override {
         if (addr < 0x2000) {
             return nes_->cartridge()->WriteChr(chr_bank1_*0x2000 + addr, val);
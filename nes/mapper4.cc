@@ -12,9 +12,12 @@ class Mapper4: public Mapper {
     Mapper4(NES* nes);
     uint8_t Read(uint16_t addr) override;
     void Write(uint16_t addr, uint8_t val) override;
-    void Emulate() override;
+    int PrgWindow(uint16_t addr) override;
+    void Scanline() override;
     void LoadState(proto::Mapper* mstate) override;
     void SaveState(proto::Mapper* mstate) override;
+    void LoadState(Snapshot* snap) override;
+    void SaveState(Snapshot* snap) override;
 
   private:
     int PrgBankOffset(int index);
@@ -36,7 +39,7 @@ class Mapper4: public Mapper {
 };
 
 Mapper4::Mapper4(NES* nes)
-    : Mapper(nes),
+    : Mapper(nes, ClockScanline),
     irqen_(false),
     register_(0),
     reload_(0),
@@ -65,6 +68,9 @@ void Mapper4::SaveState(proto::Mapper* mstate) {
     auto* state = mstate->mutable_mmc3();
     SAVE(irqen, reload, counter, prg_mode, chr_mode);
     SAVE_FIELD(register_, register_);
+    state->clear_registers();
+    state->clear_chr_offset();
+    state->clear_prg_offset();
     for(int i=0; i<8; i++) {
         state->add_registers(registers_[i]);
         state->add_chr_offset(chr_offset_[i]);
@@ -72,6 +78,16 @@ void Mapper4::SaveState(proto::Mapper* mstate) {
     }
 }
 
+void Mapper4::LoadState(Snapshot* snap) {
+    snap->Load(irqen_, reload_, counter_, prg_mode_, chr_mode_,
+               register_, registers_, prg_offset_, chr_offset_);
+}
+
+void Mapper4::SaveState(Snapshot* snap) {
+    snap->Save(irqen_, reload_, counter_, prg_mode_, chr_mode_,
+               register_, registers_, prg_offset_, chr_offset_);
+}
+
 uint8_t Mapper4::Read(uint16_t addr) {
     if (addr < 0x2000) {
         int bank = addr / 0x400;
@@ -90,6 +106,12 @@ uint8_t Mapper4::Read(uint16_t addr) {
     return 0;
 }
 
+int Mapper4::PrgWindow(uint16_t addr) {
+    if (addr < 0x8000)
+        return kSramWindow;
+    return prg_offset_[(addr - 0x8000) / 0x2000] / 0x2000;
+}
+
 void Mapper4::Write(uint16_t addr, uint8_t val) {
     if (addr < 0x2000) {
         int bank = addr / 0x400;
@@ -104,20 +126,9 @@ void Mapper4::Write(uint16_t addr, uint8_t val) {
     }
 }
 
-void Mapper4::Emulate() {
-    auto cycle = nes_->ppu()->cycle();
-    auto scanline = nes_->ppu()->scanline();
-    auto mask = nes_->ppu()->mask();
-
-    // fogleman's NES uses 280 here (and comments that it should be 260)
-    // Nimes uses 300.
-    if (cycle != 260)
-        return;
-    if (scanline >= 240 && scanline <= 260)
-        return;
-    if (!mask.showbg and !mask.showsprites)
-        return;
-
+void Mapper4::Scanline() {
+    // The PPU calls this at dot 260.  fogleman's NES uses 280 here (and
+    // comments that it should be 260); Nimes uses 300.
     if (counter_ == 0) {
         counter_ = reload_;
     } else {
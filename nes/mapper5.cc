@@ -16,7 +16,7 @@ namespace protones {
 class Mapper5: public Mapper {
   public:
     Mapper5(NES* nes):
-        Mapper(nes),
+        Mapper(nes, ClockDot),
         prg_banks_(nes_->cartridge()->prglen() / 0x2000),
         prg_mode_(0),
         chr_mode_(0),
@@ -43,12 +43,14 @@ class Mapper5: public Mapper {
         timer_running_(false),
         apu_divider_(0),
         cycle_(0),
+        junk_(0),
 
         pulse_{{nes, 1}, {nes, 2}},
         audio_debug_{&pulse_[0], &pulse_[1]}
         {
         pulse_[0].set_name("MMC5 Pulse 0");
         pulse_[1].set_name("MMC5 Pulse 1");
+        ext_ram_pages_.Attach(ext_ram_, sizeof(ext_ram_));
     }
 
     void LoadState(proto::Mapper* mstate) {
@@ -69,6 +71,9 @@ class Mapper5: public Mapper {
              scanline_counter,
              irq_enable,
              irq_status,
+             timer,
+             timer_irq,
+             timer_running,
              apu_divider,
              cycle);
         LOAD_ARRAYS(prg_ram_protect,
@@ -78,8 +83,9 @@ class Mapper5: public Mapper {
         size_t len = std::min(sizeof(ext_ram_),
                               state->mutable_ext_ram()->size());
         memcpy(ext_ram_, state->mutable_ext_ram()->data(), len);
-        pulse_[0].SaveState(state->mutable_pulse(0));
-        pulse_[1].SaveState(state->mutable_pulse(1));
+        ext_ram_pages_.TouchAll();
+        pulse_[0].LoadState(state->mutable_pulse(0));
+        pulse_[1].LoadState(state->mutable_pulse(1));
     }
 
     void SaveState(proto::Mapper* mstate) {
@@ -100,6 +106,9 @@ class Mapper5: public Mapper {
              scanline_counter,
              irq_enable,
              irq_status,
+             timer,
+             timer_irq,
+             timer_running,
              apu_divider,
              cycle);
         SAVE_ARRAYS(prg_ram_protect,
@@ -114,6 +123,68 @@ class Mapper5: public Mapper {
         pulse_[1].SaveState(state->add_pulse());
     }
 
+    void LoadState(Snapshot* snap) {
+        snap->Load(prg_banks_,
+                   prg_mode_,
+                   chr_mode_,
+                   ext_ram_mode_,
+                   nt_map_,
+                   fill_tile_,
+                   fill_color_,
+                   chr_upper_,
+                   vsplit_mode_,
+                   vsplit_scroll_,
+                   vsplit_bank_,
+                   vsplit_region_,
+                   irq_scanline_,
+                   scanline_counter_,
+                   irq_enable_,
+                   irq_status_,
+                   timer_,
+                   timer_irq_,
+                   timer_running_,
+                   apu_divider_,
+                   cycle_,
+                   prg_ram_protect_,
+                   prg_bank_,
+                   chr_bank_,
+                   multiplier_);
+        ext_ram_pages_.Load(snap, ext_ram_);
+        pulse_[0].LoadState(snap);
+        pulse_[1].LoadState(snap);
+    }
+
+    void SaveState(Snapshot* snap) {
+        snap->Save(prg_banks_,
+                   prg_mode_,
+                   chr_mode_,
+                   ext_ram_mode_,
+                   nt_map_,
+                   fill_tile_,
+                   fill_color_,
+                   chr_upper_,
+                   vsplit_mode_,
+                   vsplit_scroll_,
+                   vsplit_bank_,
+                   vsplit_region_,
+                   irq_scanline_,
+                   scanline_counter_,
+                   irq_enable_,
+                   irq_status_,
+                   timer_,
+                   timer_irq_,
+                   timer_running_,
+                   apu_divider_,
+                   cycle_,
+                   prg_ram_protect_,
+                   prg_bank_,
+                   chr_bank_,
+                   multiplier_);
+        ext_ram_pages_.Save(snap);
+        pulse_[0].SaveState(snap);
+        pulse_[1].SaveState(snap);
+    }
+
     inline uint8_t _prg_bank(size_t index) const {
         return (prg_bank_[index] & 0x7f) % prg_banks_;
     }
@@ -221,8 +292,13 @@ class Mapper5: public Mapper {
         *b = nes_->cartridge()->ReadChr(chraddr + 8);
     }
 
+    void VramWritten(uint8_t* p) override {
+        if (p >= ext_ram_ && p < ext_ram_ + sizeof(ext_ram_)) {
+            ext_ram_pages_.Touch(uint32_t(p - ext_ram_));
+        }
+    }
+
     virtual uint8_t* VramAddress(uint8_t* ppuram, uint16_t addr) override {
-        static uint8_t junk;
         uint16_t offset = addr & 0x3FF;
         uint16_t table = (addr >> 10) & 3;
         uint8_t which = (nt_map_ >> (table * 2)) & 3;
@@ -268,19 +344,19 @@ class Mapper5: public Mapper {
                 if (ext_ram_mode_ <= 1) {
                     return ext_ram_ + offset;
                 }
-                junk = 0;
+                junk_ = 0;
                 break;
             case 3:
                 if (offset < 0x3c0) {
-                    junk = fill_tile_;
+                    junk_ = fill_tile_;
                 } else {
-                    junk = fill_color_;
-                    junk |= junk << 2;
-                    junk |= junk << 4;
+                    junk_ = fill_color_;
+                    junk_ |= junk_ << 2;
+                    junk_ |= junk_ << 4;
                 }
                 break;
         }
-        return &junk;
+        return &junk_;
     }
 
     uint8_t Read(uint16_t addr) override {
@@ -305,6 +381,12 @@ class Mapper5: public Mapper {
         return 0;
     }
 
+    int PrgWindow(uint16_t addr) override {
+        if (addr < 0x8000)
+            return kSramWindow | prg_bank_[0];
+        return TranslatePrg(addr) / 0x2000;
+    }
+
     void Write(uint16_t addr, uint8_t val) override {
         if (addr < 0x2000) {
             return nes_->cartridge()->WriteChr(addr, val);
@@ -314,6 +396,7 @@ class Mapper5: public Mapper {
             fprintf(stderr, "Unhandled MMC5 write at %04x\n", addr);
         } else if (addr >= 0x5c00 && addr < 0x6000) {
             ext_ram_[addr - 0x5c00] = val;
+            ext_ram_pages_.Touch(addr - 0x5c00);
         } else if (addr >= 0x6000 && addr < 0x8000) {
             bool enabled = prg_ram_protect_[0] == 2 &&
                            prg_ram_protect_[1] == 1;
@@ -552,6 +635,7 @@ class Mapper5: public Mapper {
 
     // "Extended" ram.
     uint8_t ext_ram_[1024];
+    PagedRegion ext_ram_pages_;
 
     uint16_t timer_;
     uint8_t timer_irq_;
@@ -559,6 +643,8 @@ class Mapper5: public Mapper {
 
     uint32_t apu_divider_;
     uint32_t cycle_;
+    // What the PPU sees in the fill mode nametable.
+    uint8_t junk_;
 
     Pulse pulse_[2];
     APUDevices audio_debug_;
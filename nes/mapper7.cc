@@ -7,7 +7,7 @@ namespace protones {
 class Mapper7: public Mapper {
   public:
     Mapper7(NES* nes):
-        Mapper(nes),
+        Mapper(nes, ClockNone),
         prg_banks_(nes_->cartridge()->prglen() / 0x8000),
         prg_bank1_(0) {}
 
@@ -21,6 +21,14 @@ class Mapper7: public Mapper {
         SAVE(prg_banks, prg_bank1);
     }
 
+    void LoadState(Snapshot* snap) {
+        snap->Load(prg_banks_, prg_bank1_);
+    }
+
+    void SaveState(Snapshot* snap) {
+        snap->Save(prg_banks_, prg_bank1_);
+    }
+
     uint8_t Read(uint16_t addr) override {
         if (addr < 0x2000) {
             return nes_->cartridge()->ReadChr(addr);
@@ -36,6 +44,14 @@ class Mapper7: public Mapper {
         return 0;
     }
 
+    int PrgWindow(uint16_t addr) override {
+        if (addr < 0x8000)
+            return kSramWindow;
+        uint32_t mask = (1UL << prg_banks_) - 1;
+        uint32_t offset = (prg_bank1_ & mask) * 0x8000;
+        return (offset + addr - 0x8000) / 0x2000;
+    }
+
     void Write(uint16_t addr, uint8_t val) override {
         if (addr < 0x2000) {
             return nes_->cartridge()->WriteChr(addr, val);
@@ -1,5 +1,5 @@
+#include <cinttypes>
 #include <fstream>
-#include "imgui.h"
 
 #include "nes/mem.h"
 #include "nes/pbmacro.h"
@@ -18,7 +18,15 @@ namespace protones {
 Mem::Mem(NES* nes)
     : nes_(nes),
       ram_{0, },
-      ppuram_{0, } {
+      ppuram_{0, },
+      palette_{0, },
+      timer_start_(0),
+      lap_start_(0) {
+    ram_hash_.Attach(ram_, sizeof(ram_));
+    ppuram_hash_.Attach(ppuram_, sizeof(ppuram_));
+    palette_hash_.Attach(palette_, sizeof(palette_));
+    ram_pages_.Attach(ram_, sizeof(ram_));
+    ppuram_pages_.Attach(ppuram_, sizeof(ppuram_));
 }
 
 void Mem::LoadState(proto::NES* state) {
@@ -31,12 +39,22 @@ void Mem::LoadState(proto::NES* state) {
            ppuram.size() <= sizeof(ppuram_) ? ppuram.size() : sizeof(ppuram_));
     memcpy(palette_, palette.data(),
            palette.size() <= sizeof(palette_) ? palette.size() : sizeof(palette_));
+    ram_hash_.TouchAll();
+    ppuram_hash_.TouchAll();
+    palette_hash_.TouchAll();
+    ram_pages_.TouchAll();
+    ppuram_pages_.TouchAll();
 }
 
 void Mem::LoadEverdriveState(const uint8_t* state) {
     memcpy(ram_, state+0x6800, 0x800);
     memcpy(ppuram_, state+0x6000, 0x800);
     memcpy(palette_, state+0x7100, 16);
+    ram_hash_.TouchAll();
+    ppuram_hash_.TouchAll();
+    palette_hash_.TouchAll();
+    ram_pages_.TouchAll();
+    ppuram_pages_.TouchAll();
 }
 
 void Mem::SaveState(proto::NES* state) {
@@ -49,10 +67,30 @@ void Mem::SaveState(proto::NES* state) {
     palette->assign((char*)palette_, sizeof(palette_));
 }
 
+void Mem::LoadState(Snapshot* snap) {
+    ram_pages_.Load(snap, ram_);
+    ppuram_pages_.Load(snap, ppuram_);
+    snap->Load(palette_);
+    ram_hash_.TouchAll();
+    ppuram_hash_.TouchAll();
+    palette_hash_.TouchAll();
+}
+
+void Mem::SaveState(Snapshot* snap) {
+    ram_pages_.Save(snap);
+    ppuram_pages_.Save(snap);
+    snap->Save(palette_);
+}
+
 
 uint8_t Mem::read_byte(uint16_t addr) {
+    // The devices are clocked lazily (see NES::Emulate).  Reads of the
+    // cartridge's RAM and ROM can't see anything they do.
+    if (addr >= 0x2000 && addr < 0x6000) {
+        nes_->CatchUp();
+    }
     if (addr < 0x2000) {
-        return ram_[addr];
+        return ram_[addr & 0x7FF];
     } else if (addr < 0x4000 || addr == 0x4014) {
         return nes_->ppu()->Read(addr);
     } else if (addr == 0x4015) {
@@ -62,24 +100,22 @@ uint8_t Mem::read_byte(uint16_t addr) {
     } else if (addr == 0x4017) {
         return nes_->controller(1)->Read();
     } else if (addr == 0x4019) {
-        static uint64_t t0;
         uint64_t t1 = nes_->cpu()->cycles();
-        if (t0) {
-            unsigned diff = t1 - t0;
+        if (timer_start_) {
+            unsigned diff = t1 - timer_start_;
             printf("Elapsed: %d cpu cycles (%.6f s)\n", diff,
                    double(diff) / NES::frequency);
-            t0 = 0;
+            timer_start_ = 0;
         } else {
-            t0 = t1;
+            timer_start_ = t1;
         }
         return 0;
     } else if (addr == 0x401b) {
-        static uint64_t t0;
         uint64_t t1 = nes_->cpu()->cycles();
-        unsigned diff = t1 - t0;
+        unsigned diff = t1 - lap_start_;
         printf("Elapsed: %d cpu cycles (%.6f s)\n", diff,
                double(diff) / NES::frequency);
-        t0 = t1;
+        lap_start_ = t1;
         return 0;
 
     } else if (addr >= 0x5000) {
@@ -92,7 +128,7 @@ uint8_t Mem::read_byte(uint16_t addr) {
 
 uint8_t Mem::read_byte_no_io(uint16_t addr) {
     if (addr < 0x2000) {
-        return ram_[addr];
+        return ram_[addr & 0x7FF];
     } else if (addr < 0x4000) {
         return PPURead(addr);
     } else if (addr >= 0x5c00 && addr < 0x6000) {
@@ -108,8 +144,16 @@ uint8_t Mem::read_byte_no_io(uint16_t addr) {
 }
 
 void Mem::write_byte(uint16_t addr, uint8_t v) {
+    // No supported board has registers among its work RAM.
+    if (addr >= 0x2000 && (addr < 0x6000 || addr >= 0x8000)) {
+        nes_->CatchUp();
+    }
     if (addr < 0x2000) {
-        ram_[addr] = v;
+        ram_[addr & 0x7FF] = v;
+        ram_hash_.Touch(addr & 0x7FF);
+        ram_pages_.Touch(addr & 0x7FF);
+        // Only $0000-$07FF is cached, whichever mirror it's written through.
+        nes_->cpu()->InvalidateCode(addr & 0x7FF);
     } else if (addr < 0x4000 || addr == 0x4014) {
         return nes_->ppu()->Write(addr, v);
     } else if (addr == 0x4016) {
@@ -132,6 +176,15 @@ void Mem::write_byte(uint16_t addr, uint8_t v) {
         }
     } else if (addr >= 0x5000) {
         nes_->mapper()->Write(addr, v);
+        // Writes to ROM go to the mapper's registers and leave the code
+        // there alone.
+        if (!nes_->cpu()->rom_window(addr)) {
+            nes_->cpu()->InvalidateCode(addr);
+        }
+        if (addr < 0x6000 || addr >= 0x8000) {
+            // A mapper register: the PRG mapping may have changed.
+            nes_->UpdateCodeWindows();
+        }
     } else {
         fprintf(stderr, "Unknown write at %04x = %02x\n", addr, v);
     }
@@ -170,7 +223,15 @@ void Mem::PPUWrite(uint16_t addr, uint8_t val) {
     if (addr < 0x2000) {
         nes_->mapper()->Write(addr, val);
     } else if (addr < 0x3F00) {
-        *nes_->mapper()->VramAddress(ppuram_, addr) = val;
+        uint8_t* p = nes_->mapper()->VramAddress(ppuram_, addr);
+        *p = val;
+        // Some mappers have VRAM of their own, which is in their state.
+        if (p >= ppuram_ && p < ppuram_ + sizeof(ppuram_)) {
+            ppuram_hash_.Touch(uint32_t(p - ppuram_));
+            ppuram_pages_.Touch(uint32_t(p - ppuram_));
+        } else {
+            nes_->mapper()->VramWritten(p);
+        }
     } else {
         PaletteWrite(addr % 32, val);
     }
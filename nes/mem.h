@@ -5,6 +5,8 @@
 
 #include "nes/base.h"
 #include "nes/nes.h"
+#include "nes/snapshot.h"
+#include "nes/state_hash.h"
 #include "proto/nes.pb.h"
 namespace protones {
 
@@ -38,14 +40,22 @@ class Mem : public EmulatedDevice {
         if (addr >= 16 && (addr % 4) == 0)
             addr -= 16;
         palette_[addr] = val;
+        palette_hash_.Touch(addr);
     }
 
     void LoadState(proto::NES* state);
     void SaveState(proto::NES* state);
+    void LoadState(Snapshot* snap);
+    void SaveState(Snapshot* snap);
     void LoadEverdriveState(const uint8_t* state);
 
     uint8_t CpuExecBank();
 
+    // Hashes of the CPU's RAM, and of the PPU's RAM and palette, which
+    // only rehash what was written since the last time.
+    uint64_t HashRam() { return ram_hash_.Hash(); }
+    uint64_t HashVram() { return ppuram_hash_.Hash() ^ palette_hash_.Hash(); }
+
   private:
     uint16_t MirrorAddress(int mode, uint16_t addr);
 
@@ -54,8 +64,17 @@ class Mem : public EmulatedDevice {
     // NES has 2k of PPU vram, some carts provide extra vram.
     uint8_t ppuram_[4096];
     uint8_t palette_[32];
+    HashedRegion ram_hash_;
+    HashedRegion ppuram_hash_;
+    HashedRegion palette_hash_;
+    PagedRegion ram_pages_;
+    PagedRegion ppuram_pages_;
 
     uint64_t counters_[128];
+    // The cycles when the program last started the debug timer ($4019)
+    // and read the lap timer ($401b).
+    uint64_t timer_start_;
+    uint64_t lap_start_;
 
     std::vector<std::string> custom_memdump_;
     friend class MemDebug;
@@ -1,10 +1,16 @@
 #include <unistd.h>
-#include "imgui.h"
+#include <algorithm>
+#include <cinttypes>
+#include <chrono>
+#include <climits>
+#include <cmath>
 #include "google/protobuf/text_format.h"
 
 #include "nes/nes.h"
 
+#include "absl/flags/declare.h"
 #include "absl/flags/flag.h"
+#include "absl/strings/str_cat.h"
 #include "nes/cpu6502.h"
 #include "nes/apu.h"
 #include "nes/cartridge.h"
@@ -14,17 +20,40 @@
 #include "nes/mem.h"
 #include "midi/midi.h"
 #include "nes/ppu.h"
-#include "proto/config.pb.h"
-#include "util/config.h"
+#include "util/file.h"
 
 ABSL_FLAG(std::string, fm2, "", "FM2 Movie file.");
 ABSL_FLAG(std::string, midi, "", "Midi configuration textpb.");
 ABSL_FLAG(std::string, midi_input, "", "Midi input port.");
 ABSL_FLAG(double, fps, 60.0988, "Desired NES fps.");
+ABSL_FLAG(bool, idle_skip, true,
+          "Skip through CPU idle loops to the next event which could end "
+          "them");
+ABSL_FLAG(double, fast_forward_speed, 4.0,
+          "How many times as fast to fast forward (at least 1), or 0 for "
+          "as fast as possible");
+ABSL_FLAG(int32_t, run_ahead, 0,
+          "Frames to emulate ahead of the one shown, to hide the game's "
+          "input lag");
+ABSL_FLAG(std::string, state_hash, "",
+          "Hash the state after every frame, and \"record\" the hashes to "
+          "--state_hash_log or \"verify\" them against it");
+ABSL_FLAG(std::string, state_hash_log, "",
+          "The state hash log (default: the --fm2 movie, or the ROM, plus "
+          "\".hash\")");
+ABSL_FLAG(int64_t, state_hash_dump, 0,
+          "Dump the state after this frame as a text proto");
+ABSL_DECLARE_FLAG(int, fm2_predelay);
+ABSL_DECLARE_FLAG(bool, jit);
+ABSL_DECLARE_FLAG(bool, sram_on_disk);
+ABSL_DECLARE_FLAG(int32_t, sram_flush_frames);
+ABSL_DECLARE_FLAG(std::string, cdl);
+ABSL_DECLARE_FLAG(double, volume);
+ABSL_DECLARE_FLAG(bool, lock_framerate_to_audio);
+
 namespace protones {
 
 using namespace std::placeholders;
-using proto::ControllerButtons;
 
 const uint32_t standard_palette[] = {
     0xFF666666, 0xFF002A88, 0xFF1412A7, 0xFF3B00A4,
@@ -45,15 +74,55 @@ const uint32_t standard_palette[] = {
     0xFFB5EBF2, 0xFFB8B8B8, 0xFF000000, 0xFF000000,
 };
 
-NES::NES() :
+namespace {
+// The APU can only average samples down, not stretch them out, so there's
+// no speed between 0 (uncapped) and 1.
+double FastForwardSpeed(double speed) {
+    return speed > 0 ? std::max(speed, 1.0) : 0.0;
+}
+}  // namespace
+
+NESOptions::NESOptions()
+  : fm2(absl::GetFlag(FLAGS_fm2)),
+    fm2_predelay(absl::GetFlag(FLAGS_fm2_predelay)),
+    midi(absl::GetFlag(FLAGS_midi)),
+    fps(absl::GetFlag(FLAGS_fps)),
+    idle_skip(absl::GetFlag(FLAGS_idle_skip)),
+    jit(absl::GetFlag(FLAGS_jit)),
+    sram_on_disk(absl::GetFlag(FLAGS_sram_on_disk)),
+    sram_flush_frames(absl::GetFlag(FLAGS_sram_flush_frames)),
+    cdl(absl::GetFlag(FLAGS_cdl)),
+    volume(absl::GetFlag(FLAGS_volume)),
+    lock_framerate_to_audio(absl::GetFlag(FLAGS_lock_framerate_to_audio)),
+    run_ahead(absl::GetFlag(FLAGS_run_ahead)),
+    fast_forward_speed(absl::GetFlag(FLAGS_fast_forward_speed)),
+    state_hash(absl::GetFlag(FLAGS_state_hash)),
+    state_hash_log(absl::GetFlag(FLAGS_state_hash_log)),
+    state_hash_dump(absl::GetFlag(FLAGS_state_hash_dump)) {
+}
+
+NES::NES(const NESOptions& options) :
+    input_(0),
+    options_(options),
+    run_ahead_(options.run_ahead),
+    fast_forward_(false),
+    fast_forward_speed_(FastForwardSpeed(options.fast_forward_speed)),
+    frame_seconds_(1.0 / options.fps),
     pause_(false),
     step_(false),
     debug_(false),
     reset_(false),
     lag_(false),
     has_movie_(false),
+    profile_(false),
+    idle_skip_(options.idle_skip),
     frame_(0),
-    remainder_(0)
+    remainder_(0),
+    idle_cycles_(0),
+    idle_status_changes_(0),
+    npending_(0),
+    behind_(0),
+    next_event_(0)
 {
     mem_ = new Mem(this);
     devices_.emplace_back(mem_);
@@ -63,6 +132,7 @@ NES::NES() :
 
     cpu_ = new Cpu();
     cpu_->memory(mem_);
+    cpu_->set_jit(options_.jit);
     devices_.emplace_back(cpu_);
 
     movie_ = new FM2Movie(this);
@@ -76,8 +146,8 @@ NES::NES() :
 
     midi_ = new MidiConnector(this);
     devices_.emplace_back(midi_);
-    if (!absl::GetFlag(FLAGS_midi).empty()) {
-        midi_->LoadConfig(absl::GetFlag(FLAGS_midi));
+    if (!options_.midi.empty()) {
+        midi_->LoadConfig(options_.midi);
     }
 
     controller_[0] = new Controller(this, 0);
@@ -96,24 +166,126 @@ NES::NES() :
                       ((standard_palette[i] >> 16 ) & 0xFF) |
                       ((standard_palette[i] & 0xFF) << 16);
     }
-    const auto& config = ConfigLoader<proto::Configuration>::GetConfig();
-    for(const auto& b : config.controls().buttons()) {
-        buttons_[b.scancode()] = b.button();
-    }
-
 }
 
 void NES::Shutdown() {
-    cpu_->SaveRwLog();
+    cart_->Shutdown();
 }
 
 void NES::LoadFile(const std::string& filename) {
-    if (!absl::GetFlag(FLAGS_fm2).empty()) {
-        movie_->Load(absl::GetFlag(FLAGS_fm2));
+    if (!options_.fm2.empty()) {
+        movie_->Load(options_.fm2);
         has_movie_ = true;
     }
     cart_->LoadFile(filename);
+    cpu_->set_cdl(cart_->cdl());
     mapper_ = MapperRegistry::New(this, cart_->mapper());
+    devices_.emplace_back(mapper_);
+    UpdateCodeWindows();
+
+    if (!options_.state_hash.empty()) {
+        auto& log = options_.state_hash_log;
+        if (log.empty()) {
+            log = (options_.fm2.empty() ? filename : options_.fm2) + ".hash";
+        }
+        state_hash_log_.reset(new StateHashLog);
+        bool ok;
+        if (options_.state_hash == "record") {
+            ok = state_hash_log_->Create(log, cart_->crc32());
+        } else if (options_.state_hash == "verify") {
+            ok = state_hash_log_->Open(log, cart_->crc32());
+        } else {
+            fprintf(stderr, "Unknown --state_hash mode: %s\n",
+                    options_.state_hash.c_str());
+            ok = false;
+        }
+        if (!ok) state_hash_log_.reset();
+    }
+}
+
+void NES::UpdateCodeWindows() {
+    // Internal RAM is cacheable; its mirrors and the I/O and expansion
+    // areas are not.
+    cpu_->SetCodeWindow(0x0000, 0x07FF, 0);
+    cpu_->SetCodeWindow(0x0800, 0x5FFF, -1);
+    for(uint32_t addr=0x6000; addr<0x10000; addr+=0x2000) {
+        int id = mapper_->PrgWindow(addr);
+        bool rom = addr >= 0x8000 && !(id & Mapper::kSramWindow);
+        cpu_->SetCodeWindow(addr, addr + 0x1FFF, id, rom);
+    }
+}
+
+StateHash NES::HashState() {
+    Sync();
+    auto fold = [](uint64_t h) { return uint32_t(h ^ (h >> 32)); };
+    // The registers are few enough to hash all of them every time.
+    auto hash = [this](const google::protobuf::Message& msg) {
+        msg.SerializeToString(&hash_data_);
+        return Fnv1a(kFnvBasis, hash_data_.data(), hash_data_.size());
+    };
+    StateHash h;
+    cpu_->SaveState(hash_state_.mutable_cpu());
+    h.part[StateHash::CPU] = fold(hash(hash_state_.cpu()));
+    h.part[StateHash::RAM] = fold(mem_->HashRam());
+    ppu_->SaveState(hash_state_.mutable_ppu(), false);
+    h.part[StateHash::PPU] = fold(hash(hash_state_.ppu()) ^ mem_->HashVram());
+    apu_->SaveState(hash_state_.mutable_apu());
+    h.part[StateHash::APU] = fold(hash(hash_state_.apu()));
+    mapper_->SaveState(hash_state_.mutable_mapper());
+    h.part[StateHash::MAPPER] = fold(hash(hash_state_.mapper()));
+    h.part[StateHash::CARTRIDGE] = fold(cart_->Hash());
+    return h;
+}
+
+bool NES::CheckStateHash() {
+    if (options_.state_hash_dump > 0 &&
+        frame_ == uint64_t(options_.state_hash_dump)) {
+        SaveState(&hash_state_, false);
+        DumpState(hash_state_, frame_);
+    }
+    if (!state_hash_log_)
+        return true;
+    StateHash hash = HashState();
+    if (options_.state_hash == "record") {
+        state_hash_log_->Append(hash);
+        return true;
+    }
+    StateHash want;
+    if (!state_hash_log_->Get(frame_, &want))
+        return true;
+    if (hash == want) {
+        // A snapshot costs little enough to take every frame; it's only
+        // made a proto if there's something to dump.
+        SaveState(&verified_state_, false);
+        return true;
+    }
+    fprintf(stderr, "State hash differs after frame %" PRIu64 ": %s\n",
+            frame_, hash.Diff(want).c_str());
+    if (frame_ > 1 && ConvertState(&verified_state_, &hash_state_)) {
+        DumpState(hash_state_, frame_ - 1);
+    }
+    SaveState(&hash_state_, false);
+    DumpState(hash_state_, frame_);
+    pause_ = true;
+    state_hash_log_.reset();
+    return false;
+}
+
+void NES::DumpState(const proto::NES& state, uint64_t frame) {
+    const auto& log = options_.state_hash_log;
+    std::string filename = absl::StrCat(
+            log.empty() ? cart_->filename() : log, ".", frame, ".textpb");
+    std::string data;
+    google::protobuf::TextFormat::PrintToString(state, &data);
+    FILE* fp = fopen(filename.c_str(), "w");
+    if (fp == nullptr) {
+        fprintf(stderr, "Could not write %s\n", filename.c_str());
+        return;
+    }
+    fwrite(data.data(), 1, data.size(), fp);
+    fclose(fp);
+    fprintf(stderr, "Dumped the state after frame %" PRIu64 " to %s\n",
+            frame, filename.c_str());
 }
 
 bool NES::LoadStateFromFile(const std::string& filename) {
@@ -134,24 +306,42 @@ bool NES::LoadStateFromFile(const std::string& filename) {
 }
 
 bool NES::LoadState(const std::string& data) {
-    state_.Clear();
-    if (!state_.ParseFromString(data)) {
-        if (!google::protobuf::TextFormat::ParseFromString(data, &state_)) {
+    const std::string* bytes = &data;
+    if (IsCompressedState(data)) {
+        if (!UncompressState(data, &state_data_))
+            return false;
+        bytes = &state_data_;
+    }
+    proto::NES* state = state_arena_.New();
+    if (!state->ParseFromString(*bytes)) {
+        if (!google::protobuf::TextFormat::ParseFromString(*bytes, state)) {
             //console_.AddLog("[error] Could not parse data from %s",
             //                filename.c_str());
             return false;
         }
     }
-
-    apu_->LoadState(state_.mutable_apu());
-    cpu_->LoadState(state_.mutable_cpu());
-    mem_->LoadState(&state_);
-    ppu_->LoadState(state_.mutable_ppu());
-    mapper_->LoadState(state_.mutable_mapper());
-    cart_->LoadState(state_.mutable_mapper());
+    LoadState(state);
     return true;
 }
 
+void NES::LoadState(proto::NES* state) {
+    // Whatever the devices were owed belongs to the old state.
+    npending_ = 0;
+    behind_ = 0;
+    next_event_ = 0;
+    apu_->LoadState(state->mutable_apu());
+    cpu_->LoadState(state->mutable_cpu());
+    mem_->LoadState(state);
+    ppu_->LoadState(state->mutable_ppu());
+    mapper_->LoadState(state->mutable_mapper());
+    cart_->LoadState(state->mutable_mapper());
+    for(int i=0; i<state->controller_size() && i<controller_size(); i++) {
+        controller_[i]->LoadState(state->mutable_controller(i));
+    }
+    UpdateCodeWindows();
+    cpu_->FlushRamCode();
+}
+
 bool NES::LoadEverdriveStateFromFile(const std::string& filename) {
     FILE* fp;
     uint8_t data[32*1024];
@@ -175,78 +365,120 @@ bool NES::LoadEverdriveStateFromFile(const std::string& filename) {
     mem_->LoadEverdriveState(data);
     cpu_->LoadEverdriveState(data);
     mapper_->LoadEverdriveState(data);
+    cpu_->FlushCode();
+    UpdateCodeWindows();
     return true;
 }
 
 std::string NES::SaveState(bool text) {
-    apu_->SaveState(state_.mutable_apu());
-    cpu_->SaveState(state_.mutable_cpu());
-    mem_->SaveState(&state_);
-    ppu_->SaveState(state_.mutable_ppu());
-    mapper_->SaveState(state_.mutable_mapper());
-    cart_->SaveState(state_.mutable_mapper());
+    SaveStateOptions options;
+    options.text = text;
+    return SaveState(options);
+}
+
+std::string NES::SaveState(const SaveStateOptions& options) {
+    proto::NES* state = state_arena_.New();
+    SaveState(state, options.picture);
 
     std::string data;
-    if (text) {
-        google::protobuf::TextFormat::PrintToString(state_, &data);
+    if (options.text) {
+        google::protobuf::TextFormat::PrintToString(*state, &data);
     } else {
-        state_.SerializeToString(&data);
+        state->SerializeToString(&data);
+    }
+    if (options.compress) {
+        state_data_.swap(data);
+        CompressState(state_data_, &data);
     }
     return data;
 }
 
-bool NES::SaveStateToFile(const std::string& filename, bool text) {
-    std::string data = SaveState(text);
-    FILE* fp;
-    if ((fp = fopen(filename.c_str(), "wb")) != nullptr) {
-        fwrite(data.data(), 1, data.size(), fp);
-        fclose(fp);
-    } else {
-        //console_.AddLog("[error] Could not SaveState to %s", filename.c_str());
+void NES::SaveState(proto::NES* state, bool picture) {
+    Sync();
+    apu_->SaveState(state->mutable_apu());
+    cpu_->SaveState(state->mutable_cpu());
+    mem_->SaveState(state);
+    ppu_->SaveState(state->mutable_ppu(), picture);
+    mapper_->SaveState(state->mutable_mapper());
+    cart_->SaveState(state->mutable_mapper());
+    state->clear_controller();
+    for(int i=0; i<controller_size(); i++) {
+        controller_[i]->SaveState(state->add_controller());
+    }
+}
+
+bool NES::LoadState(Snapshot* snap) {
+    if (!snap->Open(cart_->crc32()))
         return false;
+    npending_ = 0;
+    behind_ = 0;
+    next_event_ = 0;
+    apu_->LoadState(snap);
+    cpu_->LoadState(snap);
+    mem_->LoadState(snap);
+    ppu_->LoadState(snap);
+    mapper_->LoadState(snap);
+    cart_->LoadState(snap);
+    for(int i=0; i<controller_size(); i++) {
+        controller_[i]->LoadState(snap);
     }
+    snap->Load(remainder_);
+    UpdateCodeWindows();
+    cpu_->FlushRamCode();
     return true;
 }
 
+void NES::SaveState(Snapshot* snap, bool picture) {
+    Sync();
+    snap->Begin(cart_->crc32(), picture);
+    apu_->SaveState(snap);
+    cpu_->SaveState(snap);
+    mem_->SaveState(snap);
+    ppu_->SaveState(snap);
+    mapper_->SaveState(snap);
+    cart_->SaveState(snap);
+    for(int i=0; i<controller_size(); i++) {
+        controller_[i]->SaveState(snap);
+    }
+    // Where the frame ended, so frames played again from the snapshot
+    // end where they did.
+    snap->Save(remainder_);
+    snap->End();
+}
 
-void NES::HandleKeyboard(SDL_Event *event) {
-    switch(event->type) {
-    case SDL_KEYDOWN: {
-        ControllerButtons b = buttons_[event->key.keysym.scancode];
-        switch (b) {
-        case ControllerButtons::ControllerPause:
-            pause_ = !pause_;
-            break;
-        case ControllerButtons::ControllerFrameStep:
-            pause_ = true;
-            step_ = true;
-            break;
-        case ControllerButtons::ControllerReset:
-            Reset();
-            break;
-        case ControllerButtons::Controller2UpA:
-            controller_[1]->set_buttons(Controller::BUTTON_UP |
-                                        Controller::BUTTON_A);
-            break;
-        default:
-            controller_[0]->set_buttons(event);
-        }
-        }
-        break;
-    case SDL_KEYUP: {
-        ControllerButtons b = buttons_[event->key.keysym.scancode];
-        switch (b) {
-        case ControllerButtons::Controller2UpA:
-            controller_[1]->set_buttons(0);
-            break;
-        default:
-            controller_[0]->set_buttons(event);
-        }
-        }
-        break;
-    default:
-        ;
+bool NES::ConvertState(Snapshot* from, proto::NES* to) {
+    SaveState(&convert_state_);
+    const double remainder = remainder_;
+    if (!LoadState(from))
+        return false;
+    SaveState(to, from->picture());
+    LoadState(&convert_state_);
+    remainder_ = remainder;
+    return true;
+}
+
+void NES::ConvertState(proto::NES* from, Snapshot* to) {
+    SaveState(&convert_state_);
+    LoadState(from);
+    SaveState(to, from->ppu().picture().size() > 0);
+    LoadState(&convert_state_);
+}
+
+bool NES::SaveStateToFile(const std::string& filename, bool text) {
+    SaveStateOptions options;
+    options.text = text;
+    return SaveStateToFile(filename, options);
+}
+
+bool NES::SaveStateToFile(const std::string& filename,
+                          const SaveStateOptions& options) {
+    absl::Status status = File::Replace(filename, SaveState(options));
+    if (!status.ok()) {
+        fprintf(stderr, "Could not save the state to %s: %s\n",
+                filename.c_str(), std::string(status.message()).c_str());
+        return false;
     }
+    return true;
 }
 
 uint64_t NES::cpu_cycles() {
@@ -254,50 +486,298 @@ uint64_t NES::cpu_cycles() {
 }
 
 void NES::Reset() {
+    Sync();
+    cpu_->FlushCode();
+    UpdateCodeWindows();
     cpu_->reset();
     ppu_->Reset();
 }
 
-bool NES::Emulate() {
-    // TODO(cfrantz): RegisterValue(4) is the PRG bank mapping for MMC1.
-    // This needs be abstracted into a more general solution.
-    int addr = cpu_->pc() | (mapper_->RegisterValue(Mapper::PseudoRegister::CpuExecBank) << 16);
-    const int n = cpu_->Execute();
-    frame_profile_[addr] += n;
-    for(int i=0; i<n*3; i++) {
-        //if (cpu_->irq_pending()) { ppu_->set_debug_dot(0xFF00FF00); }
-        // The PPU is clocked at 3 dots per CPU clock
-        ppu_->Emulate();
-        mapper_->Emulate();
-        cart_->Emulate();
+bool NES::instrumented() {
+    return profile_ || cpu_->instrumented();
+}
+
+bool NES::Emulate(uint64_t until) {
+    return instrumented() ? Emulate<InstrumentedPolicy>(until)
+                          : Emulate<FastPolicy>(until);
+}
+
+// The earliest cycle at which the other devices, caught up to cycle `now`,
+// could interrupt or stall the CPU.  The CPU may only run translated code
+// or skip idle loops up to there, since the devices catch up only after
+// it returns.
+uint64_t NES::Horizon(uint64_t until, uint64_t now) {
+    // IRQs from the APU and the mapper aren't predicted.
+    if (!cpu_->idf())
+        return 0;
+    return std::min(until, NextEvent(now));
+}
+
+// The same, while the CPU ignores IRQs.
+uint64_t NES::NextEvent(uint64_t now) {
+    // DMC sample fetches steal CPU cycles.
+    if (apu_->dmc_active())
+        return 0;
+    int dots = ppu_->DotsUntilNmi();
+    if (dots == INT_MAX)
+        return UINT64_MAX;
+    return now + dots / 3;
+}
+
+void NES::Clock(int n) {
+    // The PPU is clocked at 3 dots per CPU clock
+    ppu_->Run(n * 3);
+    if (mapper_->clock() == Mapper::ClockCpu) {
+        mapper_->CpuCycles(n);
     }
+    apu_->Run(n);
+}
+
+void NES::Replay() {
+    const int n = npending_;
+    npending_ = 0;
+    behind_ = 0;
     for(int i=0; i<n; i++) {
-        apu_->Emulate();
+        Clock(pending_[i]);
+    }
+}
+
+void NES::Sync() {
+    if (npending_) Replay();
+    next_event_ = NextEvent(cpu_->cycles());
+}
+
+// The CPU has just gone around a loop which may be idle, and the other
+// devices are `n` cycles behind it.  Skip as much of the loop as the
+// devices couldn't have noticed.
+int NES::SkipIdle(uint64_t until, int n) {
+    uint64_t now = cpu_->cycles() - n;
+    uint64_t deadline;
+    if (cpu_->idle_reads_status()) {
+        // The loop only reads the same PPUSTATUS every time if nothing
+        // changed it during the last iteration.
+        uint32_t changes = ppu_->status_changes();
+        bool same = changes == idle_status_changes_;
+        idle_status_changes_ = changes;
+        if (!same || !cpu_->idle())
+            return 0;
+        deadline = std::min(Horizon(until, now),
+                            now + ppu_->DotsUntilStatusChange() / 3);
+    } else {
+        if (!cpu_->idle())
+            return 0;
+        deadline = Horizon(until, now);
+    }
+    return cpu_->SkipIdle(deadline);
+}
+
+template<typename Policy>
+bool NES::Emulate(uint64_t until) {
+    int bank = 0;
+    const uint16_t pc = cpu_->pc();
+    if constexpr (Policy::kInstrumented) {
+        // TODO(cfrantz): RegisterValue(4) is the PRG bank mapping for MMC1.
+        // This needs be abstracted into a more general solution.
+        bank = mapper_->RegisterValue(Mapper::PseudoRegister::CpuExecBank);
+    }
+    int n = cpu_->stall();
+    int idle = 0;
+    if (n) {
+        // The CPU is stalled for DMA.  Pass the whole stall at once (but
+        // not `until`), and clock the other devices a cycle at a time as if
+        // the CPU had passed the stall one cycle per call.
+        if (until > cpu_->cycles()) {
+            n = std::min<uint64_t>(n, until - cpu_->cycles());
+        }
+        cpu_->Stalled(n);
+        idle = cpu_->idle_loop(pc) ? n : 0;
+        if (npending_) Replay();
+        for(int i=0; i<n; i++) {
+            Clock(1);
+        }
+        next_event_ = 0;
+    } else {
+        if constexpr (!Policy::kInstrumented) {
+            if (cpu_->jit()) {
+                cpu_->set_jit_deadline(
+                    Horizon(until, cpu_->cycles() - behind_));
+            }
+        }
+        n = cpu_->Execute<Policy>();
+        idle = cpu_->idle_loop(pc) ? n : 0;
+        if constexpr (!Policy::kInstrumented) {
+            if (idle_skip_ && cpu_->looped()) {
+                if (npending_) Replay();
+                int skipped = SkipIdle(until, n);
+                n += skipped;
+                idle += skipped;
+            }
+        }
+        pending_[npending_++] = n;
+        behind_ += n;
+        if (Policy::kInstrumented || !cpu_->idf() ||
+            cpu_->cycles() >= std::min(until, next_event_) ||
+            npending_ == kMaxPending) {
+            Sync();
+        }
+    }
+    if constexpr (Policy::kInstrumented) {
+        if (profile_) {
+            if (idle) {
+                frame_profile_.AddIdle(n);
+            } else {
+                frame_profile_.Add(bank, pc, n);
+            }
+        }
     }
+    idle_cycles_ += idle;
     return true;
 }
 
 bool NES::EmulateFrame() {
     midi_->Emulate();
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - last_frame_).count();
+    if (!pause_ && seconds < 1) {
+        // Average the times rather than the speeds: frames waiting for the
+        // audio device come in bursts.
+        frame_seconds_ = 0.95 * frame_seconds_ + 0.05 * seconds;
+    }
+    last_frame_ = now;
     if (pause_) {
         if (!step_) return true;
         step_ = false;
     }
-    double count = double(frequency) / absl::GetFlag(FLAGS_fps) - remainder_;
-    double eof = cpu_->cycles() + count;
-    frame_profile_.clear();
+    if (fast_forward_ && fast_forward_speed_ <= 0) {
+        UpdateSpeed();
+    }
+    if (run_ahead_ > 0)
+        return RunAhead();
+    return RunFrame(false);
+}
+
+void NES::PostInput(uint32_t buttons) {
+    input_.store(kInputPosted | buttons, std::memory_order_release);
+}
+
+void NES::set_fast_forward(bool ff) {
+    fast_forward_ = ff;
+    UpdateSpeed();
+}
+
+void NES::set_fast_forward_speed(double speed) {
+    fast_forward_speed_ = FastForwardSpeed(speed);
+    UpdateSpeed();
+}
+
+void NES::UpdateSpeed() {
+    if (!fast_forward_) {
+        apu_->set_decimation(1.0);
+        apu_->set_lock_to_audio(options_.lock_framerate_to_audio);
+    } else if (fast_forward_speed_ > 0) {
+        apu_->set_decimation(fast_forward_speed_);
+        apu_->set_lock_to_audio(options_.lock_framerate_to_audio);
+    } else {
+        // Nothing to wait for: keep up with however fast it goes.
+        apu_->set_decimation(speedup());
+        apu_->set_lock_to_audio(false);
+    }
+}
 
-    movie_->Emulate();
+bool NES::RunFrame(bool ahead) {
+    double count = double(frequency) / options_.fps - remainder_;
+    double eof = cpu_->cycles() + count;
+    uint64_t until = uint64_t(std::ceil(eof));
+    idle_cycles_ = 0;
+
+    if (!ahead) {
+        uint64_t input = input_.exchange(0, std::memory_order_acquire);
+        if (input & kInputPosted) {
+            for(int i=0; i<controller_size(); i++) {
+                controller_[i]->set_buttons(int(input >> (8 * i)) & 0xFF);
+            }
+        }
+        movie_->Emulate();
+    }
+    // The frames ahead are thrown away, so they stay out of the profile,
+    // and without it they take the fast path.
+    const bool profile = profile_;
+    if (ahead) profile_ = false;
     // Assume there will be lag during this frame.  If the game reads the
     // controllers on time, the controller emulation will clear the lag flag.
     lag_ = true;
-    while(double(cpu_->cycles()) < eof) {
-        if (!Emulate())
-            return false;
+    bool ok = true;
+    while(ok && double(cpu_->cycles()) < eof) {
+        ok = Emulate(until);
     }
+    profile_ = profile;
+    if (!ok)
+        return false;
+    Sync();
     frame_++;
+    if (!ahead) {
+        cart_->Emulate();
+        ok = CheckStateHash();
+        frame_profile_.Swap();
+    }
     remainder_ = double(cpu_->cycles()) - eof;
-    return true;
+    return ok;
+}
+
+bool NES::RunAhead() {
+    using Clock = std::chrono::steady_clock;
+    auto seconds = [](Clock::time_point a, Clock::time_point b) {
+        return std::chrono::duration<double>(b - a).count();
+    };
+    // Only the picture of the last frame ahead is shown.  The PPU's frames
+    // don't line up exactly with ours, so that may keep a dot from the
+    // frame before it, which is drawn too.
+    auto t0 = Clock::now();
+    ppu_->set_draw(run_ahead_ == 1);
+    bool ok = RunFrame(false);
+    auto t1 = Clock::now();
+
+    // The state is kept in memory, and the picture isn't part of it: the
+    // last frame ahead leaves the one to show.
+    SaveState(&run_ahead_state_, false);
+    const uint64_t frame = frame_;
+    const bool lag = lag_;
+    const int idle_cycles = idle_cycles_;
+    auto t2 = Clock::now();
+
+    apu_->set_mute(true);
+    for(int i=0; ok && i<run_ahead_; i++) {
+        ppu_->set_draw(i >= run_ahead_ - 2);
+        ok = RunFrame(true);
+    }
+    apu_->set_mute(false);
+    ppu_->set_draw(true);
+    auto t3 = Clock::now();
+
+    LoadState(&run_ahead_state_);
+    frame_ = frame;
+    lag_ = lag;
+    idle_cycles_ = idle_cycles;
+    auto t4 = Clock::now();
+
+    run_ahead_timing_.frames = run_ahead_;
+    run_ahead_timing_.frame = seconds(t0, t1);
+    run_ahead_timing_.save = seconds(t1, t2);
+    run_ahead_timing_.ahead = seconds(t2, t3);
+    run_ahead_timing_.load = seconds(t3, t4);
+    return ok;
+}
+
+bool NES::ReplayFrame(uint32_t buttons) {
+    const uint64_t frame = frame_;
+    for(int i=0; i<controller_size(); i++) {
+        controller_[i]->set_buttons(int(buttons >> (8 * i)) & 0xFF);
+    }
+    apu_->set_mute(true);
+    bool ok = RunFrame(true);
+    apu_->set_mute(false);
+    frame_ = frame;
+    return ok;
 }
 
 void NES::IRQ() {
@@ -1,11 +1,17 @@
 #ifndef PROTONES_NES_NES_H
 #define PROTONES_NES_NES_H
+#include <atomic>
+#include <chrono>
 #include <string>
 #include <memory>
+#include <mutex>
 #include <vector>
-#include <SDL2/SDL.h>
 
 #include "nes/base.h"
+#include "nes/profile.h"
+#include "nes/save_state.h"
+#include "nes/snapshot.h"
+#include "nes/state_hash.h"
 #include "proto/nes.pb.h"
 #include "proto/controller.pb.h"
 
@@ -22,9 +28,62 @@ class Mem;
 class PPU;
 class MidiConnector;
 
+// How to set up an NES.  The defaults come from the command line flags,
+// which is all a frontend with one NES needs; a process running many
+// sets them for each instance instead.
+struct NESOptions {
+    NESOptions();
+
+    // Play this FM2 movie, after `fm2_predelay` frames of no input.
+    std::string fm2;
+    int fm2_predelay;
+    // Midi configuration textpb.
+    std::string midi;
+    double fps;
+    bool idle_skip;
+    bool jit;
+    // Keep battery backed SRAM in a file, writing the pages which
+    // changed every `sram_flush_frames` frames.
+    bool sram_on_disk;
+    int sram_flush_frames;
+    // Log how each byte of PRG and CHR ROM is used to this file.
+    std::string cdl;
+    float volume;
+    // Wait for the audio device to play the samples.
+    bool lock_framerate_to_audio;
+    // Frames to run ahead (see NES::set_run_ahead).
+    int run_ahead;
+    // How fast to fast forward (see NES::set_fast_forward).
+    double fast_forward_speed;
+    // Hash the state after every frame, and "record" the hashes in
+    // `state_hash_log` (by default the movie's name plus ".hash"), or
+    // "verify" them against it, stopping at the first which differs.
+    std::string state_hash;
+    std::string state_hash_log;
+    // Dump the state after this frame, e.g. to diff it against what
+    // another build dumps.
+    int64_t state_hash_dump;
+};
+
+// Where the time went during the last frame with run-ahead, in seconds.
+struct RunAheadTiming {
+    int frames = 0;
+    // The frame which was played.
+    double frame = 0;
+    // Saving the state after it, emulating the frames ahead of it and
+    // loading the state again.
+    double save = 0;
+    double ahead = 0;
+    double load = 0;
+    // What each frame of run-ahead cost.
+    double per_frame() const {
+        return frames ? (save + ahead + load) / frames : 0;
+    }
+};
+
 class NES {
   public:
-    NES();
+    explicit NES(const NESOptions& options = NESOptions());
     void LoadFile(const std::string& filename);
     void IRQ();
     void NMI();
@@ -42,34 +101,153 @@ class NES {
     inline Cartridge* cartridge() { return cart_; }
     inline Controller* controller(int n) { return controller_[n]; }
     inline MidiConnector* midi() { return midi_; }
+    // A frontend which emulates on one thread and looks at the NES from
+    // others holds this while it touches the NES.  EmulateFrame doesn't
+    // take it by itself.
+    inline std::recursive_mutex& mutex() { return mutex_; }
+    // Set the buttons of all the controllers, a byte each starting with
+    // controller 0, from any thread.  The controllers take them together
+    // at the start of the next frame, so no frame sees half an update.
+    // Until then they keep what was set on them directly.
+    void PostInput(uint32_t buttons);
     inline uint32_t palette(uint8_t c) { return palette_[c % 64]; }
+    inline const NESOptions& options() const { return options_; }
     inline uint64_t frame() { return frame_; }
     inline bool lag() { return lag_; }
     inline void set_lag(bool val) { lag_ = val; }
     inline bool has_movie() { return has_movie_; }
     inline bool pause() { return pause_; }
     inline void set_pause(bool p) { pause_ = p; }
-    inline const std::map<int, int>& frame_profile() { return frame_profile_; }
+    // Pause, but emulate one more frame.
+    inline void FrameStep() { pause_ = true; step_ = true; }
+    // Reading the execution profile turns profiling on.  The profile is
+    // only collected on the instrumented path, so it fills in starting
+    // with the next frame.  Cycles spent in idle loops are counted apart
+    // from their address.
+    inline const ExecutionProfile& frame_profile() {
+        profile_ = true;
+        return frame_profile_;
+    }
+    inline bool profile() { return profile_; }
+    inline void set_profile(bool p) { profile_ = p; }
+    // CPU cycles spent in idle loops during the last frame, whether they
+    // were skipped or, on the instrumented path, executed.
+    inline int idle_cycles() const { return idle_cycles_; }
+    inline bool idle_skip() const { return idle_skip_; }
+    inline void set_idle_skip(bool s) { idle_skip_ = s; }
+    bool instrumented();
+    // Tell the CPU's decoded instruction cache what is mapped where.
+    // Called whenever the mapper's registers may have changed.
+    void UpdateCodeWindows();
 
     uint64_t cpu_cycles();
     void Stall(int s);
 
     void Reset();
-    bool Emulate();
+    // Emulate one CPU instruction and clock the other devices to match.
+    // With the JIT enabled a translated block may run several
+    // instructions, and an idle loop may be skipped through, but never
+    // reaching `until` cycles.
+    //
+    // On the fast path the other devices are clocked lazily: the cycles
+    // each instruction took are queued, and only played back when the CPU
+    // is about to touch a device (see CatchUp), when an interrupt could
+    // arrive (the next NMI, or any IRQ while they're enabled), and at the
+    // end of the frame.  They're played back an instruction at a time, so
+    // the devices see exactly what they did when clocked after every
+    // instruction.
+    bool Emulate(uint64_t until=0);
+    // Bring the other devices up to the start of the CPU's current
+    // instruction.  The memory map calls this before the CPU reads or
+    // writes their registers.
+    inline void CatchUp() {
+        if (npending_) Replay();
+        // The access may change when the next event is.
+        next_event_ = 0;
+    }
     bool EmulateFrame();
-    void HandleKeyboard(SDL_Event* event);
+    // Run-ahead: after each frame, emulate `n` more with the same input,
+    // show the last of them, and go back.  That hides up to `n` frames of
+    // the game's own lag between reading the controllers and showing the
+    // result.  The frames ahead aren't heard, and what they do to the
+    // SRAM isn't written to disk.
+    inline int run_ahead() const { return run_ahead_; }
+    inline void set_run_ahead(int n) { run_ahead_ = n; }
+    inline const RunAheadTiming& run_ahead_timing() const {
+        return run_ahead_timing_;
+    }
+    // Emulate a frame again, from the state before it, with the buttons
+    // it had (a byte each, as for PostInput), to draw its picture.  As
+    // with the frames run ahead, nothing is heard and nothing is written
+    // to disk, and the frame count stays as it was.
+    bool ReplayFrame(uint32_t buttons);
+    // Fast forward: run `fast_forward_speed` times as fast as usual, or as
+    // fast as possible if it is 0.  Speeds below 1 are 1.  The APU averages its samples down to
+    // match instead of waiting for the audio device to play them all, so
+    // when the framerate is locked to audio the audio device still sets
+    // the pace.
+    inline bool fast_forward() const { return fast_forward_; }
+    void set_fast_forward(bool ff);
+    inline double fast_forward_speed() const { return fast_forward_speed_; }
+    void set_fast_forward_speed(double speed);
+    // How many times as fast as the NES frames have been emulated lately,
+    // by the time between calls to EmulateFrame.
+    inline double speedup() const {
+        return 1.0 / (options_.fps * frame_seconds_);
+    }
+
+    // Hash the state (see StateHash).  Only the memory written since the
+    // last time is hashed again.
+    StateHash HashState();
 
+    // Load a state saved by SaveState, serialized, printed or compressed.
     bool LoadState(const std::string& state);
     std::string SaveState(bool text=false);
+    std::string SaveState(const SaveStateOptions& options);
+    // The same, without serializing the state.  Leave out the picture
+    // unless `picture` is set; loading a state without one leaves the
+    // picture alone.
+    void LoadState(proto::NES* state);
+    void SaveState(proto::NES* state, bool picture=true);
+    // The same with a Snapshot (see snapshot.h), which takes microseconds
+    // rather than milliseconds.  LoadState returns false, leaving the
+    // state alone, if the snapshot was made for another ROM.
+    bool LoadState(Snapshot* snap);
+    void SaveState(Snapshot* snap, bool picture=true);
+    // Convert between snapshots and protos, by loading one into this NES
+    // and saving the other.  The NES is left as it was.
+    bool ConvertState(Snapshot* from, proto::NES* to);
+    void ConvertState(proto::NES* from, Snapshot* to);
 
     bool LoadStateFromFile(const std::string& filename);
     bool SaveStateToFile(const std::string& filename, bool text=false);
+    bool SaveStateToFile(const std::string& filename,
+                         const SaveStateOptions& options);
     bool LoadEverdriveStateFromFile(const std::string& filename);
 
     static const int frequency = 1789773;
     static constexpr double frame_counter_rate = frequency / 240.0;
     static constexpr double sample_rate = frequency / 44100.0;
   private:
+    template<typename Policy> bool Emulate(uint64_t until);
+    uint64_t Horizon(uint64_t until, uint64_t now);
+    uint64_t NextEvent(uint64_t now);
+    // Clock the PPU, mapper and APU for `n` CPU cycles.
+    void Clock(int n);
+    void Replay();
+    // Catch up and find the next event.
+    void Sync();
+    int SkipIdle(uint64_t until, int n);
+    // Emulate one frame.  Frames `ahead` of the one being played hold the
+    // input, and don't save the SRAM.
+    bool RunFrame(bool ahead);
+    bool RunAhead();
+    // Tell the APU how fast the emulation runs.
+    void UpdateSpeed();
+    // Record or verify the hash of the frame just played, and return
+    // false if it differs from the one recorded.
+    bool CheckStateHash();
+    void DumpState(const proto::NES& state, uint64_t frame);
     void DebugPalette(bool* active);
     APU* apu_;
     Cpu* cpu_;
@@ -81,15 +259,49 @@ class NES {
     Controller* controller_[4];
     MidiConnector* midi_;
     std::vector<std::unique_ptr<EmulatedDevice>> devices_;
+    std::recursive_mutex mutex_;
+    // The posted buttons, with kInputPosted set until they're taken.
+    static const uint64_t kInputPosted = 1ULL << 32;
+    std::atomic<uint64_t> input_;
 
-    proto::NES state_;
+    NESOptions options_;
+    // The protos the string SaveState and LoadState go through, and the
+    // bytes they serialize or inflate on the way.
+    StateArena state_arena_;
+    std::string state_data_;
+    int run_ahead_;
+    Snapshot run_ahead_state_;
+    RunAheadTiming run_ahead_timing_;
+    // ConvertState's place for the state it was called in.
+    Snapshot convert_state_;
+    std::unique_ptr<StateHashLog> state_hash_log_;
+    // HashState's scratch space, and while verifying, the state after
+    // the last frame which matched.
+    proto::NES hash_state_;
+    std::string hash_data_;
+    Snapshot verified_state_;
+    bool fast_forward_;
+    double fast_forward_speed_;
+    double frame_seconds_;
+    std::chrono::steady_clock::time_point last_frame_;
 
     uint32_t palette_[64];
-    bool pause_, step_, debug_, reset_, lag_, has_movie_;
+    bool pause_, step_, debug_, reset_, lag_, has_movie_, profile_;
+    bool idle_skip_;
     uint64_t frame_;
     double remainder_;
-    std::map<int, proto::ControllerButtons> buttons_;
-    std::map<int, int> frame_profile_;
+    ExecutionProfile frame_profile_;
+    int idle_cycles_;
+    uint32_t idle_status_changes_;
+
+    // The cycles of the instructions the other devices haven't been
+    // clocked for yet, their sum, and the cycle before which nothing
+    // the devices do can reach the CPU.
+    static const int kMaxPending = 256;
+    uint32_t pending_[kMaxPending];
+    int npending_;
+    uint64_t behind_;
+    uint64_t next_event_;
 };
 
 }  // namespace protones
@@ -0,0 +1,70 @@
+#include <algorithm>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/declare.h"
+#include "nes/nes.h"
+#include "nes/nes_pool.h"
+
+ABSL_FLAG(int32_t, frames, 3600, "Number of frames to emulate");
+ABSL_FLAG(int32_t, instances, 1, "Number of NES instances to run");
+ABSL_FLAG(int32_t, threads, 0,
+          "Number of worker threads (0: one per hardware thread)");
+ABSL_DECLARE_FLAG(bool, lock_framerate_to_audio);
+ABSL_DECLARE_FLAG(bool, sram_on_disk);
+
+using protones::NESOptions;
+using protones::NESPool;
+
+// Run a ROM, and the FM2 movie given by --fm2 if any, for a number of
+// frames as fast as possible, with no window, audio device or input, and
+// report the frame rate and a hash of the final state.  Two runs of the
+// same ROM and movie must end with the same hash.
+//
+// With --instances, that many independent copies run on a pool of
+// threads, and the aggregate frame rate is reported too.  They must all
+// end in the same state.
+int main(int argc, char *argv[]) {
+    auto args = absl::ParseCommandLine(argc, argv);
+    if (args.size() < 2) {
+        fprintf(stderr, "Usage: %s [flags] <rom>\n", args[0]);
+        return 1;
+    }
+    // Nothing plays the audio, and don't touch the user's save files.
+    absl::SetFlag(&FLAGS_lock_framerate_to_audio, false);
+    absl::SetFlag(&FLAGS_sram_on_disk, false);
+
+    int threads = absl::GetFlag(FLAGS_threads);
+    if (threads <= 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    NESPool pool(threads);
+    NESOptions options;
+    for(int i=0; i<absl::GetFlag(FLAGS_instances); i++) {
+        pool.Add(args[1], absl::GetFlag(FLAGS_frames), options);
+    }
+    pool.Run();
+
+    bool ok = true;
+    for(int i=0; i<pool.size(); i++) {
+        const NESPool::Result& r = pool.result(i);
+        printf("frames=%d cycles=%" PRIu64 " seconds=%.3f fps=%.1f "
+               "state=%08" PRIx32 "\n",
+               r.frames, r.cycles, r.seconds, r.frames / r.seconds,
+               r.state_crc);
+        ok = ok && r.ok && r.state_crc == pool.result(0).state_crc;
+    }
+    if (pool.size() > 1) {
+        printf("instances=%d threads=%d frames=%" PRIu64 " seconds=%.3f "
+               "fps=%.1f%s\n",
+               pool.size(), threads, pool.frames(), pool.seconds(),
+               pool.frames() / pool.seconds(),
+               ok ? "" : " MISMATCH");
+    }
+    return ok ? 0 : 1;
+}
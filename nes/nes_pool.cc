@@ -0,0 +1,98 @@
+#include "nes/nes_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "util/crc.h"
+
+namespace protones {
+
+NESPool::NESPool(int threads, int slice_frames)
+  : threads_(std::max(threads, 1)),
+    slice_frames_(std::max(slice_frames, 1)),
+    seconds_(0) {
+}
+
+int NESPool::Add(const std::string& rom, int frames,
+                 const NESOptions& options) {
+    std::unique_ptr<Session> session(new Session);
+    session->rom = rom;
+    session->frames = frames;
+    session->options = options;
+    sessions_.emplace_back(std::move(session));
+    return int(sessions_.size()) - 1;
+}
+
+uint64_t NESPool::frames() const {
+    uint64_t frames = 0;
+    for(const auto& session : sessions_) {
+        frames += session->result.frames;
+    }
+    return frames;
+}
+
+void NESPool::Run() {
+    for(auto& session : sessions_) {
+        if (!session->done) queue_.push_back(session.get());
+    }
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    int n = std::min(threads_, int(queue_.size()));
+    for(int i=0; i<n; i++) {
+        workers.emplace_back(&NESPool::Worker, this);
+    }
+    for(auto& worker : workers) {
+        worker.join();
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    seconds_ = std::chrono::duration<double>(t1 - t0).count();
+}
+
+void NESPool::Worker() {
+    for(;;) {
+        Session* session;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (queue_.empty())
+                return;
+            session = queue_.front();
+            queue_.pop_front();
+        }
+        if (RunSlice(session)) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push_back(session);
+        }
+    }
+}
+
+bool NESPool::RunSlice(Session* session) {
+    Result& result = session->result;
+    auto t0 = std::chrono::steady_clock::now();
+    if (!session->nes) {
+        session->nes.reset(new NES(session->options));
+        session->nes->LoadFile(session->rom);
+        session->nes->Reset();
+    }
+    NES* nes = session->nes.get();
+    int end = std::min(result.frames + slice_frames_, session->frames);
+    bool running = true;
+    while(result.frames < end && (running = nes->EmulateFrame())) {
+        result.frames++;
+    }
+    bool more = running && result.frames < session->frames;
+    if (!more) {
+        std::string state = nes->SaveState();
+        result.cycles = nes->cpu_cycles();
+        result.state_crc = Crc32(0, state.data(), state.size());
+        result.ok = result.frames == session->frames;
+        nes->Shutdown();
+        session->nes.reset();
+        session->done = true;
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    result.seconds += std::chrono::duration<double>(t1 - t0).count();
+    return more;
+}
+
+}  // namespace protones
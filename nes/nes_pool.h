@@ -0,0 +1,73 @@
+#ifndef PROTONES_NES_NES_POOL_H
+#define PROTONES_NES_NES_POOL_H
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "nes/nes.h"
+
+namespace protones {
+
+// Runs many independent NES instances on a pool of worker threads.
+//
+// Each session loads its own ROM with its own options and emulates its
+// own number of frames.  The workers take the sessions in turn, a slice
+// of frames at a time, so long and short sessions share the threads
+// fairly.  A session's NES is created on its first slice and destroyed
+// when it's done, so only the running sessions hold memory.
+class NESPool {
+  public:
+    struct Result {
+        int frames = 0;
+        uint64_t cycles = 0;
+        // Time spent emulating the session, not counting time waiting
+        // for a worker.
+        double seconds = 0;
+        // CRC32 of the final saved state.
+        uint32_t state_crc = 0;
+        // Whether the session ran all its frames.
+        bool ok = false;
+    };
+
+    explicit NESPool(int threads, int slice_frames=60);
+
+    // Add a session which emulates `rom` for `frames` frames, and return
+    // its index.
+    int Add(const std::string& rom, int frames,
+            const NESOptions& options=NESOptions());
+    // Run every session which hasn't run yet to the end of its frames.
+    void Run();
+
+    inline int size() const { return int(sessions_.size()); }
+    inline const Result& result(int i) const { return sessions_[i]->result; }
+    // The wall clock time the last Run took, and the frames emulated.
+    inline double seconds() const { return seconds_; }
+    uint64_t frames() const;
+
+  private:
+    struct Session {
+        std::string rom;
+        int frames;
+        NESOptions options;
+        std::unique_ptr<NES> nes;
+        Result result;
+        bool done = false;
+    };
+    void Worker();
+    // Emulate the next slice of `session`, and return whether it has
+    // more to do.
+    bool RunSlice(Session* session);
+
+    int threads_;
+    int slice_frames_;
+    std::vector<std::unique_ptr<Session>> sessions_;
+    std::mutex mutex_;
+    std::deque<Session*> queue_;
+    double seconds_;
+};
+
+}  // namespace protones
+#endif // PROTONES_NES_NES_POOL_H
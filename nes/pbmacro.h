@@ -24,6 +24,7 @@
 
 #define SAVE_ARRAY(x) \
     do { \
+        state->clear_##x(); \
         for(const auto& val : x##_) { \
             state->add_##x(val); \
         } \
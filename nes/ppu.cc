@@ -1,7 +1,6 @@
 #include <algorithm>
+#include <climits>
 #include <tuple>
-#include "imgui.h"
-#include <SDL2/SDL_opengl.h>
 
 #include "nes/pbmacro.h"
 #include "nes/cartridge.h"
@@ -44,12 +43,14 @@ PPU::PPU(NES* nes)
     picture_{0,},
     debug_showbg_(true),
     debug_showsprites_(true),
-    debug_dot_(0) {
+    status_changes_(0),
+    debug_dot_(0),
+    draw_(true) {
     BuildExpanderTables();
 }
 
 void PPU::LoadState(proto::PPU* state) {
-    LOAD(cycle, scanline, frame,
+    LOAD(cycle, scanline, dead, frame,
          v, t, x, w, f,
          nametable, attrtable, lowtile, hightile, tiledata,
          oam_addr, buffered_data);
@@ -77,8 +78,8 @@ void PPU::LoadState(proto::PPU* state) {
     }
 }
 
-void PPU::SaveState(proto::PPU* state) {
-    SAVE(cycle, scanline, frame,
+void PPU::SaveState(proto::PPU* state, bool picture) {
+    SAVE(cycle, scanline, dead, frame,
          v, t, x, w, f,
          nametable, attrtable, lowtile, hightile, tiledata,
          oam_addr, buffered_data);
@@ -90,8 +91,11 @@ void PPU::SaveState(proto::PPU* state) {
 
     auto* oam = state->mutable_oam();
     oam->assign((char*)oam_, sizeof(oam_));
-    auto* picture = state->mutable_picture();
-    picture->assign((char*)picture_, sizeof(picture_));
+    if (picture) {
+        state->mutable_picture()->assign((char*)picture_, sizeof(picture_));
+    } else {
+        state->clear_picture();
+    }
 
     state->clear_sprite();
     for(int i=0; i<sprite_.count; i++) {
@@ -103,6 +107,28 @@ void PPU::SaveState(proto::PPU* state) {
     }
 }
 
+void PPU::LoadState(Snapshot* snap) {
+    snap->Load(cycle_, scanline_, dead_, frame_,
+               v_, t_, x_, w_, f_, register_, nmi_,
+               nametable_, attrtable_, lowtile_, hightile_, tiledata_,
+               sprite_, control_, mask_, status_,
+               oam_, oam_addr_, buffered_data_);
+    if (snap->picture()) {
+        snap->Load(picture_);
+    }
+}
+
+void PPU::SaveState(Snapshot* snap) {
+    snap->Save(cycle_, scanline_, dead_, frame_,
+               v_, t_, x_, w_, f_, register_, nmi_,
+               nametable_, attrtable_, lowtile_, hightile_, tiledata_,
+               sprite_, control_, mask_, status_,
+               oam_, oam_addr_, buffered_data_);
+    if (snap->picture()) {
+        snap->Save(picture_);
+    }
+}
+
 void PPU::Reset() {
     dead_ = 2 * (262*341);
     cycle_ = 341-18;;
@@ -120,6 +146,42 @@ void PPU::NmiChange() {
     nmi_.previous = nmi;
 }
 
+int PPU::DotsUntilNmi() const {
+    if (!nmi_.output)
+        return INT_MAX;
+    if (nmi_.delay)
+        return nmi_.delay;
+    // The vertical blank starts at dot 1 of scanline 241 and the NMI
+    // follows 15 dots later.  The dot skipped on odd frames may make it
+    // one sooner.
+    int dots = (241 * 341 + 1) - (scanline_ * 341 + cycle_);
+    if (dots <= 0)
+        dots += 262 * 341;
+    return dots + 15 - 1;
+}
+
+int PPU::DotsUntilStatusChange() const {
+    // The vertical blank flag is set at dot 1 of scanline 241 and cleared,
+    // with the sprite flags, at dot 1 of the pre-render line.  The dot
+    // skipped on odd frames may make either one sooner.
+    const int now = scanline_ * 341 + cycle_;
+    auto until = [now](int scanline, int cycle) {
+        int dots = (scanline * 341 + cycle) - now;
+        if (dots <= 0)
+            dots += 262 * 341;
+        return dots - 1;
+    };
+    int dots = std::min(until(241, 1), until(261, 1));
+    if (mask_.showbg || mask_.showsprites) {
+        // Sprite zero hits and sprite overflow can happen anywhere on the
+        // visible lines.
+        if (scanline_ < 240)
+            return 0;
+        dots = std::min(dots, until(0, 0));
+    }
+    return dots;
+}
+
 void PPU::set_control(uint8_t val) {
     control_.nametable =   val & 3;
     control_.increment =   val >> 2;
@@ -147,6 +209,7 @@ uint8_t PPU::status() {
     result |= uint8_t(status_.sprite_overflow) << 5;
     result |= uint8_t(status_.sprite0_hit) << 6;
     result |= uint8_t(nmi_.occured) << 7;
+    if (nmi_.occured) status_changes_++;
     nmi_.occured = false;
     NmiChange();
     w_ = 0;
@@ -183,7 +246,10 @@ void PPU::set_address(uint8_t val) {
 }
 
 uint8_t PPU::data() {
+    CodeDataLog* cdl = nes_->cartridge()->cdl();
+    if (cdl) cdl->set_chr_access(CodeDataLog::Read);
     uint8_t result = nes_->mem()->PPURead(v_);
+    if (cdl) cdl->set_chr_access(CodeDataLog::Rendered);
 
     if (v_ % 0x4000 < 0x3F00) {
         std::swap(buffered_data_, result);
@@ -220,6 +286,7 @@ uint8_t PPU::Read(uint16_t addr) {
 }
 
 void PPU::Write(uint16_t addr, uint8_t val) {
+    if ((register_ ^ val) & 0x1F) status_changes_++;
     register_ = val;
     switch(addr) {
         case 0x2000: set_control(val); break;
@@ -268,12 +335,14 @@ void PPU::CopyY() {
 }
 
 void PPU::SetVerticalBlank() {
+    status_changes_++;
     nmi_.occured = true;
     NmiChange();
     //nes_->io()->screen_blit(picture_);
 }
 
 void PPU::ClearVerticalBlank() {
+    status_changes_++;
     nmi_.occured = false;
     NmiChange();
 }
@@ -380,8 +449,10 @@ void PPU::RenderPixel() {
     } else if (!s) {
         color = debug_showbg_ ? background : 0;
     } else {
-        if (sprite_.index[i] == 0 && x < 255)
+        if (sprite_.index[i] == 0 && x < 255 && !status_.sprite0_hit) {
             status_.sprite0_hit = 1;
+            status_changes_++;
+        }
 
         if (sprite_.priority[i] == 0) {
             color = debug_showsprites_ ? (sprite | 0x10) : 0;
@@ -389,6 +460,8 @@ void PPU::RenderPixel() {
             color = debug_showbg_ ? background : 0;
         }
     }
+    if (!draw_)
+        return;
     if (debug_dot_) {
         picture_[y * 256 + x] = debug_dot_;
         debug_dot_ = 0;
@@ -454,6 +527,7 @@ void PPU::EvaluateSprites() {
     }
     if (count > 8) {
         count = 8;
+        if (!status_.sprite_overflow) status_changes_++;
         status_.sprite_overflow = 1;
     }
     sprite_.count = count;
@@ -555,4 +629,30 @@ void PPU::Emulate() {
     }
 
 }
+
+void PPU::Run(int dots) {
+    Mapper* mapper = nes_->mapper();
+    switch(mapper->clock()) {
+    case Mapper::ClockDot:
+        for(int i=0; i<dots; i++) {
+            Emulate();
+            mapper->Emulate();
+        }
+        break;
+    case Mapper::ClockScanline:
+        for(int i=0; i<dots; i++) {
+            Emulate();
+            if (cycle_ == 260 && (mask_.showbg || mask_.showsprites) &&
+                (scanline_ < 240 || scanline_ == 261)) {
+                mapper->Scanline();
+            }
+        }
+        break;
+    default:
+        for(int i=0; i<dots; i++) {
+            Emulate();
+        }
+    }
+}
+
 }  // namespace protones
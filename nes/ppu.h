@@ -3,6 +3,7 @@
 #include <cstdint>
 #include "nes/base.h"
 #include "nes/nes.h"
+#include "nes/snapshot.h"
 #include "proto/ppu.pb.h"
 namespace protones {
 
@@ -34,15 +35,35 @@ class PPU : public EmulatedDevice {
     uint8_t Read(uint16_t addr);
     void Write(uint16_t addr, uint8_t val);
     void Emulate();
+    // Emulate `dots` dots, clocking the mapper as it asks to be (see
+    // Mapper::Clock).
+    void Run(int dots);
 
     inline uint64_t frame() const { return frame_; }
     inline int scanline() const { return scanline_; }
     inline int cycle() const { return cycle_; }
     inline Control control() const { return control_; }
     inline Mask mask() const { return mask_; }
+    // A lower bound on the number of dots before the PPU signals the next
+    // NMI, or INT_MAX if it can't without a write to PPUCTRL first.
+    int DotsUntilNmi() const;
+    // A lower bound on the number of dots before PPUSTATUS could read
+    // differently, other than by reading or writing the PPU registers.
+    int DotsUntilStatusChange() const;
+    // Counts the changes to what PPUSTATUS reads, including those made by
+    // reading it.
+    inline uint32_t status_changes() const { return status_changes_; }
     void LoadState(proto::PPU* state);
-    void SaveState(proto::PPU* state);
+    // Leave out the picture unless `picture` is set.  Loading a state
+    // without one leaves the picture alone.
+    void SaveState(proto::PPU* state, bool picture=true);
+    // The picture is in the snapshot if it was Begun with one.
+    void LoadState(Snapshot* snap);
+    void SaveState(Snapshot* snap);
     inline uint32_t* picture() { return picture_; }
+    // Whether to draw the picture.  Everything else about rendering,
+    // e.g. sprite 0 hits, still happens when it isn't drawn.
+    inline void set_draw(bool d) { draw_ = d; }
     inline void set_debug_dot(uint32_t color) { debug_dot_ = color; }
   private:
     void NmiChange();
@@ -132,7 +153,9 @@ class PPU : public EmulatedDevice {
     void BuildExpanderTables();
     uint32_t normal_table_[256];
     uint32_t reflection_table_[256];
+    uint32_t status_changes_;
     uint32_t debug_dot_;
+    bool draw_;
     friend class PPUTileDebug;
     friend class PPUVramDebug;
 };
@@ -0,0 +1,95 @@
+#include <algorithm>
+#include <cstring>
+
+#include "nes/profile.h"
+
+namespace protones {
+
+ExecutionProfile::ExecutionProfile()
+  : recording_(0) {
+    for(Frame& f : frames_) {
+        memset(f.used, 0, sizeof(f.used));
+        f.idle = 0;
+    }
+}
+
+uint32_t* ExecutionProfile::Allocate(Frame* frame, int bank) {
+    frame->bank[bank].reset(new uint32_t[kBankSize]());
+    return frame->bank[bank].get();
+}
+
+void ExecutionProfile::Swap() {
+    recording_ = !recording_;
+    Frame& f = frames_[recording_];
+    for(int b=0; b<kBanks; b++) {
+        if (f.used[b]) {
+            memset(f.bank[b].get(), 0, kBankSize * sizeof(uint32_t));
+            f.used[b] = false;
+        }
+    }
+    f.idle = 0;
+}
+
+const uint32_t* ExecutionProfile::bank(int bank) const {
+    const Frame& f = frames_[!recording_];
+    if (bank < 0 || bank >= kBanks || !f.used[bank])
+        return nullptr;
+    return f.bank[bank].get();
+}
+
+std::vector<int> ExecutionProfile::banks() const {
+    const Frame& f = frames_[!recording_];
+    std::vector<int> result;
+    for(int b=0; b<kBanks; b++) {
+        if (f.used[b]) result.push_back(b);
+    }
+    return result;
+}
+
+uint64_t ExecutionProfile::Sum(int bank, uint16_t first,
+                               uint16_t last) const {
+    const uint32_t* table = this->bank(bank);
+    uint64_t sum = 0;
+    if (table) {
+        for(uint32_t pc=first; pc<=last; pc++) {
+            sum += table[pc];
+        }
+    }
+    return sum;
+}
+
+uint64_t ExecutionProfile::total() const {
+    uint64_t sum = idle();
+    for(int b : banks()) {
+        sum += Sum(b, 0, 0xFFFF);
+    }
+    return sum;
+}
+
+std::vector<std::pair<int, uint64_t>> ExecutionProfile::BankTotals() const {
+    std::vector<std::pair<int, uint64_t>> result;
+    result.emplace_back(-1, idle());
+    for(int b : banks()) {
+        result.emplace_back(b, Sum(b, 0, 0xFFFF));
+    }
+    return result;
+}
+
+std::vector<std::pair<int, uint32_t>> ExecutionProfile::Top(int n) const {
+    std::vector<std::pair<int, uint32_t>> result;
+    for(int b : banks()) {
+        const uint32_t* table = bank(b);
+        for(int pc=0; pc<kBankSize; pc++) {
+            if (table[pc]) result.emplace_back(b << 16 | pc, table[pc]);
+        }
+    }
+    n = std::min(std::max(n, 0), int(result.size()));
+    std::partial_sort(result.begin(), result.begin() + n, result.end(),
+                      [](const auto& a, const auto& b) {
+                          return a.second > b.second;
+                      });
+    result.resize(n);
+    return result;
+}
+
+}  // namespace protones
@@ -0,0 +1,69 @@
+#ifndef PROTONES_NES_PROFILE_H
+#define PROTONES_NES_PROFILE_H
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace protones {
+
+// Where the CPU spent its cycles during a frame: a dense table of cycle
+// counts indexed by pc for every bank the code ran from, plus the cycles
+// spent in idle loops.
+//
+// The table is double-buffered.  Add records into the frame being
+// emulated, and Swap, at the end of the frame, makes it the one which
+// is read and starts the next frame with an empty table.  A bank's
+// table is only allocated once code has run from it, and only the
+// tables which were written to are cleared.
+class ExecutionProfile {
+  public:
+    static const int kBanks = 256;
+    static const int kBankSize = 65536;
+
+    ExecutionProfile();
+
+    inline void Add(int bank, uint16_t pc, uint32_t cycles) {
+        Frame& f = frames_[recording_];
+        uint32_t* table = f.bank[bank].get();
+        if (!table) {
+            table = Allocate(&f, bank);
+        }
+        f.used[bank] = true;
+        table[pc] += cycles;
+    }
+    inline void AddIdle(uint32_t cycles) {
+        frames_[recording_].idle += cycles;
+    }
+    void Swap();
+
+    // Everything below reads the last complete frame.
+    //
+    // The cycles counted at each pc in `bank`, or nullptr if no code ran
+    // from it.  The table is overwritten two Swaps later.
+    const uint32_t* bank(int bank) const;
+    uint32_t idle() const { return frames_[!recording_].idle; }
+    // The banks code ran from.
+    std::vector<int> banks() const;
+    uint64_t total() const;
+    // The cycles spent in [first, last] in `bank`.
+    uint64_t Sum(int bank, uint16_t first, uint16_t last) const;
+    // The cycles spent in each bank, with idle loops under bank -1.
+    std::vector<std::pair<int, uint64_t>> BankTotals() const;
+    // The `n` addresses (bank << 16 | pc) the most cycles were spent at.
+    std::vector<std::pair<int, uint32_t>> Top(int n) const;
+
+  private:
+    struct Frame {
+        std::unique_ptr<uint32_t[]> bank[kBanks];
+        bool used[kBanks];
+        uint32_t idle;
+    };
+    uint32_t* Allocate(Frame* frame, int bank);
+
+    Frame frames_[2];
+    int recording_;
+};
+
+}  // namespace protones
+#endif // PROTONES_NES_PROFILE_H
@@ -0,0 +1,354 @@
+#include "nes/rewind.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "nes/controller.h"
+#include "nes/nes.h"
+#include "util/compress.h"
+
+namespace protones {
+
+namespace {
+void PutVarint(std::string* out, size_t v) {
+    while(v >= 0x80) {
+        out->push_back(char(v | 0x80));
+        v >>= 7;
+    }
+    out->push_back(char(v));
+}
+
+bool GetVarint(const uint8_t** p, const uint8_t* end, size_t* v) {
+    *v = 0;
+    for(int shift=0; *p < end && shift < 64; shift += 7) {
+        uint8_t b = *(*p)++;
+        *v |= size_t(b & 0x7F) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+// XOR `a` with `b`, and run length encode the runs of zeros: pairs of a
+// count of zeros and a count of the bytes which follow as they are, each
+// a varint.
+void EncodeDelta(const std::string& a, const std::string& b,
+                 std::string* out) {
+    const uint8_t* x = reinterpret_cast<const uint8_t*>(a.data());
+    const uint8_t* y = reinterpret_cast<const uint8_t*>(b.data());
+    const size_t n = a.size();
+    out->clear();
+    size_t i = 0;
+    while(i < n) {
+        size_t same = i;
+        while(same + 8 <= n && memcmp(x + same, y + same, 8) == 0)
+            same += 8;
+        while(same < n && x[same] == y[same])
+            same++;
+        size_t diff = same;
+        while(diff < n && x[diff] != y[diff])
+            diff++;
+        PutVarint(out, same - i);
+        PutVarint(out, diff - same);
+        for(size_t j=same; j<diff; j++) {
+            out->push_back(char(x[j] ^ y[j]));
+        }
+        i = diff;
+    }
+}
+
+// XOR a delta from EncodeDelta into `state`.
+bool ApplyDelta(const std::string& delta, std::string* state) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(delta.data());
+    const uint8_t* end = p + delta.size();
+    uint8_t* s = reinterpret_cast<uint8_t*>(&(*state)[0]);
+    size_t i = 0, same, diff;
+    while(p < end) {
+        if (!GetVarint(&p, end, &same) || !GetVarint(&p, end, &diff))
+            return false;
+        i += same;
+        if (i + diff > state->size() || p + diff > end)
+            return false;
+        for(size_t j=0; j<diff; j++) {
+            s[i++] ^= *p++;
+        }
+    }
+    return true;
+}
+
+// The frames are kept, and counted by their capacity, so drop the room
+// zlib was given beyond what it wrote.
+void Deflate(const std::string& data, std::string* out) {
+    *out = ZLib::Compress(data, ZLib::kBestSpeed);
+    out->shrink_to_fit();
+}
+
+bool Inflate(const std::string& data, size_t size, std::string* out) {
+    auto result = ZLib::Uncompress(data, int(size));
+    if (!result.ok() || result.value().size() != size)
+        return false;
+    out->assign(result.value());
+    return true;
+}
+
+double Seconds(std::chrono::steady_clock::duration d) {
+    return std::chrono::duration<double>(d).count();
+}
+
+// Smoothing for the per frame times.
+const double kAverage = 0.02;
+}  // namespace
+
+Rewind::Rewind(NES* nes)
+  : nes_(nes),
+    busy_(false),
+    stop_(false),
+    first_(1),
+    next_(1),
+    position_(0),
+    keyframes_(0),
+    bytes_(0),
+    snapshot_size_(0),
+    max_frames_(0),
+    max_bytes_(0),
+    save_seconds_(0),
+    compress_seconds_(0),
+    since_key_(-1) {
+    set_capacity(600, 32);
+    thread_ = std::thread(&Rewind::Compressor, this);
+}
+
+Rewind::~Rewind() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cond_.notify_all();
+    thread_.join();
+}
+
+void Rewind::set_capacity(double seconds, double megabytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_frames_ = size_t(std::max(1.0, seconds * nes_->options().fps));
+    max_bytes_ = size_t(megabytes * 1024 * 1024);
+}
+
+void Rewind::Push() {
+    auto t0 = Clock::now();
+    nes_->SaveState(&snapshot_, false);
+    uint32_t buttons = 0;
+    for(int i=0; i<nes_->controller_size(); i++) {
+        buttons |= uint32_t(nes_->controller(i)->buttons()) << (8 * i);
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (position_ + 1 != next_) {
+        // Play went on from a frame the NES was stepped back to: the frames
+        // after it are gone, and the next one starts a new keyframe.
+        WaitIdle(&lock);
+        while(!frames_.empty() && first_ + frames_.size() > position_ + 1) {
+            bytes_ -= FrameBytes(frames_.back());
+            keyframes_ -= frames_.back().key;
+            frames_.pop_back();
+        }
+        next_ = position_ + 1;
+        if (frames_.empty())
+            first_ = next_;
+        since_key_ = -1;
+    }
+    Pending pending;
+    pending.buttons = buttons;
+    if (!spare_.empty()) {
+        pending.state = std::move(spare_.back());
+        spare_.pop_back();
+    }
+    pending.state.assign(reinterpret_cast<const char*>(snapshot_.data()),
+                         snapshot_.size());
+    queue_.push_back(std::move(pending));
+    snapshot_size_ = snapshot_.size();
+    position_ = next_++;
+    save_seconds_ += kAverage * (Seconds(Clock::now() - t0) - save_seconds_);
+    cond_.notify_all();
+}
+
+bool Rewind::Step(int n) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    WaitIdle(&lock);
+    if (frames_.empty())
+        return false;
+    int64_t i = int64_t(position_) + n;
+    i = std::max(i, int64_t(first_));
+    i = std::min(i, int64_t(first_ + frames_.size() - 1));
+    return Load(uint64_t(i));
+}
+
+bool Rewind::Seek(uint64_t index) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    WaitIdle(&lock);
+    return Load(index);
+}
+
+bool Rewind::Load(uint64_t index) {
+    if (index == position_ || index < first_ ||
+        index >= first_ + frames_.size()) {
+        return false;
+    }
+    // Draw the frame by playing it again, then load it to be exactly as
+    // it was, which leaves the picture alone.  The PPU's frames don't line
+    // up exactly with ours, so the picture may keep dots from the frame
+    // before, which is played too.
+    // Both states are decoded before either is loaded, so a corrupt frame
+    // leaves the NES alone.
+    if (!Decode(index, &state_))
+        return false;
+    if (index > first_) {
+        uint64_t from = std::max(first_, index - kReplayFrames);
+        if (!Decode(from, &replay_state_))
+            return false;
+        snapshot_.Assign(replay_state_.data(), replay_state_.size());
+        if (!nes_->LoadState(&snapshot_))
+            return false;
+        for(uint64_t i=from+1; i<=index; i++) {
+            nes_->ReplayFrame(frames_[i - first_].buttons);
+        }
+    }
+    snapshot_.Assign(state_.data(), state_.size());
+    if (!nes_->LoadState(&snapshot_))
+        return false;
+    position_ = index;
+    return true;
+}
+
+void Rewind::Clear() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    WaitIdle(&lock);
+    frames_.clear();
+    keyframes_ = 0;
+    bytes_ = 0;
+    first_ = next_;
+    position_ = next_ - 1;
+    since_key_ = -1;
+}
+
+uint64_t Rewind::first() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return first_;
+}
+
+uint64_t Rewind::last() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return next_ - 1;
+}
+
+uint64_t Rewind::position() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return position_;
+}
+
+Rewind::Stats Rewind::stats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats;
+    stats.frames = frames_.size();
+    stats.keyframes = keyframes_;
+    stats.seconds = frames_.size() / nes_->options().fps;
+    stats.bytes = bytes_;
+    stats.snapshot = snapshot_size_;
+    stats.save = save_seconds_;
+    stats.compress = compress_seconds_;
+    return stats;
+}
+
+void Rewind::Compressor() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for(;;) {
+        cond_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+        if (stop_)
+            return;
+        Pending pending = std::move(queue_.front());
+        queue_.pop_front();
+        busy_ = true;
+        lock.unlock();
+
+        auto t0 = Clock::now();
+        Frame frame;
+        frame.buttons = pending.buttons;
+        Compress(pending.state, &frame);
+        last_.swap(pending.state);
+        double seconds = Seconds(Clock::now() - t0);
+
+        lock.lock();
+        compress_seconds_ += kAverage * (seconds - compress_seconds_);
+        keyframes_ += frame.key;
+        bytes_ += FrameBytes(frame);
+        frames_.push_back(std::move(frame));
+        Evict();
+        spare_.push_back(std::move(pending.state));
+        busy_ = false;
+        cond_.notify_all();
+    }
+}
+
+void Rewind::Compress(const std::string& state, Frame* frame) {
+    frame->key = since_key_ < 0 || since_key_ >= kKeyframeInterval - 1 ||
+                 last_.size() != state.size();
+    if (frame->key) {
+        since_key_ = 0;
+        frame->size = uint32_t(state.size());
+        Deflate(state, &frame->data);
+    } else {
+        since_key_++;
+        EncodeDelta(state, last_, &delta_);
+        frame->size = uint32_t(delta_.size());
+        Deflate(delta_, &frame->data);
+    }
+}
+
+bool Rewind::Decode(uint64_t index, std::string* state) {
+    size_t i = index - first_;
+    size_t k = i;
+    while(k > 0 && !frames_[k].key)
+        k--;
+    if (!frames_[k].key)
+        return false;
+    for(; k <= i; k++) {
+        const Frame& frame = frames_[k];
+        if (frame.key) {
+            if (!Inflate(frame.data, frame.size, state))
+                return false;
+        } else {
+            if (!Inflate(frame.data, frame.size, &inflated_) ||
+                !ApplyDelta(inflated_, state)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void Rewind::Evict() {
+    while(frames_.size() > max_frames_ || bytes_ > max_bytes_) {
+        // Drop the oldest keyframe and the frames which depend on it, but
+        // never the newest keyframe.
+        size_t n = 1;
+        while(n < frames_.size() && !frames_[n].key)
+            n++;
+        if (n == frames_.size())
+            break;
+        for(size_t i=0; i<n; i++) {
+            bytes_ -= FrameBytes(frames_.front());
+            keyframes_ -= frames_.front().key;
+            frames_.pop_front();
+        }
+        first_ += n;
+    }
+}
+
+void Rewind::WaitIdle(std::unique_lock<std::mutex>* lock) {
+    cond_.wait(*lock, [this]() { return queue_.empty() && !busy_; });
+}
+
+size_t Rewind::FrameBytes(const Frame& frame) {
+    return sizeof(Frame) + frame.data.capacity();
+}
+
+}  // namespace protones
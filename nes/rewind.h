@@ -0,0 +1,142 @@
+#ifndef PROTONES_NES_REWIND_H
+#define PROTONES_NES_REWIND_H
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "nes/snapshot.h"
+
+namespace protones {
+
+class NES;
+
+// Keeps the NES's state after every frame, going back as far as its
+// capacity allows, so the NES can be stepped back and forth through them.
+//
+// Each frame's snapshot (see snapshot.h) is handed to a thread which
+// compresses it.  Every kKeyframeInterval'th frame is kept whole, and the
+// ones between as the XOR with the frame before, with the runs of zeros
+// run length encoded; both are then deflated.  Going to a frame decodes it
+// from the keyframe before it.  When the buffer is full, the oldest
+// keyframe and the frames which depend on it are dropped.
+//
+// The snapshots leave out the picture.  Going to a frame loads the one
+// kReplayFrames before it and emulates the frames between again, with the
+// buttons they had, to draw it.
+class Rewind {
+  public:
+    static const int kKeyframeInterval = 120;
+    // The frames played again to draw the one gone to.
+    static const int kReplayFrames = 2;
+
+    struct Stats {
+        uint64_t frames = 0;
+        uint64_t keyframes = 0;
+        // The play the frames cover, in seconds, and the memory they take.
+        double seconds = 0;
+        size_t bytes = 0;
+        // The size of one snapshot, uncompressed.
+        size_t snapshot = 0;
+        // The seconds each frame takes on the emulation thread, to save
+        // the snapshot, and on the compressor's.
+        double save = 0;
+        double compress = 0;
+    };
+
+    explicit Rewind(NES* nes);
+    ~Rewind();
+
+    // Keep at most `seconds` of play, in at most `megabytes` of memory.
+    void set_capacity(double seconds, double megabytes);
+
+    // Keep the frame just played.  If the NES was stepped back, the frames
+    // after the one it was at are dropped first.  Call with the NES locked.
+    void Push();
+    // Go `n` frames forward, or back if `n` is negative, as far as there
+    // are frames, and return whether the NES moved.  Call with the NES
+    // locked.
+    bool Step(int n);
+    // Go to frame `index`, from first() to last().
+    bool Seek(uint64_t index);
+    // Drop every frame.
+    void Clear();
+
+    // The frames kept are numbered first() to last(), in the order they
+    // were played; the NES is at position().
+    uint64_t first();
+    uint64_t last();
+    uint64_t position();
+    Stats stats();
+
+  private:
+    using Clock = std::chrono::steady_clock;
+    struct Frame {
+        bool key;
+        // What the controllers had, a byte each.
+        uint32_t buttons;
+        // The size of `data` inflated.
+        uint32_t size;
+        std::string data;
+    };
+    // A snapshot waiting for the compressor.
+    struct Pending {
+        uint32_t buttons;
+        std::string state;
+    };
+
+    // Load frame `index`, with the lock held and the compressor idle.
+    bool Load(uint64_t index);
+    void Compressor();
+    void Compress(const std::string& state, Frame* frame);
+    // Decode frame `index` into `state`.  Returns false if a frame it
+    // depends on is corrupt.
+    bool Decode(uint64_t index, std::string* state);
+    void Evict();
+    // Wait for the compressor to finish what it was given.
+    void WaitIdle(std::unique_lock<std::mutex>* lock);
+    static size_t FrameBytes(const Frame& frame);
+
+    NES* nes_;
+    Snapshot snapshot_;
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::deque<Pending> queue_;
+    // Buffers the compressor is done with, to copy the next snapshots to.
+    std::vector<std::string> spare_;
+    bool busy_;
+    bool stop_;
+
+    std::deque<Frame> frames_;
+    uint64_t first_;
+    // The next frame pushed, and the frame the NES is at.
+    uint64_t next_;
+    uint64_t position_;
+    uint64_t keyframes_;
+    size_t bytes_;
+    size_t snapshot_size_;
+    size_t max_frames_;
+    size_t max_bytes_;
+    double save_seconds_;
+    double compress_seconds_;
+
+    // The compressor's: the last frame, which the next one is XORed with,
+    // the frames since the last keyframe, and scratch space.
+    std::string last_;
+    int since_key_;
+    std::string delta_;
+    // Decode's scratch space, and the state Load plays forward from.
+    std::string state_;
+    std::string inflated_;
+    std::string replay_state_;
+
+    std::thread thread_;
+};
+
+}  // namespace protones
+#endif // PROTONES_NES_REWIND_H
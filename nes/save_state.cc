@@ -0,0 +1,68 @@
+#include "nes/save_state.h"
+
+#include <cstring>
+
+#include "util/compress.h"
+
+namespace protones {
+
+namespace {
+struct Header {
+    uint32_t magic;
+    uint32_t reserved;
+    uint64_t size;
+};
+const uint32_t kMagic = 0x5a534e50;  // "PNSZ"
+// More than any NES's state, to refuse a corrupt header's size.
+const uint64_t kMaxSize = 64 << 20;
+}  // namespace
+
+proto::NES* StateArena::New() {
+    if (arena_ && arena_->SpaceAllocated() > size_) {
+        // The last state didn't fit: make the block big enough for it.
+        size_t size = arena_->SpaceAllocated();
+        arena_.reset();
+        block_.reset(new char[size]);
+        size_ = size;
+    }
+    if (arena_) {
+        arena_->Reset();
+    } else {
+        google::protobuf::ArenaOptions options;
+        options.initial_block = block_.get();
+        options.initial_block_size = size_;
+        arena_.reset(new google::protobuf::Arena(options));
+    }
+    return google::protobuf::Arena::CreateMessage<proto::NES>(arena_.get());
+}
+
+void CompressState(const std::string& state, std::string* out) {
+    Header header = {kMagic, 0, state.size()};
+    out->assign(reinterpret_cast<const char*>(&header), sizeof(header));
+    out->append(ZLib::Compress(state, ZLib::kBestSpeed));
+}
+
+bool IsCompressedState(const std::string& data) {
+    uint32_t magic;
+    if (data.size() < sizeof(Header))
+        return false;
+    memcpy(&magic, data.data(), sizeof(magic));
+    return magic == kMagic;
+}
+
+bool UncompressState(const std::string& data, std::string* out) {
+    if (!IsCompressedState(data))
+        return false;
+    Header header;
+    memcpy(&header, data.data(), sizeof(header));
+    if (header.size > kMaxSize)
+        return false;
+    auto result = ZLib::Uncompress(data.substr(sizeof(header)),
+                                   int(header.size));
+    if (!result.ok() || result.value().size() != header.size)
+        return false;
+    out->assign(result.value());
+    return true;
+}
+
+}  // namespace protones
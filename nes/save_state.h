@@ -0,0 +1,48 @@
+#ifndef PROTONES_NES_SAVE_STATE_H
+#define PROTONES_NES_SAVE_STATE_H
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "google/protobuf/arena.h"
+#include "proto/nes.pb.h"
+
+namespace protones {
+
+// How NES::SaveState saves a state.
+struct SaveStateOptions {
+    // Print the state as a text proto rather than serialize it.
+    bool text = false;
+    // Keep the picture.  It's a quarter of a megabyte, and the next frame
+    // after loading draws it again, so it's only needed to show the state
+    // without playing it.
+    bool picture = true;
+    // Deflate the state (see CompressState).
+    bool compress = false;
+};
+
+// The protos for saving or loading a state, on an arena.  The memory the
+// last one took is kept for the next, so after the first of a size
+// nothing is allocated, and nothing is freed field by field.
+class StateArena {
+  public:
+    StateArena() : size_(0) {}
+
+    // A new, empty state.  The last one returned is gone.
+    proto::NES* New();
+
+  private:
+    std::unique_ptr<google::protobuf::Arena> arena_;
+    std::unique_ptr<char[]> block_;
+    size_t size_;
+};
+
+// A serialized state deflated, behind a header which tells it from one
+// which isn't.
+void CompressState(const std::string& state, std::string* out);
+bool IsCompressedState(const std::string& data);
+// Returns false if `data` isn't a compressed state or is corrupt.
+bool UncompressState(const std::string& data, std::string* out);
+
+}  // namespace protones
+#endif // PROTONES_NES_SAVE_STATE_H
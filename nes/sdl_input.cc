@@ -0,0 +1,175 @@
+#include "nes/sdl_input.h"
+
+#include "nes/controller.h"
+#include "proto/config.pb.h"
+#include "util/config.h"
+
+namespace protones {
+
+using proto::ControllerButtons;
+
+SdlInput::SdlInput(NES* nes)
+  : nes_(nes),
+    pads_(0) {
+    const auto& config = ConfigLoader<proto::Configuration>::GetConfig();
+    for(const auto& b : config.controls().buttons()) {
+        buttons_[b.scancode()] = b.button();
+    }
+    for(const auto& cont : config.controls().controller()) {
+        if (cont.number() == 0) {
+            for(const auto& b : cont.buttons()) {
+                keyb_[b.scancode()] = b.button();
+            }
+        }
+    }
+}
+
+void SdlInput::HandleKeyboard(SDL_Event* event) {
+    switch(event->type) {
+    case SDL_KEYDOWN: {
+        ControllerButtons b = buttons_[event->key.keysym.scancode];
+        switch (b) {
+        case ControllerButtons::ControllerPause:
+            nes_->set_pause(!nes_->pause());
+            break;
+        case ControllerButtons::ControllerFrameStep:
+            nes_->FrameStep();
+            break;
+        case ControllerButtons::ControllerReset:
+            nes_->Reset();
+            break;
+        case ControllerButtons::FastForward:
+            nes_->set_fast_forward(!nes_->fast_forward());
+            break;
+        case ControllerButtons::Controller2UpA:
+            SetButtons(1, Controller::BUTTON_UP | Controller::BUTTON_A);
+            break;
+        default:
+            HandleController(event);
+        }
+        }
+        break;
+    case SDL_KEYUP: {
+        ControllerButtons b = buttons_[event->key.keysym.scancode];
+        switch (b) {
+        case ControllerButtons::Controller2UpA:
+            SetButtons(1, 0);
+            break;
+        default:
+            HandleController(event);
+        }
+        }
+        break;
+    default:
+        ;
+    }
+}
+
+void SdlInput::HandleController(SDL_Event* event) {
+    int buttons = pads_ & 0xFF;
+    if (event->type == SDL_CONTROLLERBUTTONDOWN) {
+        switch(event->cbutton.button) {
+            case SDL_CONTROLLER_BUTTON_DPAD_UP:
+                buttons |= Controller::BUTTON_UP; break;
+            case SDL_CONTROLLER_BUTTON_DPAD_DOWN:
+                buttons |= Controller::BUTTON_DOWN; break;
+            case SDL_CONTROLLER_BUTTON_DPAD_LEFT:
+                buttons |= Controller::BUTTON_LEFT; break;
+            case SDL_CONTROLLER_BUTTON_DPAD_RIGHT:
+                buttons |= Controller::BUTTON_RIGHT; break;
+            case SDL_CONTROLLER_BUTTON_A:
+                // The xbox button names for A and B are opposite their
+                // classic NES A and B button positions.
+                buttons |= Controller::BUTTON_B; break;
+            case SDL_CONTROLLER_BUTTON_B:
+                // The xbox button names for A and B are opposite their
+                // classic NES A and B button positions.
+                buttons |= Controller::BUTTON_A; break;
+            case SDL_CONTROLLER_BUTTON_BACK:
+                buttons |= Controller::BUTTON_SELECT; break;
+            case SDL_CONTROLLER_BUTTON_START:
+                buttons |= Controller::BUTTON_START; break;
+        }
+    }
+    else if (event->type == SDL_CONTROLLERBUTTONUP) {
+        switch(event->cbutton.button) {
+            case SDL_CONTROLLER_BUTTON_DPAD_UP:
+                buttons &= ~Controller::BUTTON_UP; break;
+            case SDL_CONTROLLER_BUTTON_DPAD_DOWN:
+                buttons &= ~Controller::BUTTON_DOWN; break;
+            case SDL_CONTROLLER_BUTTON_DPAD_LEFT:
+                buttons &= ~Controller::BUTTON_LEFT; break;
+            case SDL_CONTROLLER_BUTTON_DPAD_RIGHT:
+                buttons &= ~Controller::BUTTON_RIGHT; break;
+            case SDL_CONTROLLER_BUTTON_A:
+                // The xbox button names for A and B are opposite their
+                // classic NES A and B button positions.
+                buttons &= ~Controller::BUTTON_B; break;
+            case SDL_CONTROLLER_BUTTON_B:
+                // The xbox button names for A and B are opposite their
+                // classic NES A and B button positions.
+                buttons &= ~Controller::BUTTON_A; break;
+            case SDL_CONTROLLER_BUTTON_BACK:
+                buttons &= ~Controller::BUTTON_SELECT; break;
+            case SDL_CONTROLLER_BUTTON_START:
+                buttons &= ~Controller::BUTTON_START; break;
+        }
+    } else if (event->type == SDL_CONTROLLERAXISMOTION) {
+        if (event->caxis.axis == 0) {
+            if (event->caxis.value < -3000) {
+                buttons |= Controller::BUTTON_LEFT;
+                buttons &= ~Controller::BUTTON_RIGHT;
+            } else if (event->caxis.value > 3000) {
+                buttons &= ~Controller::BUTTON_LEFT;
+                buttons |= Controller::BUTTON_RIGHT;
+            } else {
+                buttons &= ~Controller::BUTTON_LEFT;
+                buttons &= ~Controller::BUTTON_RIGHT;
+            }
+        } else if (event->caxis.axis == 1) {
+            if (event->caxis.value < -3000) {
+                buttons |= Controller::BUTTON_UP;
+                buttons &= ~Controller::BUTTON_DOWN;
+            } else if (event->caxis.value > 3000) {
+                buttons &= ~Controller::BUTTON_UP;
+                buttons |= Controller::BUTTON_DOWN;
+            } else {
+                buttons &= ~Controller::BUTTON_UP;
+                buttons &= ~Controller::BUTTON_DOWN;
+            }
+        }
+    } else if (event->type == SDL_KEYDOWN ||event->type == SDL_KEYUP) {
+#define SETCLR(val, bit, s) (val = (s) ? (val) | (bit) : (val) & ~(bit))
+        bool set = event->type == SDL_KEYDOWN;
+        switch(keyb_[event->key.keysym.scancode]) {
+        case ControllerButtons::ControllerUp:
+            SETCLR(buttons, Controller::BUTTON_UP, set); break;
+        case ControllerButtons::ControllerDown:
+            SETCLR(buttons, Controller::BUTTON_DOWN, set); break;
+        case ControllerButtons::ControllerLeft:
+            SETCLR(buttons, Controller::BUTTON_LEFT, set); break;
+        case ControllerButtons::ControllerRight:
+            SETCLR(buttons, Controller::BUTTON_RIGHT, set); break;
+        case ControllerButtons::ControllerSelect:
+            SETCLR(buttons, Controller::BUTTON_SELECT, set); break;
+        case ControllerButtons::ControllerStart:
+            SETCLR(buttons, Controller::BUTTON_START, set); break;
+        case ControllerButtons::ControllerA:
+            SETCLR(buttons, Controller::BUTTON_A, set); break;
+        case ControllerButtons::ControllerB:
+            SETCLR(buttons, Controller::BUTTON_B, set); break;
+        default:
+            // Nothing
+            ;
+        }
+    }
+    SetButtons(0, buttons);
+}
+
+void SdlInput::SetButtons(int n, int buttons) {
+    pads_ &= ~(0xFFu << (8 * n));
+    pads_ |= uint32_t(buttons & 0xFF) << (8 * n);
+    nes_->PostInput(pads_);
+}
+
+}  // namespace protones
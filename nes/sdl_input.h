@@ -0,0 +1,41 @@
+#ifndef PROTONES_NES_SDL_INPUT_H
+#define PROTONES_NES_SDL_INPUT_H
+#include <map>
+#include <SDL2/SDL.h>
+
+#include "nes/nes.h"
+#include "proto/controller.pb.h"
+
+namespace protones {
+
+// Turns SDL keyboard and game controller events into presses of the
+// emulated controllers' buttons and the emulator's own keys, using the
+// key bindings in the configuration.  The emulation core knows nothing
+// about SDL.
+//
+// The buttons are posted to the NES (see NES::PostInput), so the events
+// can be handled on another thread than the one emulating.  The
+// emulator's own keys touch the NES directly, with it locked.
+class SdlInput {
+  public:
+    explicit SdlInput(NES* nes);
+
+    // The emulator's keys (pause, frame step, reset), and otherwise the
+    // keys bound to controller 0.
+    void HandleKeyboard(SDL_Event* event);
+    // Game controller events and key bindings for controller 0.
+    void HandleController(SDL_Event* event);
+
+  private:
+    // Post the buttons of controller `n`.
+    void SetButtons(int n, int buttons);
+
+    NES* nes_;
+    // The buttons of all the controllers, a byte each.
+    uint32_t pads_;
+    std::map<int, proto::ControllerButtons> buttons_;
+    std::map<int, proto::ControllerButtons> keyb_;
+};
+
+}  // namespace protones
+#endif // PROTONES_NES_SDL_INPUT_H
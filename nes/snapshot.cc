@@ -0,0 +1,89 @@
+#include "nes/snapshot.h"
+
+#include <algorithm>
+
+namespace protones {
+
+void Snapshot::Begin(uint32_t crc, bool picture) {
+    Header header = {kMagic, kVersion, crc,
+                     (picture ? kPicture : 0) | (paged_ ? kPaged : 0), 0};
+    pos_ = 0;
+    page_pos_ = 0;
+    picture_ = picture;
+    SaveBytes(&header, sizeof(header));
+}
+
+void Snapshot::End() {
+    size_ = pos_;
+    pages_.resize(page_pos_);
+    Header header;
+    memcpy(&header, &data_[0], sizeof(header));
+    header.size = size_;
+    memcpy(&data_[0], &header, sizeof(header));
+}
+
+bool Snapshot::Open(uint32_t crc) {
+    if (size_ < sizeof(Header))
+        return false;
+    Header header;
+    memcpy(&header, &data_[0], sizeof(header));
+    if (header.magic != kMagic || header.version != kVersion ||
+        header.crc != crc || header.size != size_ ||
+        bool(header.flags & kPaged) != paged_) {
+        return false;
+    }
+    picture_ = header.flags & kPicture;
+    pos_ = sizeof(header);
+    page_pos_ = 0;
+    return true;
+}
+
+void Snapshot::Assign(const void* data, size_t size) {
+    pos_ = 0;
+    SaveBytes(data, size);
+    size_ = size;
+}
+
+void Snapshot::Grow(size_t size) {
+    // An NES's snapshots are all the same size, so this only happens the
+    // first time (and the first time with the picture).
+    size_t capacity = std::max(size, 2 * capacity_);
+    std::unique_ptr<uint8_t[]> data(new uint8_t[capacity]);
+    if (pos_) memcpy(data.get(), data_.get(), pos_);
+    data_ = std::move(data);
+    capacity_ = capacity;
+}
+
+void PagedRegion::Attach(const uint8_t* data, uint32_t size) {
+    data_ = data;
+    size_ = size;
+    uint32_t pages = (size + Snapshot::Page::kSize - 1) >>
+                     Snapshot::Page::kShift;
+    dirty_.assign(pages, true);
+    pages_.assign(pages, nullptr);
+}
+
+void PagedRegion::TouchAll() {
+    dirty_.assign(dirty_.size(), true);
+}
+
+void PagedRegion::Save(Snapshot* snap) {
+    if (!snap->paged()) {
+        snap->SaveBytes(data_, size_);
+        return;
+    }
+    for(size_t i=0; i<pages_.size(); i++) {
+        if (dirty_[i]) {
+            // The snapshots before keep the old page.
+            uint32_t offset = uint32_t(i) << Snapshot::Page::kShift;
+            auto page = std::make_shared<Snapshot::Page>();
+            memcpy(page->data, data_ + offset,
+                   std::min(size_ - offset, Snapshot::Page::kSize));
+            pages_[i] = std::move(page);
+            dirty_[i] = false;
+        }
+        snap->SavePage(pages_[i]);
+    }
+}
+
+}  // namespace protones
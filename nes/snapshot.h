@@ -0,0 +1,179 @@
+#ifndef PROTONES_NES_SNAPSHOT_H
+#define PROTONES_NES_SNAPSHOT_H
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace protones {
+
+// The state of an NES in one flat buffer, for saving and restoring it
+// many times a second, e.g. to run ahead, rewind or search.
+//
+// Each device copies its fields into the buffer in a fixed order, and
+// copies them back out in the same order, so saving and loading are a
+// series of memcpys.  The buffer is kept from one save to the next, so
+// after the first save of an NES nothing is allocated.
+//
+// A paged snapshot keeps the big blocks of memory (see PagedRegion) as
+// pages instead, shared with the other snapshots which have the same
+// ones.  Saving one copies only the pages written since the last save,
+// and loading one only the pages which differ, so keeping thousands of
+// them, e.g. to search from, takes memory for what actually changed.
+//
+// The layout is whatever the devices of this build write for this ROM.
+// A snapshot can only be loaded into an NES running the same ROM, and
+// isn't meant to be kept: convert it to a proto::NES (see
+// NES::ConvertState) to write it to a file.
+class Snapshot {
+  public:
+    // Bump whenever a device changes what it saves.
+    static const uint32_t kVersion = 2;
+
+    explicit Snapshot(bool paged=false)
+      : size_(0), capacity_(0), pos_(0), picture_(false), paged_(paged),
+        page_pos_(0) {}
+
+    // Start a snapshot of an NES running the ROM with CRC32 `crc`.
+    void Begin(uint32_t crc, bool picture);
+    // Finish the snapshot Begun.
+    void End();
+    // Start reading the snapshot back into an NES running the ROM with
+    // CRC32 `crc`.  Returns false, having read nothing, if it was made by
+    // another build or for another ROM.
+    bool Open(uint32_t crc);
+    // Whether the snapshot has the picture.
+    inline bool picture() const { return picture_; }
+    inline bool paged() const { return paged_; }
+    inline bool empty() const { return size_ == 0; }
+    inline size_t size() const { return size_; }
+    inline const uint8_t* data() const { return data_.get(); }
+    // Make this a copy of the flat snapshot with data() `data`, e.g. one
+    // which was kept compressed.
+    void Assign(const void* data, size_t size);
+
+    // Copy fields in and out, in the same order.
+    template<typename... T>
+    inline void Save(const T&... fields) {
+        static_assert((std::is_trivially_copyable<T>::value && ...),
+                      "Snapshot fields are copied as bytes");
+        (SaveBytes(&fields, sizeof(T)), ...);
+    }
+    template<typename... T>
+    inline void Load(T&... fields) {
+        static_assert((std::is_trivially_copyable<T>::value && ...),
+                      "Snapshot fields are copied as bytes");
+        (LoadBytes(&fields, sizeof(T)), ...);
+    }
+    inline void SaveBytes(const void* data, size_t len) {
+        if (pos_ + len > capacity_) Grow(pos_ + len);
+        memcpy(&data_[pos_], data, len);
+        pos_ += len;
+    }
+    inline void LoadBytes(void* data, size_t len) {
+        memcpy(data, &data_[pos_], len);
+        pos_ += len;
+    }
+    // The next `len` bytes, where they are.
+    inline const uint8_t* LoadBytes(size_t len) {
+        pos_ += len;
+        return &data_[pos_ - len];
+    }
+
+    // A paged snapshot's pages, in the same order.
+    struct Page {
+        static const int kShift = 8;
+        static const uint32_t kSize = 1 << kShift;
+        uint8_t data[kSize];
+    };
+    using PageRef = std::shared_ptr<const Page>;
+    inline void SavePage(const PageRef& page) {
+        if (page_pos_ < pages_.size()) {
+            pages_[page_pos_] = page;
+        } else {
+            pages_.push_back(page);
+        }
+        page_pos_++;
+    }
+    inline const PageRef& LoadPage() { return pages_[page_pos_++]; }
+
+  private:
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t crc;
+        uint32_t flags;
+        uint64_t size;
+    };
+    static const uint32_t kMagic = 0x53534e50;  // "PNSS"
+    static const uint32_t kPicture = 1;
+    static const uint32_t kPaged = 2;
+    void Grow(size_t size);
+
+    std::unique_ptr<uint8_t[]> data_;
+    size_t size_;
+    size_t capacity_;
+    size_t pos_;
+    bool picture_;
+    bool paged_;
+    std::vector<PageRef> pages_;
+    size_t page_pos_;
+};
+
+// A block of an NES's memory, kept in paged snapshots page by page.
+// Writes mark their page, and saving copies the pages marked since the
+// last save or load; the others are shared with the snapshot before.
+// Flat snapshots just copy the whole block.
+class PagedRegion {
+  public:
+    PagedRegion() : data_(nullptr), size_(0) {}
+    void Attach(const uint8_t* data, uint32_t size);
+    inline void Touch(uint32_t offset) {
+        dirty_[offset >> Snapshot::Page::kShift] = true;
+    }
+    // After the whole region was replaced, other than from a snapshot.
+    void TouchAll();
+
+    void Save(Snapshot* snap);
+    // Load into `to`, which is where the region is.
+    void Load(Snapshot* snap, uint8_t* to) {
+        Load(snap, [to](uint32_t offset, const uint8_t* data, uint32_t len) {
+            memcpy(to + offset, data, len);
+        });
+    }
+    // Load with `store(offset, data, len)`, for memory which must see
+    // what's written to it.  Only the pages which differ are stored.
+    template<typename Store>
+    void Load(Snapshot* snap, Store store);
+
+  private:
+    const uint8_t* data_;
+    uint32_t size_;
+    std::vector<bool> dirty_;
+    // The pages as the region was last saved or loaded.
+    std::vector<Snapshot::PageRef> pages_;
+};
+
+template<typename Store>
+void PagedRegion::Load(Snapshot* snap, Store store) {
+    if (!snap->paged()) {
+        store(0, snap->LoadBytes(size_), size_);
+        TouchAll();
+        return;
+    }
+    for(size_t i=0; i<pages_.size(); i++) {
+        const Snapshot::PageRef& page = snap->LoadPage();
+        if (page == pages_[i] && !dirty_[i])
+            continue;
+        uint32_t offset = uint32_t(i) << Snapshot::Page::kShift;
+        store(offset, page->data,
+              std::min(size_ - offset, Snapshot::Page::kSize));
+        pages_[i] = page;
+        dirty_[i] = false;
+    }
+}
+
+}  // namespace protones
+#endif // PROTONES_NES_SNAPSHOT_H
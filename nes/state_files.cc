@@ -0,0 +1,173 @@
+#include "nes/state_files.h"
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <sys/stat.h>
+
+#include "nes/nes.h"
+#include "nes/save_state.h"
+#include "util/file.h"
+
+namespace protones {
+
+StateFiles::StateFiles(NES* nes)
+  : nes_(nes),
+    busy_(false),
+    stop_(false) {
+    thread_ = std::thread(&StateFiles::Worker, this);
+}
+
+StateFiles::~StateFiles() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cond_.notify_all();
+    thread_.join();
+}
+
+void StateFiles::Save(const std::string& filename) {
+    Job job;
+    job.filename = filename;
+    job.state.reset(new proto::NES);
+    nes_->SaveState(job.state.get());
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    saving_[filename]++;
+    queue_.push_back(std::move(job));
+    cond_.notify_all();
+}
+
+bool StateFiles::Load(const std::string& filename) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [&]() { return saving_.count(filename) == 0; });
+    auto it = cache_.find(filename);
+    if (it != cache_.end() && Unchanged(filename, it->second)) {
+        return nes_->LoadState(it->second.data);
+    }
+    lock.unlock();
+    return nes_->LoadStateFromFile(filename);
+}
+
+void StateFiles::Prefetch(const std::string& filename) {
+    Job job;
+    job.filename = filename;
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(std::move(job));
+    cond_.notify_all();
+}
+
+void StateFiles::Sync() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [this]() { return queue_.empty() && !busy_; });
+}
+
+std::vector<std::string> StateFiles::TakeMessages() {
+    std::vector<std::string> messages;
+    std::lock_guard<std::mutex> lock(mutex_);
+    messages.swap(messages_);
+    return messages;
+}
+
+void StateFiles::Worker() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for(;;) {
+        cond_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+        // Finish the saves before stopping.
+        if (queue_.empty())
+            return;
+        Job job = std::move(queue_.front());
+        queue_.pop_front();
+        if (stop_ && !job.state)
+            continue;
+        busy_ = true;
+        lock.unlock();
+        if (job.state) {
+            SaveFile(job);
+        } else {
+            PrefetchFile(job.filename);
+        }
+        lock.lock();
+        busy_ = false;
+        cond_.notify_all();
+    }
+}
+
+void StateFiles::SaveFile(const Job& job) {
+    auto t0 = std::chrono::steady_clock::now();
+    Cached cached;
+    job.state->SerializeToString(&cached.data);
+    std::string compressed;
+    CompressState(cached.data, &compressed);
+    absl::Status status = File::Replace(job.filename, compressed);
+    double ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - t0).count();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (status.ok() && StatFile(job.filename, &cached)) {
+        cache_[job.filename] = std::move(cached);
+        Log("Saved %s (%zu bytes, %.1f ms)",
+            File::Basename(job.filename).c_str(), compressed.size(), ms);
+    } else {
+        cache_.erase(job.filename);
+        Log("[error] Could not save %s: %s", job.filename.c_str(),
+            std::string(status.message()).c_str());
+    }
+    if (--saving_[job.filename] == 0) {
+        saving_.erase(job.filename);
+    }
+}
+
+void StateFiles::PrefetchFile(const std::string& filename) {
+    Cached cached;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = cache_.find(filename);
+        if (it != cache_.end() && Unchanged(filename, it->second))
+            return;
+    }
+    // A slot which was never saved is fine.
+    if (!StatFile(filename, &cached))
+        return;
+    std::string data;
+    bool ok = File::GetContents(filename, &data);
+    if (ok && IsCompressedState(data)) {
+        ok = UncompressState(data, &cached.data);
+    } else {
+        cached.data.swap(data);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!ok) {
+        Log("[error] Could not read %s", filename.c_str());
+    } else if (saving_.count(filename) == 0) {
+        cache_[filename] = std::move(cached);
+    }
+}
+
+bool StateFiles::Unchanged(const std::string& filename, const Cached& cached) {
+    Cached now;
+    return StatFile(filename, &now) && now.size == cached.size &&
+           now.mtime == cached.mtime;
+}
+
+bool StateFiles::StatFile(const std::string& filename, Cached* cached) {
+    struct stat st;
+    if (stat(filename.c_str(), &st) == -1)
+        return false;
+    cached->size = st.st_size;
+    cached->mtime = st.st_mtime;
+    return true;
+}
+
+void StateFiles::Log(const char* fmt, ...) {
+    char buf[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    messages_.push_back(buf);
+}
+
+}  // namespace protones
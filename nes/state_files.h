@@ -0,0 +1,83 @@
+#ifndef PROTONES_NES_STATE_FILES_H
+#define PROTONES_NES_STATE_FILES_H
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "proto/nes.pb.h"
+
+namespace protones {
+
+class NES;
+
+// Saves states to files and loads them back, without making the NES wait
+// for the disk, e.g. for the save slots.
+//
+// Save only takes the state, as a proto.  A thread serializes and deflates
+// it, then replaces the file with it (see File::Replace), so a crash while
+// writing leaves the state which was there.  Prefetch has the thread read
+// and inflate a file ahead of loading it, and the states saved are kept
+// too, so Load usually only parses.  What the thread did, or couldn't do,
+// is kept for the frontend to show (see TakeMessages).
+class StateFiles {
+  public:
+    explicit StateFiles(NES* nes);
+    // Finishes the saves still queued.
+    ~StateFiles();
+
+    // Save the NES's state to `filename`.  Call with the NES locked.
+    void Save(const std::string& filename);
+    // Load the state in `filename`, after any save to it still queued.
+    // Call with the NES locked.
+    bool Load(const std::string& filename);
+    // Read `filename`, if it exists, to load it later.
+    void Prefetch(const std::string& filename);
+    // Wait for the thread to finish what it was given.
+    void Sync();
+    // What the thread finished or failed at since the last call.
+    std::vector<std::string> TakeMessages();
+
+  private:
+    struct Job {
+        std::string filename;
+        // The state to save, or null to prefetch the file.
+        std::unique_ptr<proto::NES> state;
+    };
+    // A state read ahead or saved, serialized, and its file's size and
+    // modification time then, to tell whether it changed since.
+    struct Cached {
+        std::string data;
+        int64_t size;
+        int64_t mtime;
+    };
+
+    void Worker();
+    void SaveFile(const Job& job);
+    void PrefetchFile(const std::string& filename);
+    // Whether the file is as it was when `cached` was kept.
+    static bool Unchanged(const std::string& filename, const Cached& cached);
+    static bool StatFile(const std::string& filename, Cached* cached);
+    // Call with mutex_ held.
+    void Log(const char* fmt, ...);
+
+    NES* nes_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::deque<Job> queue_;
+    // The saves queued or being written, by file.
+    std::map<std::string, int> saving_;
+    std::map<std::string, Cached> cache_;
+    std::vector<std::string> messages_;
+    bool busy_;
+    bool stop_;
+    std::thread thread_;
+};
+
+}  // namespace protones
+#endif // PROTONES_NES_STATE_FILES_H
@@ -0,0 +1,162 @@
+#include "nes/state_hash.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "absl/strings/str_cat.h"
+
+namespace protones {
+
+namespace {
+const char kMagic[4] = {'P', 'N', 'S', 'H'};
+const uint32_t kVersion = 1;
+
+void PutWord(uint8_t* p, uint32_t v) {
+    p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+uint32_t GetWord(const uint8_t* p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | uint32_t(p[3]) << 24;
+}
+}  // namespace
+
+uint64_t Fnv1a(uint64_t hash, const void* data, size_t len) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    for(size_t i=0; i<len; i++) {
+        hash = (hash ^ p[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+HashedRegion::HashedRegion()
+  : data_(nullptr),
+    size_(0),
+    changed_(false),
+    hash_(0) {
+}
+
+void HashedRegion::Attach(const uint8_t* data, uint32_t size) {
+    data_ = data;
+    size_ = size;
+    uint32_t chunks = (size + (1 << kChunkShift) - 1) >> kChunkShift;
+    chunk_.assign(chunks, 0);
+    dirty_.assign(chunks, true);
+    changed_ = true;
+    hash_ = 0;
+}
+
+void HashedRegion::TouchAll() {
+    dirty_.assign(dirty_.size(), true);
+    changed_ = true;
+}
+
+uint64_t HashedRegion::Hash() {
+    if (!changed_)
+        return hash_;
+    for(uint32_t i=0; i<chunk_.size(); i++) {
+        if (!dirty_[i])
+            continue;
+        uint32_t offset = i << kChunkShift;
+        uint32_t len = std::min(size_ - offset, uint32_t(1) << kChunkShift);
+        // Seed each chunk by where it is, so the chunks can be combined
+        // in any order.
+        uint64_t h = Fnv1a(kFnvBasis ^ (i * 0x9e3779b97f4a7c15ULL),
+                           data_ + offset, len);
+        hash_ ^= chunk_[i] ^ h;
+        chunk_[i] = h;
+        dirty_[i] = false;
+    }
+    changed_ = false;
+    return hash_;
+}
+
+const char* StateHash::name(int part) {
+    static const char* names[] = {
+        "cpu", "ram", "ppu", "apu", "mapper", "cartridge",
+    };
+    return part >= 0 && part < kParts ? names[part] : "?";
+}
+
+bool StateHash::operator==(const StateHash& that) const {
+    for(int i=0; i<kParts; i++) {
+        if (part[i] != that.part[i])
+            return false;
+    }
+    return true;
+}
+
+std::string StateHash::Diff(const StateHash& that) const {
+    std::string diff;
+    for(int i=0; i<kParts; i++) {
+        if (part[i] != that.part[i]) {
+            absl::StrAppend(&diff, diff.empty() ? "" : " ", name(i));
+        }
+    }
+    return diff;
+}
+
+StateHashLog::~StateHashLog() {
+    if (fp_) fclose(fp_);
+}
+
+bool StateHashLog::Create(const std::string& filename, uint32_t crc) {
+    fp_ = fopen(filename.c_str(), "wb");
+    if (fp_ == nullptr) {
+        fprintf(stderr, "Could not create %s\n", filename.c_str());
+        return false;
+    }
+    uint8_t header[16];
+    memcpy(header, kMagic, 4);
+    PutWord(header + 4, kVersion);
+    PutWord(header + 8, crc);
+    PutWord(header + 12, StateHash::kParts);
+    fwrite(header, 1, sizeof(header), fp_);
+    return true;
+}
+
+bool StateHashLog::Open(const std::string& filename, uint32_t crc) {
+    FILE* fp = fopen(filename.c_str(), "rb");
+    if (fp == nullptr) {
+        fprintf(stderr, "Could not open %s\n", filename.c_str());
+        return false;
+    }
+    uint8_t header[16];
+    bool ok = fread(header, 1, sizeof(header), fp) == sizeof(header) &&
+              memcmp(header, kMagic, 4) == 0 &&
+              GetWord(header + 4) == kVersion &&
+              GetWord(header + 12) == StateHash::kParts;
+    if (!ok) {
+        fprintf(stderr, "%s is not a state hash log\n", filename.c_str());
+    } else if (GetWord(header + 8) != crc) {
+        fprintf(stderr, "%s was recorded with another ROM (CRC32 %08x)\n",
+                filename.c_str(), GetWord(header + 8));
+        ok = false;
+    }
+    uint8_t record[4 * StateHash::kParts];
+    while(ok && fread(record, 1, sizeof(record), fp) == sizeof(record)) {
+        StateHash hash;
+        for(int i=0; i<StateHash::kParts; i++) {
+            hash.part[i] = GetWord(record + 4 * i);
+        }
+        frames_.push_back(hash);
+    }
+    fclose(fp);
+    return ok;
+}
+
+void StateHashLog::Append(const StateHash& hash) {
+    uint8_t record[4 * StateHash::kParts];
+    for(int i=0; i<StateHash::kParts; i++) {
+        PutWord(record + 4 * i, hash.part[i]);
+    }
+    fwrite(record, 1, sizeof(record), fp_);
+}
+
+bool StateHashLog::Get(uint64_t frame, StateHash* hash) const {
+    if (frame == 0 || frame > frames_.size())
+        return false;
+    *hash = frames_[frame - 1];
+    return true;
+}
+
+}  // namespace protones
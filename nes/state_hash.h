@@ -0,0 +1,73 @@
+#ifndef PROTONES_NES_STATE_HASH_H
+#define PROTONES_NES_STATE_HASH_H
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace protones {
+
+// A block of memory hashed in 64 byte chunks.  Writes mark their chunk,
+// and only the chunks marked since the last Hash are hashed again, so
+// hashing every frame costs about what the frame wrote.
+class HashedRegion {
+  public:
+    HashedRegion();
+    void Attach(const uint8_t* data, uint32_t size);
+    inline void Touch(uint32_t offset) {
+        dirty_[offset >> kChunkShift] = true;
+        changed_ = true;
+    }
+    // After the whole region was replaced, e.g. by loading a state.
+    void TouchAll();
+    uint64_t Hash();
+
+  private:
+    static const int kChunkShift = 6;
+    const uint8_t* data_;
+    uint32_t size_;
+    std::vector<uint64_t> chunk_;
+    std::vector<bool> dirty_;
+    bool changed_;
+    uint64_t hash_;
+};
+
+// 64-bit FNV-1a.
+uint64_t Fnv1a(uint64_t hash, const void* data, size_t len);
+const uint64_t kFnvBasis = 0xcbf29ce484222325ULL;
+
+// The hash of the emulated state at the end of a frame, in parts, so a
+// mismatch says where to look.
+struct StateHash {
+    enum Part { CPU, RAM, PPU, APU, MAPPER, CARTRIDGE, kParts };
+    static const char* name(int part);
+    uint32_t part[kParts] = {};
+
+    bool operator==(const StateHash& that) const;
+    bool operator!=(const StateHash& that) const { return !(*this == that); }
+    // The parts which differ, by name.
+    std::string Diff(const StateHash& that) const;
+};
+
+// A movie's sidecar log of the state hash after every frame.  After a
+// small header, each frame is kParts 32-bit words, little endian.
+class StateHashLog {
+  public:
+    StateHashLog() : fp_(nullptr) {}
+    ~StateHashLog();
+    // Start a new log, for a ROM with CRC32 `crc`.
+    bool Create(const std::string& filename, uint32_t crc);
+    // Read a log to verify against.
+    bool Open(const std::string& filename, uint32_t crc);
+    void Append(const StateHash& hash);
+    // The hash recorded after `frame` (counting from 1), or false if the
+    // log doesn't go that far.
+    bool Get(uint64_t frame, StateHash* hash) const;
+
+  private:
+    FILE* fp_;
+    std::vector<StateHash> frames_;
+};
+
+}  // namespace protones
+#endif // PROTONES_NES_STATE_HASH_H
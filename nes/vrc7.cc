@@ -1,5 +1,7 @@
 #include "nes/mapper.h"
 
+#include <mutex>
+
 #include "nes/base.h"
 #include "nes/pbmacro.h"
 #include "nes/cpu6502.h"
@@ -33,10 +35,18 @@ class VRC7AudioDebug: public APUDevice {
     char status_[NSTATUS][64];
 };
 
+// The OPLL emulators fill in their shared tables when the first chip is
+// created, so create one at a time.
+static VRC7AudioPtr NewVRC7Audio() {
+    static std::mutex mutex;
+    std::lock_guard<std::mutex> lock(mutex);
+    return VRC7Audio_New(3579545, 44100);
+}
+
 class VRC7: public Mapper {
   public:
     VRC7(NES* nes):
-        Mapper(nes),
+        Mapper(nes, ClockCpu),
         prg_banks_(nes_->cartridge()->prglen() / 0x2000),
         prg_bank_{0,},
         chr_banks_(nes_->cartridge()->chrlen() / 0x400),
@@ -47,7 +57,7 @@ class VRC7: public Mapper {
         irq_counter_(0),
         cycle_counter_(0),
         oplidx_(0),
-        opl_(VRC7Audio_New(3579545, 44100)),
+        opl_(NewVRC7Audio()),
         opl_freq_{0,}
     {
         const char *names[] = {
@@ -101,6 +111,30 @@ class VRC7: public Mapper {
         SAVE_ARRAYS(prg_bank, chr_bank);
     }
 
+    void LoadState(Snapshot* snap) {
+        snap->Load(prg_banks_,
+                   chr_banks_,
+                   mirror_,
+                   irq_latch_,
+                   irq_control_,
+                   irq_counter_,
+                   cycle_counter_,
+                   oplidx_,
+                   prg_bank_, chr_bank_);
+    }
+
+    void SaveState(Snapshot* snap) {
+        snap->Save(prg_banks_,
+                   chr_banks_,
+                   mirror_,
+                   irq_latch_,
+                   irq_control_,
+                   irq_counter_,
+                   cycle_counter_,
+                   oplidx_,
+                   prg_bank_, chr_bank_);
+    }
+
     uint8_t Read(uint16_t addr) override {
         if (addr < 0x2000) {
             uint32_t n = addr / 0x400;
@@ -128,6 +162,16 @@ class VRC7: public Mapper {
         return 0;
     }
 
+    int PrgWindow(uint16_t addr) override {
+        switch(addr & 0xE000) {
+            case 0x6000: return mirror_ & 0x80 ? kSramWindow : -1;
+            case 0x8000: return prg_bank_[0] % prg_banks_;
+            case 0xA000: return prg_bank_[1] % prg_banks_;
+            case 0xC000: return prg_bank_[2] % prg_banks_;
+            default:     return prg_banks_ - 1;
+        }
+    }
+
     void WriteAudio(uint8_t idx, uint8_t val) {
         const char *instruments[] = {
             // Name in FamiTracker, Name in https://wiki.nesdev.org/w/index.php?title=VRC7_audio
@@ -240,9 +284,10 @@ unhandled:
         }
     }
 
-    void Emulate() {
+    void CpuCycles(int n) override {
+        // The IRQ prescaler counts 341 PPU dots per scanline.
         if (irq_control_ & 2) {
-            cycle_counter_++;
+            cycle_counter_ += n * 3;
             while (cycle_counter_ >= 341) {
                 cycle_counter_ -= 341;
                 irq_counter_++;
@@ -0,0 +1,13 @@
+#include "nes/wav_sink.h"
+
+namespace protones {
+
+WavSink::WavSink(const std::string& filename)
+  : file_(filename, SFM_WRITE, SF_FORMAT_WAV|SF_FORMAT_FLOAT, 1, 44100) {
+}
+
+void WavSink::Write(float sample) {
+    file_.write(&sample, 1);
+}
+
+}  // namespace protones
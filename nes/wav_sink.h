@@ -0,0 +1,21 @@
+#ifndef PROTONES_NES_WAV_SINK_H
+#define PROTONES_NES_WAV_SINK_H
+#include <string>
+
+#include "nes/apu.h"
+#include "sndfile.hh"
+
+namespace protones {
+
+// Records the APU's output to a WAV file.
+class WavSink : public AudioSink {
+  public:
+    explicit WavSink(const std::string& filename);
+    void Write(float sample) override;
+
+  private:
+    SndfileHandle file_;
+};
+
+}  // namespace protones
+#endif // PROTONES_NES_WAV_SINK_H
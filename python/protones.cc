@@ -1,3 +1,5 @@
+#include <mutex>
+
 #include "nes/apu.h"
 #include "nes/cartridge.h"
 #include "nes/controller.h"
@@ -16,6 +18,16 @@
 namespace protones {
 namespace py = pybind11;
 
+namespace {
+// One bank of the execution profile, exposed through the buffer protocol
+// so python (and numpy) can read the counts without copying them.  It holds
+// the profile's python object, which holds the NES.
+struct ProfileBank {
+    const uint32_t* counts;
+    py::object profile;
+};
+}  // namespace
+
 PYBIND11_EMBEDDED_MODULE(protones, m) {
     py::class_<NES, std::shared_ptr<NES> >(m, "NES")
         .def("cpu_cycles", &NES::cpu_cycles, "CPU cycles since reset")
@@ -23,35 +35,110 @@ PYBIND11_EMBEDDED_MODULE(protones, m) {
         .def("frame", &NES::frame, "Frames since reset")
         .def("palette", &NES::palette, "Translate a NES color to RGBA")
         .def("Emulate", &NES::EmulateFrame, "Emulate for one CPU instruction")
-        .def("EmulateFrame", &NES::EmulateFrame, "Emulate a single frame")
+        .def("EmulateFrame", [](NES* self) {
+                // The frontend emulates on a thread of its own: let the
+                // other threads have python meanwhile, but not the NES.
+                py::gil_scoped_release nogil;
+                std::lock_guard<std::recursive_mutex> lock(self->mutex());
+                return self->EmulateFrame();
+            }, "Emulate a single frame")
         .def("Reset", &NES::Reset, "Reset the emulation")
         .def("IRQ", &NES::IRQ, "Signal an IRQ to the CPU")
         .def("NMI", &NES::NMI, "Signal an NMI to the CPU")
-        .def("LoadState", &NES::LoadState, "Load an emulator state")
-        .def("SaveState", &NES::SaveState,
-             "Save an emulator state",
-             py::arg("text")=false)
+        .def("LoadState",
+             py::overload_cast<const std::string&>(&NES::LoadState),
+             "Load an emulator state")
+        .def("SaveState", [](NES* self, bool text, bool picture,
+                             bool compress) {
+                SaveStateOptions options;
+                options.text = text;
+                options.picture = picture;
+                options.compress = compress;
+                std::string data = self->SaveState(options);
+                // Serialized or compressed states aren't text.
+                if (text && !compress)
+                    return py::object(py::str(data));
+                return py::object(py::bytes(data));
+            }, "Save an emulator state",
+             py::arg("text")=false, py::arg("picture")=true,
+             py::arg("compress")=false)
+        .def("LoadSnapshot",
+             py::overload_cast<Snapshot*>(&NES::LoadState),
+             "Load the state from a snapshot",
+             py::arg("snapshot"))
+        .def("SaveSnapshot",
+             py::overload_cast<Snapshot*, bool>(&NES::SaveState),
+             "Save the state into a snapshot",
+             py::arg("snapshot"), py::arg("picture")=true)
         .def("LoadStateFromFile", &NES::LoadStateFromFile,
              "Load an emulator state from a file",
              py::arg("filename"))
         .def("LoadEverdriveStateFromFile", &NES::LoadEverdriveStateFromFile,
              "Load an everdrive state from a file",
              py::arg("filename"))
-        .def("SaveStateToFile", &NES::SaveStateToFile,
-             "Save an emulator state to a file",
-             py::arg("filename"), py::arg("text")=false)
+        .def("SaveStateToFile", [](NES* self, const std::string& filename,
+                                   bool text, bool picture, bool compress) {
+                SaveStateOptions options;
+                options.text = text;
+                options.picture = picture;
+                options.compress = compress;
+                return self->SaveStateToFile(filename, options);
+            }, "Save an emulator state to a file",
+             py::arg("filename"), py::arg("text")=false,
+             py::arg("picture")=true, py::arg("compress")=false)
         .def("GetMapperReg", [](NES* self, int reg) -> uint8_t {
                 return self->mapper()->RegisterValue(Mapper::PseudoRegister(reg));
             }, py::arg("register"))
         .def_property("pause", &NES::pause, &NES::set_pause)
         .def_property_readonly("frame_profile", &NES::frame_profile,
+                               py::return_value_policy::reference_internal,
                                "Frame execution profile")
+        .def_property("profile", &NES::profile, &NES::set_profile,
+                      "Collect the frame execution profile")
+        .def_property_readonly("idle_cycles", &NES::idle_cycles,
+                               "CPU cycles spent in idle loops last frame")
+        .def_property("idle_skip", &NES::idle_skip, &NES::set_idle_skip,
+                      "Skip through CPU idle loops")
+        .def_property("run_ahead", &NES::run_ahead, &NES::set_run_ahead,
+                      "Frames to emulate ahead of the one shown")
+        .def_property("fast_forward", &NES::fast_forward,
+                      &NES::set_fast_forward, "Fast forward")
+        .def_property("fast_forward_speed", &NES::fast_forward_speed,
+                      &NES::set_fast_forward_speed,
+                      "Fast forward speed multiplier (0 for uncapped)")
+        .def_property_readonly("speedup", &NES::speedup,
+                               "Emulation speed relative to the NES")
+        .def_property_readonly("run_ahead_timing", &NES::run_ahead_timing,
+                               py::return_value_policy::copy,
+                               "What run-ahead cost last frame")
         .def_property_readonly("mem", &NES::mem, "NES memory")
         .def_property_readonly("cartridge", &NES::cartridge)
         .def_property_readonly("cpu", &NES::cpu)
         .def_property_readonly_static("frequency",
                 [](py::object /*self*/){ return NES::frequency; });
 
+    py::class_<Snapshot>(m, "Snapshot")
+        .def(py::init<bool>(), py::arg("paged")=false)
+        .def_property_readonly("picture", &Snapshot::picture,
+                               "Whether the snapshot has the picture")
+        .def_property_readonly("paged", &Snapshot::paged,
+                               "Whether memory is kept in shared pages")
+        .def_property_readonly("size", &Snapshot::size, "Size in bytes");
+
+    py::class_<RunAheadTiming>(m, "RunAheadTiming")
+        .def_readonly("frames", &RunAheadTiming::frames,
+                      "Frames emulated ahead")
+        .def_readonly("frame", &RunAheadTiming::frame,
+                      "Seconds spent on the frame played")
+        .def_readonly("save", &RunAheadTiming::save,
+                      "Seconds spent saving the state")
+        .def_readonly("ahead", &RunAheadTiming::ahead,
+                      "Seconds spent on the frames ahead")
+        .def_readonly("load", &RunAheadTiming::load,
+                      "Seconds spent loading the state")
+        .def_property_readonly("per_frame", &RunAheadTiming::per_frame,
+                               "Seconds each frame of run-ahead cost");
+
     py::class_<Cartridge>(m, "Cartridge")
         .def_property_readonly("mirror", &Cartridge::mirror, "Mirror mode")
         .def_property_readonly("battery", &Cartridge::battery,
@@ -64,7 +151,63 @@ PYBIND11_EMBEDDED_MODULE(protones, m) {
         .def("ReadSram", &Cartridge::ReadSram, "Read SRAM")
         .def("WritePrg", &Cartridge::WritePrg, "Write PRG ROM")
         .def("WriteChr", &Cartridge::WriteChr, "Write CHR Rom")
-        .def("WriteSram", &Cartridge::WriteSram, "Write SRAM");
+        .def("WriteSram", &Cartridge::WriteSram, "Write SRAM")
+        .def_property_readonly("cdl", &Cartridge::cdl,
+                               py::return_value_policy::reference,
+                               "Code/data log (None unless --cdl is set)");
+
+    py::class_<CodeDataLog>(m, "CodeDataLog")
+        .def_property_readonly("prglen", &CodeDataLog::prglen,
+                               "PRG length (bytes)")
+        .def_property_readonly("chrlen", &CodeDataLog::chrlen,
+                               "CHR length (bytes)")
+        .def("prg", [](const CodeDataLog& self, uint32_t offset) {
+                if (offset >= self.prglen())
+                    throw py::index_error("PRG offset out of range");
+                return self.prg(offset);
+            }, "Flags for a PRG ROM offset")
+        .def("chr", [](const CodeDataLog& self, uint32_t offset) {
+                if (offset >= self.chrlen())
+                    throw py::index_error("CHR offset out of range");
+                return self.chr(offset);
+            }, "Flags for a CHR ROM offset")
+        .def("Flush", &CodeDataLog::Flush, "Write the changes to the file")
+        .def("Clear", &CodeDataLog::Clear, "Forget everything logged");
+
+    py::class_<ProfileBank>(m, "ProfileBank", py::buffer_protocol())
+        .def_buffer([](ProfileBank& self) {
+            // The buffer is only ever exported read only (see
+            // ExecutionProfile.bank).
+            return py::buffer_info(
+                const_cast<uint32_t*>(self.counts), sizeof(uint32_t),
+                py::format_descriptor<uint32_t>::format(), 1,
+                {ExecutionProfile::kBankSize}, {sizeof(uint32_t)});
+        });
+
+    py::class_<ExecutionProfile>(m, "ExecutionProfile")
+        .def("bank", [](py::object self, int bank) -> py::object {
+                const uint32_t* counts =
+                    self.cast<const ExecutionProfile&>().bank(bank);
+                if (!counts) return py::none();
+                py::memoryview view(py::cast(ProfileBank{counts, self}));
+                return view.attr("toreadonly")();
+            }, py::arg("bank"),
+            "Cycles at each pc in a bank (a read-only memoryview valid for "
+            "one frame)")
+        .def_property_readonly("banks", &ExecutionProfile::banks,
+                               "Banks code ran from")
+        .def_property_readonly("idle", &ExecutionProfile::idle,
+                               "Cycles spent in idle loops")
+        .def_property_readonly("total", &ExecutionProfile::total,
+                               "Cycles in the frame")
+        .def("Sum", &ExecutionProfile::Sum,
+             "Cycles spent in an address range of a bank",
+             py::arg("bank"), py::arg("first"), py::arg("last"))
+        .def("BankTotals", &ExecutionProfile::BankTotals,
+             "(bank, cycles) for each bank, with idle loops as bank -1")
+        .def("Top", &ExecutionProfile::Top,
+             "The (bank << 16 | pc, cycles) the most cycles were spent at",
+             py::arg("n")=20);
 
     py::class_<Controller>(m, "Controller")
         .def_property("buttons",
@@ -80,6 +223,21 @@ PYBIND11_EMBEDDED_MODULE(protones, m) {
         .def_property("flags", &Cpu::flags, &Cpu::set_flags)
         .def_property("pc", &Cpu::pc, &Cpu::set_pc)
         .def_property_readonly("irq_pending", &Cpu::irq_pending)
+        .def_property("instrumented", &Cpu::instrumented,
+                      &Cpu::set_instrumented,
+                      "Run the instrumented CPU path (always on while hooks are set)")
+        .def_property_readonly("icache_hits", &Cpu::icache_hits,
+                               "Decoded instruction cache hits")
+        .def_property_readonly("icache_misses", &Cpu::icache_misses,
+                               "Decoded instruction cache misses")
+        .def("ClearIcacheStats", &Cpu::ClearIcacheStats,
+             "Reset the decoded instruction cache statistics")
+        .def_property("jit", &Cpu::jit, &Cpu::set_jit,
+                      "Translate hot basic blocks to host code")
+        .def_property_readonly("jit_blocks", &Cpu::jit_blocks,
+                               "Number of blocks translated")
+        .def_property("trace", &Cpu::trace, &Cpu::set_trace,
+                      "Record every instruction executed")
         .def("Flush", &Cpu::Flush, "Flush the trace buffer")
         .def("Reset", &Cpu::Reset, "Reset the CPU")
         .def("IRQ", &Cpu::IRQ, "Signal an IRQ to the CPU")
@@ -87,8 +245,8 @@ PYBIND11_EMBEDDED_MODULE(protones, m) {
         .def("SetReadCallback", &Cpu::set_read_cb)
         .def("SetWriteCallback", &Cpu::set_write_cb)
         .def("SetExecCallback", &Cpu::set_exec_cb)
-        .def("SaveRwLog", &Cpu::SaveRwLog)
-        .def("ClearRwLog", &Cpu::ClearRwLog)
+        .def("ClearCallbacks", &Cpu::ClearCallbacks,
+             "Remove all read, write and exec callbacks")
         .def("Disassemble", [](Cpu* self, uint16_t addr) {
             std::string s = self->Disassemble(&addr);
             return std::make_pair(addr, s);
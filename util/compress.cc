@@ -7,12 +7,12 @@
 #include "util/status.h"
 
 
-std::string ZLib::Compress(const std::string& data) {
+std::string ZLib::Compress(const std::string& data, int level) {
     unsigned long size = compressBound(data.size());
     std::string buf;
     buf.resize(size);
     if (compress2((unsigned char*)buf.data(), &size,
-                  (const unsigned char*)data.data(), data.size(), -1) != Z_OK) {
+                  (const unsigned char*)data.data(), data.size(), level) != Z_OK) {
         LOG(FATAL, "Failed to compress rom buffer.");
     }
     buf.resize(size);
@@ -6,7 +6,12 @@
 
 class ZLib {
   public:
-    static std::string Compress(const std::string& data);
+    // zlib's compression levels: 1 is the fastest, 9 the smallest.
+    static const int kBestSpeed = 1;
+    static const int kDefaultCompression = -1;
+
+    static std::string Compress(const std::string& data,
+                                int level=kDefaultCompression);
     static StatusOr<std::string> Uncompress(const std::string& data, int size=0);
 };
 
@@ -3,6 +3,7 @@
 #include <string>
 #include <vector>
 
+#include <fcntl.h>
 #include <libgen.h>
 #include <limits.h>
 
@@ -60,6 +61,49 @@ bool File::SetContents(const std::string& filename, const std::string& contents)
     return f->Write(contents);
 }
 
+absl::Status File::Replace(const std::string& filename,
+                           const std::string& contents) {
+    std::string tmp = absl::StrCat(filename, ".tmp");
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        return util::PosixStatus(errno);
+    }
+    const char* p = contents.data();
+    size_t len = contents.size();
+    while(len) {
+        ssize_t n = write(fd, p, len);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            int error = errno;
+            close(fd);
+            unlink(tmp.c_str());
+            return util::PosixStatus(error);
+        }
+        p += n;
+        len -= n;
+    }
+    int error = fsync(fd) == -1 ? errno : 0;
+    if (close(fd) == -1 && !error)
+        error = errno;
+    if (error) {
+        unlink(tmp.c_str());
+        return util::PosixStatus(error);
+    }
+    if (rename(tmp.c_str(), filename.c_str()) == -1) {
+        int error = errno;
+        unlink(tmp.c_str());
+        return util::PosixStatus(error);
+    }
+    // Sync the directory too, so the rename itself survives a crash.
+    int dir = open(Dirname(filename).c_str(), O_RDONLY);
+    if (dir != -1) {
+        fsync(dir);
+        close(dir);
+    }
+    return absl::OkStatus();
+}
+
 std::string File::Basename(const std::string& path) {
     char buf[PATH_MAX];
     memcpy(buf, path.data(), path.size());
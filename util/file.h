@@ -83,6 +83,10 @@ class File {
                                       const std::string& mode);
     static bool GetContents(const std::string& filename, std::string* contents);
     static bool SetContents(const std::string& filename, const std::string& contents);
+    // Write `contents` to a temporary file, sync it and rename it over
+    // `filename`, so a crash leaves either the old file or the new one.
+    static absl::Status Replace(const std::string& filename,
+                                const std::string& contents);
 
     static std::string Basename(const std::string& path);
     static std::string Dirname(const std::string& path);